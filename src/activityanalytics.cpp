@@ -0,0 +1,127 @@
+#include "activityanalytics.h"
+#include "geo.h"
+
+#include <stdio.h>
+
+RollingWindow::RollingWindow(qint64 length)
+    : m_head(0), m_length(length), m_best(0), m_bestEndTime(-1)
+{
+}
+
+/*!
+    Adds the point where the integral of the value reached \a integral at
+    \a time. Between two points the value is assumed to be constant, so the
+    integral is linear.
+*/
+void RollingWindow::add(qint64 time, double integral)
+{
+    Point point;
+    point.time = time;
+    point.integral = integral;
+    m_points.append(point);
+
+    const qint64 windowStart = time - m_length;
+    while (m_head + 1 < m_points.count() && m_points.at(m_head + 1).time <= windowStart)
+        ++m_head;
+    const Point &first = m_points.at(m_head);
+    if (first.time <= windowStart) {
+        double startIntegral = first.integral;
+        if (first.time < windowStart) {
+            const Point &next = m_points.at(m_head + 1);
+            startIntegral += (next.integral - first.integral) * (windowStart - first.time) / (next.time - first.time);
+        }
+        const double average = (integral - startIntegral) / m_length;
+        if (m_bestEndTime == -1 || average > m_best) {
+            m_best = average;
+            m_bestEndTime = time;
+        }
+    }
+
+    // Drop the points that slid out of the window now and then
+    if (m_head > 64 && m_head * 2 > m_points.count()) {
+        m_points.remove(0, m_head);
+        m_head = 0;
+    }
+}
+
+static const qint64 effortLengths[ActivityAnalytics::EffortCount] = {
+    60 * 1000, 5 * 60 * 1000, 20 * 60 * 1000
+};
+
+ActivityAnalytics::ActivityAnalytics()
+    : m_maximumHR(0), m_count(0), m_speedIntegral(0), m_rollingSpeed(30 * 1000)
+{
+    for (int i = 0; i < ZoneCount; ++i)
+        m_timeInZone[i] = 0;
+    for (int i = 0; i < EffortCount; ++i)
+        m_efforts[i] = RollingWindow(effortLengths[i]);
+}
+
+/*!
+    Returns the zone of \a hr: below 60% of the maximum HR is zone 0, and each
+    10% above that is the next zone. Returns -1 if no maximum HR is set.
+*/
+int ActivityAnalytics::zoneOf(int hr) const
+{
+    if (m_maximumHR <= 0)
+        return -1;
+    const int zone = (hr * 10 / m_maximumHR) - 5;
+    return qBound(0, zone, ZoneCount - 1);
+}
+
+/*!
+    Adds \a sample, which must not be earlier than the previously added sample.
+    The HR and speed of a sample count until the time of the next sample.
+*/
+void ActivityAnalytics::add(const GpsSample &sample)
+{
+    if (m_count > 0) {
+        const qint64 elapsed = sample.time - m_prev.time;
+        if (elapsed > 0) {
+            const int zone = zoneOf(m_prev.hr);
+            if (zone >= 0)
+                m_timeInZone[zone] += elapsed;
+
+            double speed = m_prev.speed;
+            if (speed < 0)
+                speed = segmentDistance(m_prev.lat, m_prev.lon, sample.lat, sample.lon) * 3600000.0 / elapsed;
+            m_speedIntegral += speed * elapsed;
+        }
+    }
+    m_rollingSpeed.add(sample.time, m_speedIntegral);
+    for (int i = 0; i < EffortCount; ++i)
+        m_efforts[i].add(sample.time, m_speedIntegral);
+    m_prev = sample;
+    ++m_count;
+}
+
+void ActivityAnalytics::addSamples(const SampleData &samples)
+{
+    foreach (const GpsSample &sample, samples)
+        add(sample);
+}
+
+static void printWindow(const char *label, const RollingWindow &window)
+{
+    if (window.isValid())
+        printf("%s%.1f (ending %s)\n", label, window.best(), qPrintable(msToDateTimeString(window.bestEndTime())));
+}
+
+void ActivityAnalytics::print() const
+{
+    if (m_maximumHR > 0) {
+        static const char *zoneLabels[ZoneCount] = {
+            "HR zone 1 (<60%):  ",
+            "HR zone 2 (60-70%):",
+            "HR zone 3 (70-80%):",
+            "HR zone 4 (80-90%):",
+            "HR zone 5 (>=90%): "
+        };
+        for (int i = 0; i < ZoneCount; ++i)
+            printf("%s %s\n", zoneLabels[i], qPrintable(msToTimeString(m_timeInZone[i])));
+    }
+    printWindow("Best 30s speed: ", m_rollingSpeed);
+    printWindow("Best 1min speed:", m_efforts[0]);
+    printWindow("Best 5min speed:", m_efforts[1]);
+    printWindow("Best 20min speed:", m_efforts[2]);
+}
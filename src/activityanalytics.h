@@ -0,0 +1,78 @@
+#ifndef ACTIVITYANALYTICS_H
+#define ACTIVITYANALYTICS_H
+
+#include "gpssample.h"
+
+/*
+    Best average of a value over a sliding time window.
+
+    The window is fed the running integral of the value over time (a prefix
+    sum), so the average over any window is the difference of two integrals.
+    Only the points inside the window are kept, so memory depends on the
+    window length and not on the length of the track.
+*/
+class RollingWindow {
+public:
+    explicit RollingWindow(qint64 length = 0);
+
+    void add(qint64 time, double integral);
+
+    qint64 length() const { return m_length; }
+    bool isValid() const { return m_bestEndTime != -1; }
+    double best() const { return m_best; }
+    qint64 bestEndTime() const { return m_bestEndTime; }
+
+private:
+    struct Point {
+        qint64 time;
+        double integral;
+    };
+    QVector<Point> m_points;
+    int m_head;
+    qint64 m_length;
+    double m_best;
+    qint64 m_bestEndTime;
+};
+
+/*
+    Analytics that are computed while the samples are streamed through add():
+    time in HR zone, the best 30 second speed and the best 1, 5 and 20 minute
+    efforts. Each sample costs O(1).
+
+    The HRM and GPX files carry no power data, so the efforts are measured as
+    average speed. Samples without speed (GPX data) get the speed computed
+    from the distance to the previous sample.
+*/
+class ActivityAnalytics {
+public:
+    enum {
+        ZoneCount = 5,
+        EffortCount = 3
+    };
+
+    ActivityAnalytics();
+
+    void setMaximumHR(int maximumHR) { m_maximumHR = maximumHR; }
+    int maximumHR() const { return m_maximumHR; }
+
+    void add(const GpsSample &sample);
+    void addSamples(const SampleData &samples);
+
+    int zoneOf(int hr) const;
+    qint64 timeInZone(int zone) const { return m_timeInZone[zone]; }
+    const RollingWindow &rollingSpeed() const { return m_rollingSpeed; }
+    const RollingWindow &bestEffort(int effort) const { return m_efforts[effort]; }
+
+    void print() const;
+
+private:
+    int m_maximumHR;
+    int m_count;
+    GpsSample m_prev;
+    double m_speedIntegral;     // km/h * ms
+    qint64 m_timeInZone[ZoneCount];
+    RollingWindow m_rollingSpeed;
+    RollingWindow m_efforts[EffortCount];
+};
+
+#endif // ACTIVITYANALYTICS_H
@@ -0,0 +1,433 @@
+#include "clockalignment.h"
+#include "geo.h"
+
+#include <math.h>
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+namespace {
+
+enum {
+    GridStep = 1000,        // ms
+    MaximumGap = 10000,     // ms without samples before the grid is marked as missing
+    SmoothingRadius = 2,    // the speeds are smoothed over 2 * radius + 1 grid points
+    MinimumOverlap = 120,   // grid points
+    WindowLength = 30 * 60  // grid points per drift window
+};
+
+static const double MinimumScore = 0.3;
+
+/*
+    A signal on the time grid. Grid points without data have mask 0 and
+    value 0.
+*/
+struct Signal {
+    Signal() : start(0) {}
+    qint64 start;
+    QVector<double> values;
+    QVector<double> mask;
+
+    int count() const { return values.count(); }
+    Signal mid(int from, int length) const
+    {
+        Signal signal;
+        signal.start = start + qint64(from) * GridStep;
+        signal.values = values.mid(from, length);
+        signal.mask = mask.mid(from, length);
+        return signal;
+    }
+};
+
+/*
+    Resamples the values at the given times (sorted) onto the grid from
+    \a start, with linear interpolation.
+*/
+static Signal resample(const QVector<qint64> &times, const QVector<double> &values, qint64 start, int count)
+{
+    Signal signal;
+    signal.start = start;
+    signal.values.fill(0.0, count);
+    signal.mask.fill(0.0, count);
+    int j = 0;
+    const int n = times.count();
+    for (int i = 0; i < count; ++i) {
+        const qint64 t = start + qint64(i) * GridStep;
+        while (j + 1 < n && times.at(j + 1) <= t)
+            ++j;
+        if (j + 1 >= n || times.at(j) > t || times.at(j + 1) - times.at(j) > MaximumGap)
+            continue;
+        const double progress = double(t - times.at(j)) / (times.at(j + 1) - times.at(j));
+        signal.values[i] = values.at(j) + (values.at(j + 1) - values.at(j)) * progress;
+        signal.mask[i] = 1.0;
+    }
+    return signal;
+}
+
+static void smooth(Signal *signal)
+{
+    const int n = signal->count();
+    QVector<double> smoothed(n);
+    double sum = 0;
+    double weight = 0;
+    const double *values = signal->values.constData();
+    const double *mask = signal->mask.constData();
+    for (int i = -SmoothingRadius; i < n; ++i) {
+        const int in = i + SmoothingRadius;
+        const int out = i - SmoothingRadius - 1;
+        if (in < n) {
+            sum += values[in];
+            weight += mask[in];
+        }
+        if (out >= 0) {
+            sum -= values[out];
+            weight -= mask[out];
+        }
+        if (i >= 0)
+            smoothed[i] = mask[i] > 0 && weight > 0 ? sum / weight : 0.0;
+    }
+    signal->values = smoothed;
+}
+
+/*
+    In-place iterative radix-2 FFT. The size must be a power of two. The
+    inverse transform is not scaled.
+*/
+static void fft(double *re, double *im, int n, bool inverse)
+{
+    for (int i = 1, j = 0; i < n; ++i) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j |= bit;
+        if (i < j) {
+            qSwap(re[i], re[j]);
+            qSwap(im[i], im[j]);
+        }
+    }
+    for (int length = 2; length <= n; length <<= 1) {
+        const double angle = (inverse ? 2 : -2) * M_PI / length;
+        const double stepRe = cos(angle);
+        const double stepIm = sin(angle);
+        for (int i = 0; i < n; i += length) {
+            double wRe = 1.0;
+            double wIm = 0.0;
+            for (int k = 0; k < length / 2; ++k) {
+                const int a = i + k;
+                const int b = a + length / 2;
+                const double tRe = re[b] * wRe - im[b] * wIm;
+                const double tIm = re[b] * wIm + im[b] * wRe;
+                re[b] = re[a] - tRe;
+                im[b] = im[a] - tIm;
+                re[a] += tRe;
+                im[a] += tIm;
+                const double nextRe = wRe * stepRe - wIm * stepIm;
+                wIm = wRe * stepIm + wIm * stepRe;
+                wRe = nextRe;
+            }
+        }
+    }
+}
+
+/*
+    The spectra of two real sequences, computed with one complex FFT.
+*/
+struct Spectrum {
+    QVector<double> re;
+    QVector<double> im;
+};
+
+static void transformPair(const QVector<double> &x, const QVector<double> &y, int n, Spectrum *fx, Spectrum *fy)
+{
+    QVector<double> re(n, 0.0);
+    QVector<double> im(n, 0.0);
+    for (int i = 0; i < x.count(); ++i)
+        re[i] = x.at(i);
+    for (int i = 0; i < y.count(); ++i)
+        im[i] = y.at(i);
+    fft(re.data(), im.data(), n, false);
+    fx->re.resize(n);
+    fx->im.resize(n);
+    fy->re.resize(n);
+    fy->im.resize(n);
+    for (int k = 0; k < n; ++k) {
+        const int m = (n - k) & (n - 1);
+        // X = (Z[k] + conj(Z[n-k])) / 2, Y = (Z[k] - conj(Z[n-k])) / 2i
+        fx->re[k] = (re.at(k) + re.at(m)) / 2;
+        fx->im[k] = (im.at(k) - im.at(m)) / 2;
+        fy->re[k] = (im.at(k) + im.at(m)) / 2;
+        fy->im[k] = (re.at(m) - re.at(k)) / 2;
+    }
+}
+
+/*
+    Computes the circular cross-correlations sum_i p[i] q[i + k] and
+    sum_i r[i] s[i + k] from the spectra, with one inverse FFT.
+*/
+static void correlatePair(const Spectrum &p, const Spectrum &q, const Spectrum &r, const Spectrum &s, int n,
+                          QVector<double> *pq, QVector<double> *rs)
+{
+    pq->resize(n);
+    rs->resize(n);
+    double *re = pq->data();
+    double *im = rs->data();
+    for (int k = 0; k < n; ++k) {
+        // conj(P) * Q + i * conj(R) * S
+        const double aRe = p.re.at(k) * q.re.at(k) + p.im.at(k) * q.im.at(k);
+        const double aIm = p.re.at(k) * q.im.at(k) - p.im.at(k) * q.re.at(k);
+        const double bRe = r.re.at(k) * s.re.at(k) + r.im.at(k) * s.im.at(k);
+        const double bIm = r.re.at(k) * s.im.at(k) - r.im.at(k) * s.re.at(k);
+        re[k] = aRe - bIm;
+        im[k] = aIm + bRe;
+    }
+    fft(re, im, n, true);
+    for (int k = 0; k < n; ++k) {
+        re[k] /= n;
+        im[k] /= n;
+    }
+}
+
+static QVector<double> squared(const Signal &signal)
+{
+    QVector<double> result(signal.count());
+    for (int i = 0; i < signal.count(); ++i)
+        result[i] = signal.values.at(i) * signal.values.at(i);
+    return result;
+}
+
+/*
+    Computes the normalized cross-correlation of \a a and \a b for the lags
+    [minLag, maxLag], counting only the grid points where both have data.
+    Lags with too little overlap get a score of -2.
+*/
+static QVector<double> normalizedCorrelation(const Signal &a, const Signal &b, int minLag, int maxLag)
+{
+    int n = 1;
+    while (n < a.count() + b.count())
+        n <<= 1;
+
+    Spectrum fa, fa2, fma, fb, fb2, fmb;
+    transformPair(a.values, squared(a), n, &fa, &fa2);
+    transformPair(a.mask, b.values, n, &fma, &fb);
+    transformPair(squared(b), b.mask, n, &fb2, &fmb);
+
+    QVector<double> sumAB, sumA, sumB, sumAA, sumBB, overlap;
+    correlatePair(fa, fb, fa, fmb, n, &sumAB, &sumA);
+    correlatePair(fma, fb, fa2, fmb, n, &sumB, &sumAA);
+    correlatePair(fma, fb2, fma, fmb, n, &sumBB, &overlap);
+
+    QVector<double> scores;
+    scores.reserve(maxLag - minLag + 1);
+    for (int lag = minLag; lag <= maxLag; ++lag) {
+        const int k = lag & (n - 1);
+        const double count = qRound(overlap.at(k));
+        double score = -2.0;
+        if (count >= MinimumOverlap) {
+            const double covariance = sumAB.at(k) - sumA.at(k) * sumB.at(k) / count;
+            const double varianceA = sumAA.at(k) - sumA.at(k) * sumA.at(k) / count;
+            const double varianceB = sumBB.at(k) - sumB.at(k) * sumB.at(k) / count;
+            if (varianceA > 0 && varianceB > 0)
+                score = covariance / sqrt(varianceA * varianceB);
+        }
+        scores.append(score);
+    }
+    return scores;
+}
+
+struct Signals {
+    Signal speed;
+    Signal altitude;
+};
+
+/*
+    Finds the lag of \a gpx that best matches \a hrm, within the offsets
+    [minOffset, maxOffset] in ms. The lag is refined to a fraction of the grid
+    step by fitting a parabola through the scores around the peak.
+*/
+static bool bestOffset(const Signals &hrm, const Signals &gpx, bool useAltitude,
+                       qint64 minOffset, qint64 maxOffset, double *offset, double *score)
+{
+    const qint64 base = gpx.speed.start - hrm.speed.start;
+    const int minLag = qMax(int((minOffset - base) / GridStep), -(hrm.speed.count() - 1));
+    const int maxLag = qMin(int((maxOffset - base) / GridStep), gpx.speed.count() - 1);
+    if (minLag > maxLag)
+        return false;
+
+    QVector<double> scores = normalizedCorrelation(hrm.speed, gpx.speed, minLag, maxLag);
+    if (useAltitude) {
+        const QVector<double> altitudeScores = normalizedCorrelation(hrm.altitude, gpx.altitude, minLag, maxLag);
+        for (int i = 0; i < scores.count(); ++i) {
+            if (scores.at(i) > -2 && altitudeScores.at(i) > -2)
+                scores[i] = (scores.at(i) + altitudeScores.at(i)) / 2;
+        }
+    }
+
+    int best = -1;
+    for (int i = 0; i < scores.count(); ++i) {
+        if (scores.at(i) > -2 && (best == -1 || scores.at(i) > scores.at(best)))
+            best = i;
+    }
+    if (best == -1)
+        return false;
+
+    double fraction = 0;
+    if (best > 0 && best + 1 < scores.count() && scores.at(best - 1) > -2 && scores.at(best + 1) > -2) {
+        const double left = scores.at(best - 1);
+        const double right = scores.at(best + 1);
+        const double curvature = left - 2 * scores.at(best) + right;
+        if (curvature < 0)
+            fraction = 0.5 * (left - right) / curvature;
+    }
+    *offset = base + (minLag + best + fraction) * GridStep;
+    *score = scores.at(best);
+    return true;
+}
+
+static qint64 gridStart(qint64 time)
+{
+    return time - time % GridStep;
+}
+
+static Signals hrmSignals(const SampleData &hrm)
+{
+    const int n = hrm.count();
+    QVector<qint64> times(n);
+    QVector<double> speeds(n);
+    QVector<double> altitudes(n);
+    for (int i = 0; i < n; ++i) {
+        const GpsSample &sample = hrm.at(i);
+        times[i] = sample.time;
+        speeds[i] = sample.speed;
+        altitudes[i] = sample.ele;
+    }
+    const qint64 start = gridStart(hrm.startTime());
+    const int count = int((hrm.endTime() - start) / GridStep) + 1;
+    Signals result;
+    result.speed = resample(times, speeds, start, count);
+    result.altitude = resample(times, altitudes, start, count);
+    smooth(&result.speed);
+    return result;
+}
+
+static Signals gpxSignals(const SampleData &gpx)
+{
+    const int n = gpx.count();
+    const GpsSample *samples = gpx.constData();
+    QVector<double> distances(qMax(n - 1, 0));
+    segmentDistances(&samples->lat, &samples->lon, n, distances.data(), sizeof(GpsSample));
+
+    // The speed of each segment belongs to the middle of the segment
+    QVector<qint64> segmentTimes;
+    QVector<double> speeds;
+    segmentTimes.reserve(n);
+    speeds.reserve(n);
+    for (int i = 1; i < n; ++i) {
+        const qint64 elapsed = samples[i].time - samples[i - 1].time;
+        if (elapsed <= 0)
+            continue;
+        segmentTimes.append(samples[i - 1].time + elapsed / 2);
+        speeds.append(distances.at(i - 1) * 3600000.0 / elapsed);
+    }
+    QVector<qint64> times(n);
+    QVector<double> elevations(n);
+    for (int i = 0; i < n; ++i) {
+        times[i] = samples[i].time;
+        elevations[i] = samples[i].ele;
+    }
+
+    const qint64 start = gridStart(gpx.startTime());
+    const int count = int((gpx.endTime() - start) / GridStep) + 1;
+    Signals result;
+    result.speed = resample(segmentTimes, speeds, start, count);
+    result.altitude = resample(times, elevations, start, count);
+    smooth(&result.speed);
+    return result;
+}
+
+} // namespace
+
+ClockAlignment::ClockAlignment()
+    : m_maximumOffset(15 * 60 * 1000), m_useAltitude(false), m_estimateDrift(false),
+      m_valid(false), m_score(0), m_referenceTime(0), m_offset(0), m_drift(0)
+{
+}
+
+/*!
+    Finds the offset to add to the times of \a hrm to match the clock of
+    \a gpx. Returns false if the tracks do not overlap enough or do not
+    correlate.
+*/
+bool ClockAlignment::align(const SampleData &hrm, const SampleData &gpx)
+{
+    m_valid = false;
+    m_drift = 0;
+    if (hrm.count() < 2 || gpx.count() < 2)
+        return false;
+
+    const Signals hrmSignal = hrmSignals(hrm);
+    const Signals gpxSignal = gpxSignals(gpx);
+    double offset;
+    double score;
+    if (!bestOffset(hrmSignal, gpxSignal, m_useAltitude, -m_maximumOffset, m_maximumOffset, &offset, &score)
+            || score < MinimumScore)
+        return false;
+    m_valid = true;
+    m_score = score;
+    m_offset = offset;
+    m_referenceTime = hrm.startTime();
+
+    const int windows = hrmSignal.speed.count() / WindowLength;
+    if (!m_estimateDrift || windows < 2)
+        return true;
+
+    // Align each window near the offset of the whole track, and fit a line
+    // through the offsets with least squares
+    static const qint64 WindowSearch = 2 * 60 * 1000;
+    double sumT = 0, sumO = 0, sumTT = 0, sumTO = 0;
+    int found = 0;
+    for (int w = 0; w < windows; ++w) {
+        const int length = w == windows - 1 ? hrmSignal.speed.count() - w * WindowLength : WindowLength;
+        Signals window;
+        window.speed = hrmSignal.speed.mid(w * WindowLength, length);
+        window.altitude = hrmSignal.altitude.mid(w * WindowLength, length);
+        double windowOffset;
+        double windowScore;
+        if (!bestOffset(window, gpxSignal, m_useAltitude, qint64(offset) - WindowSearch, qint64(offset) + WindowSearch,
+                        &windowOffset, &windowScore) || windowScore < MinimumScore)
+            continue;
+        const double t = double(window.speed.start - m_referenceTime) + length * GridStep / 2.0;
+        sumT += t;
+        sumO += windowOffset;
+        sumTT += t * t;
+        sumTO += t * windowOffset;
+        ++found;
+    }
+    const double denominator = found * sumTT - sumT * sumT;
+    if (found >= 2 && denominator > 0) {
+        m_drift = (found * sumTO - sumT * sumO) / denominator;
+        m_offset = (sumO - m_drift * sumT) / found;
+    }
+    return true;
+}
+
+/*!
+    Returns the offset in ms to add to the HRM time \a hrmTime.
+*/
+qint64 ClockAlignment::offsetAt(qint64 hrmTime) const
+{
+    if (!m_valid)
+        return 0;
+    return qRound64(m_offset + m_drift * (hrmTime - m_referenceTime));
+}
+
+/*!
+    Moves the samples of \a hrm to the clock of the GPS.
+*/
+void ClockAlignment::apply(SampleData *hrm) const
+{
+    if (!m_valid)
+        return;
+    GpsSample *samples = hrm->data();
+    for (int i = 0; i < hrm->count(); ++i)
+        samples[i].time += offsetAt(samples[i].time);
+}
@@ -0,0 +1,53 @@
+#ifndef CLOCKALIGNMENT_H
+#define CLOCKALIGNMENT_H
+
+#include "gpssample.h"
+
+/*
+    Finds the offset (and optionally the drift) between the clock of a heart
+    rate monitor and the clock of a GPS.
+
+    Both tracks are resampled onto a common time grid, the HRM speed against
+    the speed computed from the GPX positions (and the HRM altitude against
+    the GPX elevation, if the HRM recorded altitude). The offset is the lag
+    with the highest normalized cross-correlation, which is computed for all
+    lags at once with FFTs, so the cost is O(n log n) in the length of the
+    tracks.
+
+    For drift, the HRM track is cut in windows that are each aligned on their
+    own, and a line is fitted through the offsets of the windows.
+*/
+class ClockAlignment {
+public:
+    ClockAlignment();
+
+    void setMaximumOffset(qint64 ms) { m_maximumOffset = ms; }
+    qint64 maximumOffset() const { return m_maximumOffset; }
+    void setUseAltitude(bool useAltitude) { m_useAltitude = useAltitude; }
+    bool useAltitude() const { return m_useAltitude; }
+    void setEstimateDrift(bool estimateDrift) { m_estimateDrift = estimateDrift; }
+    bool estimateDrift() const { return m_estimateDrift; }
+
+    bool align(const SampleData &hrm, const SampleData &gpx);
+
+    bool isValid() const { return m_valid; }
+    double score() const { return m_score; }
+    qint64 offset() const { return offsetAt(m_referenceTime); }
+    double drift() const { return m_drift; }
+    qint64 offsetAt(qint64 hrmTime) const;
+
+    void apply(SampleData *hrm) const;
+
+private:
+    qint64 m_maximumOffset;
+    bool m_useAltitude;
+    bool m_estimateDrift;
+
+    bool m_valid;
+    double m_score;             // correlation at the offset, -1 to 1
+    qint64 m_referenceTime;     // HRM time where the offset is m_offset
+    double m_offset;            // ms
+    double m_drift;             // ms of offset per ms of HRM time
+};
+
+#endif // CLOCKALIGNMENT_H
@@ -0,0 +1,180 @@
+#include "compactsamplestore.h"
+
+#include <math.h>
+#include <string.h>
+
+static const double CoordinateScale = 1e7;
+
+static inline quint64 zigzag(qint64 v)
+{
+    return (quint64(v) << 1) ^ quint64(v >> 63);
+}
+
+static inline qint64 unzigzag(quint64 v)
+{
+    return qint64(v >> 1) ^ -qint64(v & 1);
+}
+
+static inline void writeVarint(QByteArray *data, qint64 value)
+{
+    quint64 v = zigzag(value);
+    while (v >= 0x80) {
+        data->append(char(v | 0x80));
+        v >>= 7;
+    }
+    data->append(char(v));
+}
+
+static inline qint64 readVarint(const uchar *&p)
+{
+    quint64 v = 0;
+    int shift = 0;
+    while (*p & 0x80) {
+        v |= quint64(*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    v |= quint64(*p++) << shift;
+    return unzigzag(v);
+}
+
+// Rounds halfway cases away from zero, like GpxWriter's fixed notation, so
+// an elevation of 12.25 is stored as 123 and still written as "12.3". The
+// product is exact for the float fields.
+static inline qint64 toFixed(double value, double scale)
+{
+    const double scaled = value * scale;
+    return qint64(scaled < 0 ? -floor(0.5 - scaled) : floor(scaled + 0.5));
+}
+
+static inline bool isExactCoordinate(double value)
+{
+    return qAbs(value) <= 180.0 && toFixed(value, CoordinateScale) / CoordinateScale == value;
+}
+
+CompactSampleStore::CompactSampleStore(const SampleData &samples)
+    : metaData(samples.metaData), m_count(0)
+{
+    m_blocks.reserve(samples.count() / BlockSize);
+    m_data.reserve(samples.count() * 10);
+    for (int i = 0; i < samples.count(); ++i)
+        append(samples.at(i));
+    m_data.squeeze();
+    m_pending.squeeze();
+}
+
+void CompactSampleStore::append(const GpsSample &sample)
+{
+    m_pending.append(sample);
+    ++m_count;
+    if (m_pending.count() == BlockSize) {
+        encodeBlock(m_pending.constData());
+        m_pending.clear();
+    }
+}
+
+void CompactSampleStore::encodeBlock(const GpsSample *samples)
+{
+    Block block;
+    block.offset = m_data.size();
+    block.rawCoordinates = false;
+    for (int i = 0; i < BlockSize && !block.rawCoordinates; ++i)
+        block.rawCoordinates = !isExactCoordinate(samples[i].lat) || !isExactCoordinate(samples[i].lon);
+
+    qint64 time = 0, lat = 0, lon = 0, ele = 0, speed = 0;
+    for (int i = 0; i < BlockSize; ++i) {
+        const GpsSample &sample = samples[i];
+        writeVarint(&m_data, sample.time - time);
+        time = sample.time;
+        if (block.rawCoordinates) {
+            m_data.append(reinterpret_cast<const char *>(&sample.lat), sizeof(double));
+            m_data.append(reinterpret_cast<const char *>(&sample.lon), sizeof(double));
+        } else {
+            const qint64 fixedLat = toFixed(sample.lat, CoordinateScale);
+            const qint64 fixedLon = toFixed(sample.lon, CoordinateScale);
+            writeVarint(&m_data, fixedLat - lat);
+            writeVarint(&m_data, fixedLon - lon);
+            lat = fixedLat;
+            lon = fixedLon;
+        }
+        const qint64 fixedEle = toFixed(sample.ele, 10);
+        const qint64 fixedSpeed = toFixed(sample.speed, 10);
+        writeVarint(&m_data, fixedEle - ele);
+        writeVarint(&m_data, fixedSpeed - speed);
+        ele = fixedEle;
+        speed = fixedSpeed;
+        m_data.append(char(qBound(0, sample.hr, 255)));
+        m_data.append(char(qBound(0, sample.cadence + 1, 255)));
+    }
+    m_blocks.append(block);
+}
+
+void CompactSampleStore::decodeBlock(int index, GpsSample *samples) const
+{
+    const Block &block = m_blocks.at(index);
+    const uchar *p = reinterpret_cast<const uchar *>(m_data.constData()) + block.offset;
+    qint64 time = 0, lat = 0, lon = 0, ele = 0, speed = 0;
+    for (int i = 0; i < BlockSize; ++i) {
+        GpsSample &sample = samples[i];
+        time += readVarint(p);
+        sample.time = time;
+        if (block.rawCoordinates) {
+            memcpy(&sample.lat, p, sizeof(double));
+            memcpy(&sample.lon, p + sizeof(double), sizeof(double));
+            p += 2 * sizeof(double);
+        } else {
+            lat += readVarint(p);
+            lon += readVarint(p);
+            sample.lat = lat / CoordinateScale;
+            sample.lon = lon / CoordinateScale;
+        }
+        ele += readVarint(p);
+        speed += readVarint(p);
+        // Divide in double, so the result is rounded like a parsed "123.4"
+        sample.ele = float(ele / 10.0);
+        sample.speed = float(speed / 10.0);
+        sample.hr = *p++;
+        sample.cadence = int(*p++) - 1;
+    }
+}
+
+/*!
+    Points \a samples at the next block of samples and returns how many there
+    are, or 0 after the last sample.
+*/
+int CompactSampleStore::BlockCursor::next(const GpsSample **samples)
+{
+    m_index += m_count;
+    if (m_block < m_store.m_blocks.count()) {
+        m_store.decodeBlock(m_block++, m_samples);
+        *samples = m_samples;
+        m_count = BlockSize;
+    } else if (m_index < m_store.m_count) {
+        *samples = m_store.m_pending.constData();
+        m_count = m_store.m_pending.count();
+    } else {
+        m_count = 0;
+    }
+    return m_count;
+}
+
+SampleData CompactSampleStore::toSampleData() const
+{
+    SampleData samples;
+    samples.metaData = metaData;
+    samples.resize(m_count);
+    GpsSample *data = samples.data();
+    for (int i = 0; i < m_blocks.count(); ++i)
+        decodeBlock(i, data + i * BlockSize);
+    for (int i = 0; i < m_pending.count(); ++i)
+        data[m_blocks.count() * BlockSize + i] = m_pending.at(i);
+    return samples;
+}
+
+/*!
+    Returns the approximate number of bytes used for the samples.
+*/
+qint64 CompactSampleStore::memoryUsage() const
+{
+    return m_data.capacity() + qint64(m_blocks.capacity()) * sizeof(Block)
+            + qint64(m_pending.capacity()) * sizeof(GpsSample);
+}
@@ -0,0 +1,77 @@
+#ifndef COMPACTSAMPLESTORE_H
+#define COMPACTSAMPLESTORE_H
+
+#include <QtCore/qbytearray.h>
+#include <QtCore/qvector.h>
+#include "gpssample.h"
+
+/*
+    Compact in-memory storage for large amounts of SampleData.
+
+    Samples are packed in blocks of BlockSize samples. Within a block each field
+    is stored as a zigzag varint delta from the previous sample:
+      - time in milliseconds (lossless)
+      - latitude and longitude as fixed point integers of 1e-7 degrees (~1 cm)
+      - elevation in decimetres
+      - speed in 0.1 km/h
+    followed by the heart rate and the cadence (plus one, so that 0 means not
+    recorded) in a single byte each. A typical 1 Hz track needs about 10 bytes
+    per sample, compared to 48 bytes for a GpsSample.
+
+    GPS units report coordinates with at most 7 decimals, and those round trip
+    exactly. If a block contains a coordinate that does not (e.g. interpolated
+    positions), the coordinates of that block are stored as raw doubles instead.
+    Elevation and speed are rounded to the single decimal that saveGPX() writes,
+    so the GPX output is unchanged.
+
+    Samples are read back a block at a time with a BlockCursor, or all at once
+    with toSampleData().
+*/
+class CompactSampleStore {
+public:
+    enum { BlockSize = 256 };
+
+    CompactSampleStore() : m_count(0) {}
+    explicit CompactSampleStore(const SampleData &samples);
+
+    void append(const GpsSample &sample);
+    int count() const { return m_count; }
+    bool isEmpty() const { return m_count == 0; }
+    SampleData toSampleData() const;
+    qint64 memoryUsage() const;
+
+    SampleData::MetaData metaData;
+
+    class BlockCursor {
+    public:
+        explicit BlockCursor(const CompactSampleStore &store)
+            : m_store(store), m_block(0), m_index(0), m_count(0) {}
+
+        int next(const GpsSample **samples);
+        // Index of the first sample returned by the last next()
+        int index() const { return m_index; }
+
+    private:
+        const CompactSampleStore &m_store;
+        int m_block;
+        int m_index;
+        int m_count;
+        GpsSample m_samples[BlockSize];
+    };
+
+private:
+    struct Block {
+        int offset;
+        bool rawCoordinates;
+    };
+
+    void encodeBlock(const GpsSample *samples);
+    void decodeBlock(int block, GpsSample *samples) const;
+
+    int m_count;
+    QVector<Block> m_blocks;
+    QByteArray m_data;
+    QVector<GpsSample> m_pending;   // samples that do not fill a block yet
+};
+
+#endif // COMPACTSAMPLESTORE_H
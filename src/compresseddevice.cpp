@@ -0,0 +1,387 @@
+#include "compresseddevice.h"
+#include <QtCore/qthread.h>
+
+#include <string.h>
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+# include <zstd.h>
+#endif
+
+/*
+    One direction of one compression format. process() consumes all of
+    [data, data + size) and appends the result to \a out; \a finish ends the
+    stream. Returns false on corrupt or, when finishing, truncated input.
+*/
+class StreamCodec {
+public:
+    virtual ~StreamCodec() {}
+    virtual bool process(const char *data, int size, QByteArray *out, bool finish) = 0;
+};
+
+namespace {
+
+enum { OutputChunkSize = 64 * 1024 };
+
+#ifdef HAVE_ZLIB
+class GzipCodec : public StreamCodec {
+public:
+    explicit GzipCodec(bool compress)
+        : m_compress(compress), m_ok(false), m_streamEnd(false)
+    {
+        memset(&m_stream, 0, sizeof(m_stream));
+        if (compress)
+            m_ok = deflateInit2(&m_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        else
+            m_ok = inflateInit2(&m_stream, 15 + 32) == Z_OK;    // gzip or zlib header
+    }
+
+    ~GzipCodec()
+    {
+        if (m_compress)
+            deflateEnd(&m_stream);
+        else
+            inflateEnd(&m_stream);
+    }
+
+    bool process(const char *data, int size, QByteArray *out, bool finish) Q_DECL_OVERRIDE
+    {
+        if (!m_ok)
+            return false;
+        m_stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        m_stream.avail_in = size;
+        for (;;) {
+            if (!m_compress && m_streamEnd && m_stream.avail_in) {
+                // Another gzip member follows
+                inflateReset(&m_stream);
+                m_streamEnd = false;
+            }
+            const int used = out->size();
+            out->resize(used + OutputChunkSize);
+            m_stream.next_out = reinterpret_cast<Bytef *>(out->data() + used);
+            m_stream.avail_out = OutputChunkSize;
+            const int ret = m_compress ? deflate(&m_stream, finish ? Z_FINISH : Z_NO_FLUSH)
+                                       : inflate(&m_stream, Z_NO_FLUSH);
+            out->resize(used + OutputChunkSize - m_stream.avail_out);
+            if (ret == Z_STREAM_END)
+                m_streamEnd = true;
+            else if (ret != Z_OK && ret != Z_BUF_ERROR)
+                return false;
+
+            const bool outputFull = m_stream.avail_out == 0;
+            if (m_compress) {
+                if (!outputFull && !m_stream.avail_in && (!finish || m_streamEnd))
+                    return true;
+            } else if (!outputFull && (!m_stream.avail_in || ret == Z_BUF_ERROR)) {
+                return !m_stream.avail_in && (!finish || m_streamEnd);
+            }
+        }
+    }
+
+private:
+    z_stream m_stream;
+    bool m_compress;
+    bool m_ok;
+    bool m_streamEnd;
+};
+#endif
+
+#ifdef HAVE_ZSTD
+class ZstdCodec : public StreamCodec {
+public:
+    explicit ZstdCodec(bool compress)
+        : m_compress(compress), m_cstream(0), m_dstream(0), m_frameEnd(true)
+    {
+        if (compress)
+            m_cstream = ZSTD_createCStream();
+        else
+            m_dstream = ZSTD_createDStream();
+    }
+
+    ~ZstdCodec()
+    {
+        ZSTD_freeCStream(m_cstream);
+        ZSTD_freeDStream(m_dstream);
+    }
+
+    bool process(const char *data, int size, QByteArray *out, bool finish) Q_DECL_OVERRIDE
+    {
+        if (!m_cstream && !m_dstream)
+            return false;
+        ZSTD_inBuffer input = { data, size_t(size), 0 };
+        size_t consumed = 0;
+        for (;;) {
+            const int used = out->size();
+            out->resize(used + OutputChunkSize);
+            ZSTD_outBuffer output = { out->data() + used, OutputChunkSize, 0 };
+            const size_t ret = m_compress
+                    ? ZSTD_compressStream2(m_cstream, &output, &input, finish ? ZSTD_e_end : ZSTD_e_continue)
+                    : ZSTD_decompressStream(m_dstream, &output, &input);
+            out->resize(used + int(output.pos));
+            if (ZSTD_isError(ret))
+                return false;
+            if (!m_compress && (input.pos > consumed || output.pos))
+                m_frameEnd = ret == 0;
+            consumed = input.pos;
+
+            if (output.pos < output.size && input.pos == input.size && (!m_compress || !finish || ret == 0))
+                return m_compress || !finish || m_frameEnd;
+        }
+    }
+
+private:
+    bool m_compress;
+    ZSTD_CStream *m_cstream;
+    ZSTD_DStream *m_dstream;
+    bool m_frameEnd;
+};
+#endif
+
+StreamCodec *createCodec(CompressedDevice::Format format, bool compress)
+{
+    switch (format) {
+#ifdef HAVE_ZLIB
+    case CompressedDevice::Gzip:
+        return new GzipCodec(compress);
+#endif
+#ifdef HAVE_ZSTD
+    case CompressedDevice::Zstd:
+        return new ZstdCodec(compress);
+#endif
+    default:
+        return 0;
+    }
+}
+
+} // namespace
+
+class CompressedDevice::Reader : public QThread {
+public:
+    explicit Reader(CompressedDevice *device) : m_device(device) {}
+protected:
+    void run() Q_DECL_OVERRIDE { m_device->readSource(); }
+private:
+    CompressedDevice *m_device;
+};
+
+CompressedDevice::CompressedDevice(QIODevice *device, Format format)
+    : m_device(device), m_format(format), m_codec(0), m_reader(0),
+      m_offset(0), m_finished(false), m_cancelled(false)
+{
+}
+
+CompressedDevice::~CompressedDevice()
+{
+    close();
+}
+
+CompressedDevice::Format CompressedDevice::detectFormat(const QByteArray &header)
+{
+    if (header.startsWith("\x1f\x8b"))
+        return Gzip;
+    if (header.startsWith("\x28\xb5\x2f\xfd"))
+        return Zstd;
+    return Uncompressed;
+}
+
+bool CompressedDevice::isSupported(Format format)
+{
+    switch (format) {
+#ifdef HAVE_ZLIB
+    case Gzip:
+        return true;
+#endif
+#ifdef HAVE_ZSTD
+    case Zstd:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+/*!
+    Parses "gzip" or "zstd" (or "gz", "zst") into \a format.
+*/
+bool CompressedDevice::formatFromName(const QString &name, Format *format)
+{
+    if (name == QLatin1String("gzip") || name == QLatin1String("gz"))
+        *format = Gzip;
+    else if (name == QLatin1String("zstd") || name == QLatin1String("zst"))
+        *format = Zstd;
+    else
+        return false;
+    return true;
+}
+
+QString CompressedDevice::fileSuffix(Format format)
+{
+    switch (format) {
+    case Gzip:
+        return QLatin1String(".gz");
+    case Zstd:
+        return QLatin1String(".zst");
+    default:
+        return QString();
+    }
+}
+
+/*!
+    Opens the device for either reading or writing. The underlying device
+    must already be open in the same mode.
+*/
+bool CompressedDevice::open(OpenMode mode)
+{
+    const OpenMode direction = mode & ReadWrite;
+    if (isOpen() || (direction != ReadOnly && direction != WriteOnly))
+        return false;
+    if (!isSupported(m_format)) {
+        setErrorString(QLatin1String("Unsupported compression format"));
+        return false;
+    }
+    m_codec = createCodec(m_format, direction == WriteOnly);
+    m_blocks.clear();
+    m_offset = 0;
+    m_finished = false;
+    m_cancelled = false;
+    m_error.clear();
+    QIODevice::open(mode | Unbuffered);
+    if (direction == ReadOnly) {
+        m_reader = new Reader(this);
+        m_reader->start();
+    }
+    return true;
+}
+
+void CompressedDevice::close()
+{
+    if (!isOpen())
+        return;
+    if (m_reader) {
+        m_mutex.lock();
+        m_cancelled = true;
+        m_blockTaken.wakeAll();
+        m_mutex.unlock();
+        m_reader->wait();
+        delete m_reader;
+        m_reader = 0;
+    } else if (m_codec && !finishWriting()) {
+        qWarning("Failed to write compressed data: %s", qPrintable(errorString()));
+    }
+    delete m_codec;
+    m_codec = 0;
+    m_blocks.clear();
+    QIODevice::close();
+}
+
+qint64 CompressedDevice::bytesAvailable() const
+{
+    QMutexLocker locker(&m_mutex);
+    qint64 available = -m_offset;
+    for (int i = 0; i < m_blocks.count(); ++i)
+        available += m_blocks.at(i).size();
+    return available + QIODevice::bytesAvailable();
+}
+
+// Runs in the reader thread
+void CompressedDevice::readSource()
+{
+    QByteArray input(BlockSize, Qt::Uninitialized);
+    for (;;) {
+        const qint64 size = m_device->read(input.data(), BlockSize);
+        QByteArray block;
+        block.reserve(BlockSize);
+        const bool ok = size >= 0 && m_codec->process(input.constData(), int(qMax<qint64>(size, 0)), &block, size <= 0);
+
+        QMutexLocker locker(&m_mutex);
+        while (m_blocks.count() >= MaxQueuedBlocks && !m_cancelled)
+            m_blockTaken.wait(&m_mutex);
+        if (m_cancelled)
+            return;
+        if (!block.isEmpty())
+            m_blocks.append(block);
+        if (!ok)
+            m_error = size < 0 ? m_device->errorString() : QLatin1String("Corrupt or truncated compressed data");
+        if (!ok || size <= 0)
+            m_finished = true;
+        m_blockQueued.wakeAll();
+        if (m_finished)
+            return;
+    }
+}
+
+qint64 CompressedDevice::readData(char *data, qint64 maxSize)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_blocks.isEmpty() && !m_finished)
+        m_blockQueued.wait(&m_mutex);
+    if (m_blocks.isEmpty()) {
+        if (m_error.isEmpty())
+            return 0;
+        setErrorString(m_error);
+        return -1;
+    }
+
+    qint64 copied = 0;
+    while (copied < maxSize && !m_blocks.isEmpty()) {
+        const QByteArray &block = m_blocks.first();
+        const int size = int(qMin<qint64>(block.size() - m_offset, maxSize - copied));
+        memcpy(data + copied, block.constData() + m_offset, size);
+        copied += size;
+        m_offset += size;
+        if (m_offset == block.size()) {
+            m_blocks.removeFirst();
+            m_offset = 0;
+            m_blockTaken.wakeOne();
+        }
+    }
+    return copied;
+}
+
+qint64 CompressedDevice::writeData(const char *data, qint64 size)
+{
+    if (!m_codec) {
+        setErrorString(QLatin1String("Write after the compressed stream was finished"));
+        return -1;
+    }
+    QByteArray block;
+    for (qint64 done = 0; done < size; ) {
+        const int chunk = int(qMin<qint64>(size - done, BlockSize));
+        block.clear();
+        if (!m_codec->process(data + done, chunk, &block, false)
+            || m_device->write(block) != block.size()) {
+            setErrorString(m_device->errorString());
+            return -1;
+        }
+        done += chunk;
+    }
+    return size;
+}
+
+/*!
+    Ends the compressed stream of a device opened for writing, and writes the
+    rest of it to the underlying device. Returns false if that fails. close()
+    does the same, but can only warn about a failure.
+*/
+bool CompressedDevice::finish()
+{
+    if (!isOpen() || m_reader)
+        return false;
+    if (!m_codec)
+        return m_finished;
+    m_finished = finishWriting();
+    delete m_codec;
+    m_codec = 0;
+    return m_finished;
+}
+
+bool CompressedDevice::finishWriting()
+{
+    QByteArray block;
+    if (!m_codec->process(0, 0, &block, true) || m_device->write(block) != block.size()) {
+        setErrorString(m_device->errorString());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef COMPRESSEDDEVICE_H
+#define COMPRESSEDDEVICE_H
+
+#include <QtCore/qbytearray.h>
+#include <QtCore/qiodevice.h>
+#include <QtCore/qlist.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qwaitcondition.h>
+
+class StreamCodec;
+
+/*
+    A sequential QIODevice that gzip or zstd compresses what is written to it
+    into another device, or decompresses what is read from another device.
+
+    Reading is overlapped: a worker thread reads and decompresses the source
+    in blocks and queues at most MaxQueuedBlocks of them ahead of the reader.
+    The source device must not be used by anyone else while the device is open.
+
+    Concatenated gzip members and zstd frames are read as one stream.
+    gzip and zstd are only available when built with HAVE_ZLIB and
+    HAVE_ZSTD respectively.
+*/
+class CompressedDevice : public QIODevice {
+public:
+    enum Format {
+        Uncompressed,
+        Gzip,
+        Zstd
+    };
+
+    enum {
+        BlockSize = 256 * 1024,
+        MaxQueuedBlocks = 16
+    };
+
+    CompressedDevice(QIODevice *device, Format format);
+    ~CompressedDevice();
+
+    Format format() const { return m_format; }
+
+    bool open(OpenMode mode) Q_DECL_OVERRIDE;
+    void close() Q_DECL_OVERRIDE;
+    bool finish();
+    bool isSequential() const Q_DECL_OVERRIDE { return true; }
+    qint64 bytesAvailable() const Q_DECL_OVERRIDE;
+
+    // The format of data starting with \a header, judging by its magic number
+    static Format detectFormat(const QByteArray &header);
+    static bool isSupported(Format format);
+    static bool formatFromName(const QString &name, Format *format);
+    static QString fileSuffix(Format format);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) Q_DECL_OVERRIDE;
+    qint64 writeData(const char *data, qint64 size) Q_DECL_OVERRIDE;
+
+private:
+    class Reader;
+    friend class Reader;
+
+    void readSource();
+    bool finishWriting();
+
+    QIODevice *m_device;
+    Format m_format;
+    StreamCodec *m_codec;
+    Reader *m_reader;
+
+    // Shared with the reader thread
+    mutable QMutex m_mutex;
+    QWaitCondition m_blockQueued;
+    QWaitCondition m_blockTaken;
+    QList<QByteArray> m_blocks;
+    int m_offset;               // into m_blocks.first()
+    bool m_finished;            // reading: source exhausted, writing: finish() succeeded
+    bool m_cancelled;
+    QString m_error;
+};
+
+#endif // COMPRESSEDDEVICE_H
@@ -0,0 +1,634 @@
+#include "fitfile.h"
+#include <QtCore/qdatetime.h>
+#include <QtCore/qfile.h>
+
+#include <string.h>
+
+#include "geo.h"
+#include "samplestatistics.h"
+
+namespace {
+
+enum {
+    FitEpoch = 631065600,       // 1989-12-31T00:00:00Z, in seconds since 1970
+    FileHeaderSize = 14,
+    ProtocolVersion = 0x20,     // 2.0
+    ProfileVersion = 2132,      // 21.32
+    LocalMessageTypes = 16
+};
+
+enum GlobalMessage {
+    FileIdMessage = 0,
+    SessionMessage = 18,
+    LapMessage = 19,
+    RecordMessage = 20,
+    ActivityMessage = 34
+};
+
+enum BaseType {
+    EnumType = 0x00,
+    UInt8Type = 0x02,
+    UInt16Type = 0x84,
+    SInt32Type = 0x85,
+    UInt32Type = 0x86
+};
+
+// Values of the FIT profile enums that are written
+enum {
+    FileTypeActivity = 4,
+    ManufacturerDevelopment = 255,
+    EventSession = 8,
+    EventLap = 9,
+    EventActivity = 26,
+    EventTypeStop = 1,
+    SportGeneric = 0,
+    SportRunning = 1,
+    SportCycling = 2
+};
+
+enum LocalType {
+    LocalFileId = 0,
+    LocalCompressedRecord = 1,  // compressed timestamp headers only have two bits for the type
+    LocalRecord = 2,
+    LocalLap = 3,
+    LocalSession = 4,
+    LocalActivity = 5
+};
+
+const quint8 InvalidUInt8 = 0xff;
+const quint16 InvalidUInt16 = 0xffff;
+const quint32 InvalidUInt32 = 0xffffffff;
+const qint32 InvalidSInt32 = 0x7fffffff;
+
+const double SemicirclesPerDegree = 2147483648.0 / 180.0;
+
+struct FieldDefinition {
+    quint8 number;
+    quint8 size;
+    quint8 baseType;
+};
+
+const FieldDefinition fileIdFields[] = {
+    {0, 1, EnumType},           // type
+    {1, 2, UInt16Type},         // manufacturer
+    {2, 2, UInt16Type},         // product
+    {4, 4, UInt32Type}          // time_created
+};
+
+// The record fields after the timestamp
+const FieldDefinition recordFields[] = {
+    {0, 4, SInt32Type},         // position_lat
+    {1, 4, SInt32Type},         // position_long
+    {2, 2, UInt16Type},         // altitude, 5 * (m + 500)
+    {3, 1, UInt8Type},          // heart_rate
+    {4, 1, UInt8Type},          // cadence
+    {5, 4, UInt32Type},         // distance, cm
+    {6, 2, UInt16Type}          // speed, mm/s
+};
+
+const FieldDefinition timestampField = {253, 4, UInt32Type};
+
+const FieldDefinition lapFields[] = {
+    {253, 4, UInt32Type},       // timestamp
+    {2, 4, UInt32Type},         // start_time
+    {7, 4, UInt32Type},         // total_elapsed_time, ms
+    {8, 4, UInt32Type},         // total_timer_time, ms
+    {9, 4, UInt32Type},         // total_distance, cm
+    {0, 1, EnumType},           // event
+    {1, 1, EnumType},           // event_type
+    {15, 1, UInt8Type},         // avg_heart_rate
+    {16, 1, UInt8Type}          // max_heart_rate
+};
+
+const FieldDefinition sessionFields[] = {
+    {253, 4, UInt32Type},       // timestamp
+    {2, 4, UInt32Type},         // start_time
+    {7, 4, UInt32Type},         // total_elapsed_time, ms
+    {8, 4, UInt32Type},         // total_timer_time, ms
+    {9, 4, UInt32Type},         // total_distance, cm
+    {0, 1, EnumType},           // event
+    {1, 1, EnumType},           // event_type
+    {5, 1, EnumType},           // sport
+    {16, 1, UInt8Type},         // avg_heart_rate
+    {17, 1, UInt8Type},         // max_heart_rate
+    {25, 2, UInt16Type},        // first_lap_index
+    {26, 2, UInt16Type}         // num_laps
+};
+
+const FieldDefinition activityFields[] = {
+    {253, 4, UInt32Type},       // timestamp
+    {0, 4, UInt32Type},         // total_timer_time, ms
+    {1, 2, UInt16Type},         // num_sessions
+    {2, 1, EnumType},           // type (manual)
+    {3, 1, EnumType},           // event
+    {4, 1, EnumType},           // event_type
+    {5, 4, UInt32Type}          // local_timestamp
+};
+
+// CRC-16 with the polynomial 0x8005 (reflected), one table lookup per byte
+class Crc16 {
+public:
+    Crc16()
+    {
+        for (int i = 0; i < 256; ++i) {
+            quint16 crc = quint16(i);
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ (0xa001 & (0 - (crc & 1)));
+            m_table[i] = crc;
+        }
+    }
+
+    quint16 operator()(const uchar *data, qint64 size, quint16 crc) const
+    {
+        for (const uchar *end = data + size; data != end; ++data)
+            crc = (crc >> 8) ^ m_table[(crc ^ *data) & 0xff];
+        return crc;
+    }
+
+private:
+    quint16 m_table[256];
+};
+
+class FitEncoder {
+public:
+    void u8(quint8 value) { m_data.append(char(value)); }
+    void u16(quint16 value) { u8(value & 0xff); u8(value >> 8); }
+    void u32(quint32 value) { u16(value & 0xffff); u16(value >> 16); }
+
+    void define(int localType, quint16 globalMessage, const FieldDefinition *fields, int count,
+                const FieldDefinition *firstField = 0)
+    {
+        u8(0x40 | localType);
+        u8(0);                  // reserved
+        u8(0);                  // little endian
+        u16(globalMessage);
+        u8(count + (firstField ? 1 : 0));
+        if (firstField)
+            field(*firstField);
+        for (int i = 0; i < count; ++i)
+            field(fields[i]);
+    }
+
+    QByteArray &data() { return m_data; }
+
+private:
+    void field(const FieldDefinition &field)
+    {
+        u8(field.number);
+        u8(field.size);
+        u8(field.baseType);
+    }
+
+    QByteArray m_data;
+};
+
+inline quint32 fitTime(qint64 msecsSinceEpoch)
+{
+    const qint64 secs = (msecsSinceEpoch >= -500 ? msecsSinceEpoch + 500 : msecsSinceEpoch - 499) / 1000 - FitEpoch;
+    return quint32(qBound<qint64>(0, secs, Q_INT64_C(0xfffffffe)));
+}
+
+inline bool hasPosition(const GpsSample &sample)
+{
+    return sample.lat != 0 || sample.lon != 0;
+}
+
+inline qint32 toSemicircles(double degrees)
+{
+    return qint32(qBound<qint64>(-Q_INT64_C(0x7fffffff), qRound64(degrees * SemicirclesPerDegree), Q_INT64_C(0x7ffffffe)));
+}
+
+inline quint8 toUInt8(int value)
+{
+    return value < 0 ? InvalidUInt8 : quint8(qMin(value, 254));
+}
+
+inline quint16 toUInt16(double value)
+{
+    return value < 0 ? InvalidUInt16 : quint16(qMin<qint64>(qRound64(value), 0xfffe));
+}
+
+inline quint32 toUInt32(double value)
+{
+    return value < 0 ? InvalidUInt32 : quint32(qMin<qint64>(qRound64(value), Q_INT64_C(0xfffffffe)));
+}
+
+/*
+    A definition message, reduced to what the decoder needs: the size of the
+    data messages and where the fields it reads are.
+*/
+struct FitDefinition {
+    enum Field {
+        Timestamp,
+        PositionLat,
+        PositionLong,
+        Altitude,
+        HeartRate,
+        Cadence,
+        Speed,
+        EnhancedAltitude,
+        EnhancedSpeed,
+        Sport,
+        FieldCount
+    };
+
+    FitDefinition() : defined(false), bigEndian(false), globalMessage(0), size(0)
+    {
+        for (int i = 0; i < FieldCount; ++i)
+            offsets[i] = -1;
+    }
+
+    // Maps a field of the global message to one of ours, with its expected size
+    bool lookup(int number, Field *field, int *expectedSize) const
+    {
+        static const struct { int number; Field field; int size; } recordMap[] = {
+            {253, Timestamp, 4}, {0, PositionLat, 4}, {1, PositionLong, 4}, {2, Altitude, 2},
+            {3, HeartRate, 1}, {4, Cadence, 1}, {6, Speed, 2}, {78, EnhancedAltitude, 4},
+            {73, EnhancedSpeed, 4}
+        };
+        if (number == 253) {
+            *field = Timestamp;
+            *expectedSize = 4;
+            return true;
+        }
+        if (globalMessage == SessionMessage && number == 5) {
+            *field = Sport;
+            *expectedSize = 1;
+            return true;
+        }
+        if (globalMessage == RecordMessage) {
+            for (size_t i = 0; i < sizeof(recordMap) / sizeof(recordMap[0]); ++i) {
+                if (recordMap[i].number == number) {
+                    *field = recordMap[i].field;
+                    *expectedSize = recordMap[i].size;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool has(Field field) const { return offsets[field] >= 0; }
+
+    quint32 value(const uchar *message, Field field) const
+    {
+        const uchar *p = message + offsets[field];
+        switch (sizes[field]) {
+        case 1:
+            return p[0];
+        case 2:
+            return bigEndian ? quint32(p[0] << 8 | p[1]) : quint32(p[1] << 8 | p[0]);
+        default:
+            return bigEndian ? quint32(p[0]) << 24 | quint32(p[1]) << 16 | quint32(p[2]) << 8 | p[3]
+                             : quint32(p[3]) << 24 | quint32(p[2]) << 16 | quint32(p[1]) << 8 | p[0];
+        }
+    }
+
+    bool defined;
+    bool bigEndian;
+    quint16 globalMessage;
+    int size;
+    int offsets[FieldCount];
+    int sizes[FieldCount];
+};
+
+class FitDecoder {
+public:
+    FitDecoder(SampleData *sampleData) : m_sampleData(sampleData), m_timestamp(0) {}
+    bool decode(const uchar *p, const uchar *end);
+
+private:
+    bool readDefinition(quint8 header, const uchar *&p, const uchar *end);
+    void readMessage(const FitDefinition &definition, const uchar *message, bool compressedTimestamp);
+
+    SampleData *m_sampleData;
+    FitDefinition m_definitions[LocalMessageTypes];
+    quint32 m_timestamp;        // of the last message that had one
+    GpsSample m_record;
+};
+
+bool FitDecoder::readDefinition(quint8 header, const uchar *&p, const uchar *end)
+{
+    if (end - p < 5)
+        return false;
+    FitDefinition &definition = m_definitions[header & 0xf];
+    definition = FitDefinition();
+    definition.bigEndian = p[1] == 1;
+    definition.globalMessage = definition.bigEndian ? quint16(p[2] << 8 | p[3]) : quint16(p[3] << 8 | p[2]);
+    const int fieldCount = p[4];
+    p += 5;
+    if (end - p < fieldCount * 3)
+        return false;
+    for (int i = 0; i < fieldCount; ++i, p += 3) {
+        FitDefinition::Field field;
+        int expectedSize;
+        if (definition.lookup(p[0], &field, &expectedSize) && p[1] == expectedSize) {
+            definition.offsets[field] = definition.size;
+            definition.sizes[field] = expectedSize;
+        }
+        definition.size += p[1];
+    }
+    if (header & 0x20) {
+        // Developer data fields, skipped
+        if (p == end)
+            return false;
+        const int developerFieldCount = *p++;
+        if (end - p < developerFieldCount * 3)
+            return false;
+        for (int i = 0; i < developerFieldCount; ++i, p += 3)
+            definition.size += p[1];
+    }
+    definition.defined = true;
+    return true;
+}
+
+void FitDecoder::readMessage(const FitDefinition &definition, const uchar *message, bool compressedTimestamp)
+{
+    if (!compressedTimestamp && definition.has(FitDefinition::Timestamp))
+        m_timestamp = definition.value(message, FitDefinition::Timestamp);
+
+    if (definition.globalMessage == SessionMessage && definition.has(FitDefinition::Sport)) {
+        switch (definition.value(message, FitDefinition::Sport)) {
+        case SportRunning:
+            m_sampleData->metaData.activity = SampleData::Running;
+            break;
+        case SportCycling:
+            m_sampleData->metaData.activity = SampleData::Cycling;
+            break;
+        default:
+            break;
+        }
+        return;
+    }
+    if (definition.globalMessage != RecordMessage)
+        return;
+
+    // Like GPX, a missing altitude keeps the previous value
+    GpsSample &sample = m_record;
+    sample.time = (qint64(m_timestamp) + FitEpoch) * 1000;
+    sample.lat = sample.lon = 0;
+    if (definition.has(FitDefinition::PositionLat) && definition.has(FitDefinition::PositionLong)) {
+        const qint32 lat = qint32(definition.value(message, FitDefinition::PositionLat));
+        const qint32 lon = qint32(definition.value(message, FitDefinition::PositionLong));
+        if (lat != InvalidSInt32 && lon != InvalidSInt32) {
+            sample.lat = lat / SemicirclesPerDegree;
+            sample.lon = lon / SemicirclesPerDegree;
+        }
+    }
+    if (definition.has(FitDefinition::EnhancedAltitude)
+        && definition.value(message, FitDefinition::EnhancedAltitude) != InvalidUInt32) {
+        sample.ele = float(definition.value(message, FitDefinition::EnhancedAltitude) / 5.0 - 500.0);
+    } else if (definition.has(FitDefinition::Altitude)
+               && definition.value(message, FitDefinition::Altitude) != InvalidUInt16) {
+        sample.ele = float(definition.value(message, FitDefinition::Altitude) / 5.0 - 500.0);
+    }
+    sample.hr = 0;
+    if (definition.has(FitDefinition::HeartRate)
+        && definition.value(message, FitDefinition::HeartRate) != InvalidUInt8) {
+        sample.hr = definition.value(message, FitDefinition::HeartRate);
+    }
+    sample.cadence = -1;
+    if (definition.has(FitDefinition::Cadence)
+        && definition.value(message, FitDefinition::Cadence) != InvalidUInt8) {
+        sample.cadence = definition.value(message, FitDefinition::Cadence);
+    }
+    sample.speed = -1;
+    if (definition.has(FitDefinition::EnhancedSpeed)
+        && definition.value(message, FitDefinition::EnhancedSpeed) != InvalidUInt32) {
+        sample.speed = float(definition.value(message, FitDefinition::EnhancedSpeed) * 0.0036);
+    } else if (definition.has(FitDefinition::Speed)
+               && definition.value(message, FitDefinition::Speed) != InvalidUInt16) {
+        sample.speed = float(definition.value(message, FitDefinition::Speed) * 0.0036);
+    }
+    m_sampleData->append(sample);
+}
+
+// Decodes the data records of one FIT file, [p, end) excludes header and CRC
+bool FitDecoder::decode(const uchar *p, const uchar *end)
+{
+    while (p < end) {
+        const quint8 header = *p++;
+        int localType;
+        bool compressedTimestamp = false;
+        if (header & 0x80) {
+            const quint32 offset = header & 0x1f;
+            quint32 timestamp = (m_timestamp & ~quint32(0x1f)) + offset;
+            if (offset < (m_timestamp & 0x1f))
+                timestamp += 0x20;
+            m_timestamp = timestamp;
+            compressedTimestamp = true;
+            localType = (header >> 5) & 0x3;
+        } else if (header & 0x40) {
+            if (!readDefinition(header, p, end))
+                return false;
+            continue;
+        } else {
+            localType = header & 0xf;
+        }
+
+        const FitDefinition &definition = m_definitions[localType];
+        if (!definition.defined || end - p < definition.size)
+            return false;
+        readMessage(definition, p, compressedTimestamp);
+        p += definition.size;
+    }
+    return true;
+}
+
+} // namespace
+
+/*!
+    Returns the FIT CRC of \a size bytes at \a data, continuing from \a crc.
+*/
+quint16 fitChecksum(const char *data, qint64 size, quint16 crc)
+{
+    static const Crc16 crc16;
+    return crc16(reinterpret_cast<const uchar *>(data), size, crc);
+}
+
+/*!
+    Appends the records of the FIT data in [\a begin, \a end) to \a sampleData.
+    Chained FIT files are read one after the other. Returns false if a header
+    or a CRC does not match, or the data is truncated.
+*/
+bool loadFIT(SampleData *sampleData, const char *begin, const char *end)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(begin);
+    const uchar *fileEnd = reinterpret_cast<const uchar *>(end);
+    if (p == fileEnd) {
+        qWarning("Empty FIT file");
+        return false;
+    }
+    while (p < fileEnd) {
+        const int headerSize = p[0];
+        if (fileEnd - p < 12 || headerSize < 12 || memcmp(p + 8, ".FIT", 4) != 0) {
+            qWarning("Invalid FIT header");
+            return false;
+        }
+        const quint32 dataSize = quint32(p[7]) << 24 | quint32(p[6]) << 16 | quint32(p[5]) << 8 | p[4];
+        if (quint64(fileEnd - p) < quint64(headerSize) + dataSize + 2) {
+            qWarning("Truncated FIT file");
+            return false;
+        }
+        const char *file = reinterpret_cast<const char *>(p);
+        const bool hasHeaderCrc = headerSize >= 14 && (p[12] || p[13]);
+        if ((hasHeaderCrc && fitChecksum(file, 14) != 0)
+            || fitChecksum(file, headerSize + dataSize + 2) != 0) {
+            qWarning("FIT file has a CRC error");
+            return false;
+        }
+        FitDecoder decoder(sampleData);
+        if (!decoder.decode(p + headerSize, p + headerSize + dataSize)) {
+            qWarning("Invalid FIT data");
+            return false;
+        }
+        p += headerSize + dataSize + 2;
+    }
+    return true;
+}
+
+/*!
+    Loads the FIT file \a fileName into \a sampleData.
+*/
+bool loadFIT(SampleData *sampleData, const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning("Failed to open '%s'", qPrintable(fileName));
+        return false;
+    }
+    const qint64 size = file.size();
+    const char *data = reinterpret_cast<const char *>(size > 0 ? file.map(0, size) : 0);
+    QByteArray contents;
+    if (!data) {
+        contents = file.readAll();
+        data = contents.constData();
+    }
+    return loadFIT(sampleData, data, data + (contents.isNull() ? size : contents.size()));
+}
+
+/*!
+    Writes \a sampleData as a FIT activity file to \a device.
+*/
+bool saveFIT(const SampleData &sampleData, QIODevice *device)
+{
+    if (sampleData.isEmpty()) {
+        qWarning("Data contains no samples");
+        return false;
+    }
+
+    FitEncoder fit;
+    fit.data().reserve(sampleData.count() * 22 + 256);
+    const quint32 startTime = fitTime(sampleData.first().time);
+    const quint32 endTime = fitTime(sampleData.last().time);
+
+    fit.define(LocalFileId, FileIdMessage, fileIdFields, 4);
+    fit.u8(LocalFileId);
+    fit.u8(FileTypeActivity);
+    fit.u16(ManufacturerDevelopment);
+    fit.u16(0);
+    fit.u32(startTime);
+
+    const int recordFieldCount = sizeof(recordFields) / sizeof(recordFields[0]);
+    fit.define(LocalCompressedRecord, RecordMessage, recordFields, recordFieldCount);
+    fit.define(LocalRecord, RecordMessage, recordFields, recordFieldCount, &timestampField);
+    double distance = 0;       // km
+    quint32 lastTimestamp = 0;
+    for (int i = 0; i < sampleData.count(); ++i) {
+        const GpsSample &sample = sampleData.at(i);
+        if (i > 0 && hasPosition(sample) && hasPosition(sampleData.at(i - 1))) {
+            const GpsSample &prev = sampleData.at(i - 1);
+            distance += segmentDistance(prev.lat, prev.lon, sample.lat, sample.lon);
+        }
+        const quint32 timestamp = fitTime(sample.time);
+        if (i > 0 && timestamp >= lastTimestamp && timestamp - lastTimestamp < 32) {
+            fit.u8(0x80 | LocalCompressedRecord << 5 | (timestamp & 0x1f));
+        } else {
+            fit.u8(LocalRecord);
+            fit.u32(timestamp);
+        }
+        lastTimestamp = timestamp;
+
+        if (hasPosition(sample)) {
+            fit.u32(toSemicircles(sample.lat));
+            fit.u32(toSemicircles(sample.lon));
+        } else {
+            fit.u32(InvalidSInt32);
+            fit.u32(InvalidSInt32);
+        }
+        fit.u16(toUInt16((sample.ele + 500.0) * 5.0));
+        fit.u8(sample.hr > 0 ? toUInt8(sample.hr) : InvalidUInt8);
+        fit.u8(toUInt8(sample.cadence));
+        fit.u32(toUInt32(distance * 100000.0));
+        fit.u16(toUInt16(sample.speed / 3.6 * 1000.0));
+    }
+
+    const SampleStatistics stats = sampleData.statistics();
+    const quint32 elapsed = toUInt32(double(sampleData.last().time - sampleData.first().time));
+    const quint32 totalDistance = toUInt32(distance * 100000.0);
+    const quint8 averageHR = stats.averageHR() > 0 ? toUInt8(qRound(stats.averageHR())) : InvalidUInt8;
+    const quint8 maximumHR = stats.maximumHR() > 0 ? toUInt8(stats.maximumHR()) : InvalidUInt8;
+
+    fit.define(LocalLap, LapMessage, lapFields, sizeof(lapFields) / sizeof(lapFields[0]));
+    fit.u8(LocalLap);
+    fit.u32(endTime);
+    fit.u32(startTime);
+    fit.u32(elapsed);
+    fit.u32(elapsed);
+    fit.u32(totalDistance);
+    fit.u8(EventLap);
+    fit.u8(EventTypeStop);
+    fit.u8(averageHR);
+    fit.u8(maximumHR);
+
+    quint8 sport = SportGeneric;
+    if (sampleData.metaData.activity == SampleData::Running)
+        sport = SportRunning;
+    else if (sampleData.metaData.activity == SampleData::Cycling)
+        sport = SportCycling;
+    fit.define(LocalSession, SessionMessage, sessionFields, sizeof(sessionFields) / sizeof(sessionFields[0]));
+    fit.u8(LocalSession);
+    fit.u32(endTime);
+    fit.u32(startTime);
+    fit.u32(elapsed);
+    fit.u32(elapsed);
+    fit.u32(totalDistance);
+    fit.u8(EventSession);
+    fit.u8(EventTypeStop);
+    fit.u8(sport);
+    fit.u8(averageHR);
+    fit.u8(maximumHR);
+    fit.u16(0);
+    fit.u16(1);
+
+    const QDateTime end = QDateTime::fromMSecsSinceEpoch(sampleData.last().time);
+    fit.define(LocalActivity, ActivityMessage, activityFields, sizeof(activityFields) / sizeof(activityFields[0]));
+    fit.u8(LocalActivity);
+    fit.u32(endTime);
+    fit.u32(elapsed);
+    fit.u16(1);
+    fit.u8(0);
+    fit.u8(EventActivity);
+    fit.u8(EventTypeStop);
+    fit.u32(endTime + end.offsetFromUtc());
+
+    const QByteArray &data = fit.data();
+    FitEncoder header;
+    header.u8(FileHeaderSize);
+    header.u8(ProtocolVersion);
+    header.u16(ProfileVersion);
+    header.u32(data.size());
+    header.data().append(".FIT", 4);
+    header.u16(fitChecksum(header.data().constData(), 12));
+
+    FitEncoder trailer;
+    trailer.u16(fitChecksum(data.constData(), data.size(),
+                            fitChecksum(header.data().constData(), FileHeaderSize)));
+    if (device->write(header.data()) != FileHeaderSize
+        || device->write(data) != data.size()
+        || device->write(trailer.data()) != 2) {
+        qWarning("Failed to write FIT data: %s", qPrintable(device->errorString()));
+        return false;
+    }
+    return true;
+}
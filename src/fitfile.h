@@ -0,0 +1,34 @@
+#ifndef FITFILE_H
+#define FITFILE_H
+
+#include <QtCore/qstring.h>
+#include "gpssample.h"
+
+class QIODevice;
+
+/*
+    Reading and writing of FIT (Flexible and Interoperable Data Transfer)
+    activity files.
+
+    saveFIT() writes a file_id message, one record message per sample (time,
+    position, altitude, HR, cadence, speed and the distance so far) and closing
+    lap, session and activity messages. Records less than 32 seconds apart use
+    compressed timestamp headers.
+
+    loadFIT() reads the record messages, and the sport of the session, from any
+    FIT activity file. Definition messages are cached per local message type
+    together with the offsets of the record fields, so data messages are decoded
+    without looking at their definition again.
+
+    FIT stores whole seconds, altitude in steps of 0.2 m, speed in mm/s and
+    positions in semicircles (about 1 cm). A position of exactly 0,0, a HR of 0
+    and a negative speed or cadence are written as invalid values, and read
+    back the same way.
+*/
+bool loadFIT(SampleData *sampleData, const QString &fileName);
+bool loadFIT(SampleData *sampleData, const char *begin, const char *end);
+bool saveFIT(const SampleData &sampleData, QIODevice *device);
+
+quint16 fitChecksum(const char *data, qint64 size, quint16 crc = 0);
+
+#endif // FITFILE_H
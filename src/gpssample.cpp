@@ -1,8 +1,14 @@
 #include <QtCore/qstring.h>
 #include <QtCore/qdatetime.h>
 #include <QtCore/qfile.h>
+#include <QtCore/qthreadpool.h>
+#include <QtConcurrent/qtconcurrentmap.h>
 #include "gpssample.h"
-#include "geo.h"
+#include "gpxwriter.h"
+#include "outlierfilter.h"
+#include "samplestatistics.h"
+#include "timestampformatter.h"
+#include "timeindex.h"
 
 #include <float.h>
 QString msToDateTimeStringHuman(qint64 msSinceEpoch)
@@ -36,9 +42,15 @@ QDebug operator<<(QDebug dbg, const GpsSample &s)
     dbg << "elevation:" << s.ele;
     dbg << "hr:" << s.hr;
     dbg << "speed:" << s.speed;
+    dbg << "cadence:" << s.cadence;
     return dbg;
 }
 
+TimeIndex SampleData::buildTimeIndex() const
+{
+    return TimeIndex(*this);
+}
+
 float SampleData::startAltitude() const
 {
     if (!isEmpty())
@@ -68,11 +80,11 @@ qint64 SampleData::endTime() const
 }
 
 float SampleData::averageHR() const {
-    float sum = 0;
+    qint64 sum = 0;
     foreach (const GpsSample &sample, *this) {
         sum += sample.hr;
     }
-    return sum/count();
+    return double(sum)/count();
 }
 
 int SampleData::maximumHR() const {
@@ -82,60 +94,54 @@ int SampleData::maximumHR() const {
     return max;
 }
 
-void SampleData::correctTimeErrors()
+struct StatisticsChunk
 {
-    if (!isEmpty()) {
-        GpsSample prev = first();
-        int lastGoodIndex = -1;
-        for (int i = 1; i < count(); ++i) {
-            GpsSample &curr = operator[](i);
-            double dist = haversineDistance(prev.lat, prev.lon, curr.lat, curr.lon);
-            double speed = -1;
-            if (curr.time != prev.time)
-                speed = dist * 3600000.0 /(curr.time - prev.time);
+    StatisticsChunk() : samples(0), count(0), firstIndex(0) {}
+    const GpsSample *samples;
+    int count;
+    int firstIndex;
+    SampleStatistics statistics;
+};
+
+static void sumChunk(StatisticsChunk &chunk)
+{
+    chunk.statistics.addSamples(chunk.samples, chunk.count, chunk.firstIndex);
+}
 
-            curr.speed = speed;
-            if (i >= 1) {
-                if (lastGoodIndex != -1) {
-                    GpsSample lastGood = at(lastGoodIndex);
-                    double speedDelta = qAbs(speed - lastGood.speed);
-                    //printf("i: %d, lastGoodIndex: %d, speedDelta: %.2f, %.2f, %.2f, %.2f\n", i, lastGoodIndex, speedDelta, speed, lastGood.speed, dist);
-                    if (speedDelta < 20) {
-                        if (lastGoodIndex < i - 1) {
-                            // Backtrack with a smaller error threshold (10 km/h difference)
-                            const int lastBackTrackIndex = qMax(lastGoodIndex - 10, 0);
-                            while (lastGoodIndex > lastBackTrackIndex) {
-                                GpsSample &s1 = operator[](lastGoodIndex - 1);
-                                GpsSample &s2 = operator[](lastGoodIndex);
-                                if (qAbs(s1.speed - s2.speed) > 8) {
-                                    --lastGoodIndex;
-                                } else {
-                                    break;
-                                }
-                            }
-                            lastGood = at(lastGoodIndex);
-                            qint64 deltaTime = curr.time - lastGood.time;
-                            double deltaLat = curr.lat - lastGood.lat;
-                            double deltaLon = curr.lon - lastGood.lon;
-                            int deltaIndex = i - lastGoodIndex;
-                            printf("Invalid data in range [%d,%d], fixing with interpolation\n", lastGoodIndex + 1, i-1);
-                            // Do linear interpolation over the error range
-                            for (int j = lastGoodIndex + 1; j < i; ++j) {
-                                GpsSample &fix = operator[](j);
-                                fix.time = lastGood.time + deltaTime * (j - lastGoodIndex)/deltaIndex;
-                                fix.lat = lastGood.lat + deltaLat * (j - lastGoodIndex)/deltaIndex;
-                                fix.lon = lastGood.lon + deltaLon * (j - lastGoodIndex)/deltaIndex;
-                            }
-                        }
-                        lastGoodIndex = i;
-                    }
-                } else {
-                    lastGoodIndex = i;
-                }
-            }
-            prev = curr;
-        }
+SampleStatistics SampleData::statistics() const
+{
+    enum { MinimumChunkSize = 64 * 1024 };
+    const int threadCount = QThreadPool::globalInstance()->maxThreadCount();
+    const int chunkCount = qMin(threadCount, count() / MinimumChunkSize);
+    if (chunkCount <= 1)
+        return SampleStatistics(*this);
+
+    QVector<StatisticsChunk> chunks(chunkCount);
+    const int chunkSize = (count() + chunkCount - 1) / chunkCount;
+    for (int i = 0; i < chunkCount; ++i) {
+        StatisticsChunk &chunk = chunks[i];
+        chunk.firstIndex = i * chunkSize;
+        chunk.samples = constData() + chunk.firstIndex;
+        chunk.count = qMin(chunkSize, count() - chunk.firstIndex);
     }
+    QtConcurrent::blockingMap(chunks, sumChunk);
+
+    SampleStatistics result;
+    for (int i = 0; i < chunkCount; ++i)
+        result.combine(chunks.at(i).statistics);
+    return result;
+}
+
+/*!
+    Replaces positions (and times) that are inconsistent with the rest of the
+    track with an interpolation, and returns the ranges that were replaced.
+    Ranges that were too long to replace are added to \a uncorrected.
+    See OutlierFilter.
+*/
+QVector<SampleRange> SampleData::correctTimeErrors(QVector<SampleRange> *uncorrected)
+{
+    OutlierFilter filter;
+    return filter.correct(this, uncorrected);
 }
 
 /*!
@@ -170,8 +176,9 @@ void SampleData::correctAltitudes(float startAltitude, float endAltitude = -FLT_
 
 void SampleData::print() const
 {
-    qint64 timeStarted = startTime();
-    qint64 timeFinsihed = endTime();
+    const SampleStatistics stats = statistics();
+    qint64 timeStarted = stats.startTime();
+    qint64 timeFinsihed = stats.endTime();
     qint64 timeElapsed = timeFinsihed - timeStarted;
 
     QString startStr = msToDateTimeString(timeStarted);
@@ -181,53 +188,25 @@ void SampleData::print() const
     printf("Start time:     %s\n", qPrintable(startStr));
     printf("End time:       %s\n", qPrintable(endStr));
     printf("Elapsed time:   %s\n", qPrintable(elapsedStr));
-    printf("Start altitude: %g\n", startAltitude());
-    printf("End altitude:   %g\n", endAltitude());
+    printf("Start altitude: %g\n", stats.startAltitude());
+    printf("End altitude:   %g\n", stats.endAltitude());
+    printf("Ascent/descent: %.0f/%.0f\n", stats.ascent(), stats.descent());
     printf("Activity:       %s\n", activityString(metaData.activity));
-    printf("HR avg/max:     %.1f/%d\n", averageHR(), maximumHR());
-
-    double maxSpeed = 0;
-    int maxSpeedIndex = -1;
-    double totalDist = 0;
-    if (!isEmpty()) {
-        GpsSample prev = first();
-        if (prev.speed == -1) {
-            double speed = 0.0;
-            for (int i = 1; i < count(); ++i) {
-                GpsSample curr = at(i);
-                double dist = haversineDistance(prev.lat, prev.lon, curr.lat, curr.lon);
-                totalDist += dist;
-                speed = dist * 3600000.0 /(curr.time - prev.time);
-                prev.speed = speed;
-                if (speed > maxSpeed) {
-                    maxSpeedIndex = i;
-                    maxSpeed = speed;
-                }
-                prev = curr;
-            }
-            prev.speed = speed;
-        }
-        for (int i = 0; i < count(); ++i) {
-            GpsSample curr = at(i);
-            double speed = curr.speed;
-            if (speed > maxSpeed) {
-                maxSpeedIndex = i;
-                maxSpeed = speed;
-            }
-        }
-    }
-    printf("Max speed:      %.1f\n", maxSpeed);
-    printf("Max speed index:%d\n", maxSpeedIndex);
-    if (totalDist > 0)
-        printf("Route distance :%.2f\n", totalDist);
+    printf("HR avg/max:     %.1f/%d\n", stats.averageHR(), stats.maximumHR());
+    printf("Max speed:      %.1f\n", stats.maximumSpeed());
+    printf("Max speed index:%d\n", stats.maximumSpeedIndex());
+    if (stats.distance() > 0)
+        printf("Route distance :%.2f\n", stats.distance());
 }
 
 void SampleData::printSamples() const
 {
+    TimestampFormatter timestamps;
+    char strTime[TimestampFormatter::MaxLength + 1];
     for (int i = 0; i < count(); ++i) {
         GpsSample sample = at(i);
-        QString strTime = msToDateTimeString(sample.time);
-        printf("hrm: %s %d, %g, %g", qPrintable(strTime), sample.hr, sample.speed/10, sample.ele);
+        *timestamps.format(sample.time, strTime) = '\0';
+        printf("hrm: %s %d, %g, %g", strTime, sample.hr, sample.speed/10, sample.ele);
     }
 }
 
@@ -239,60 +218,5 @@ bool SampleData::writeGPX(const QString &fileName)
         qWarning("Failed to open '%s'", qPrintable(fileName));
         return false;
     }
-
-    if (count() == 0) {
-        qWarning("Data contains no samples");
-        return false;
-    }
-    QTextStream stream(&out);
-
-    const GpsSample &sample = first();
-    QDateTime dt;
-    dt.setMSecsSinceEpoch(sample.time);
-    const QString strDateTime = dt.toString(QLatin1String("dd/MM/yyyy hh:mm:ss"));
-
-    stream.setRealNumberNotation(QTextStream::FixedNotation);
-    stream << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
-    stream << "<gpx xsi:schemaLocation=\"http://www.topografix.com/GPX/1/1"
-             " http://www.topografix.com/GPX/1/1/gpx.xsd"
-             " http://www.garmin.com/xmlschemas/GpxExtensions/v3"
-             " http://www.garmin.com/xmlschemas/GpxExtensionsv3.xsd"
-             " http://www.garmin.com/xmlschemas/TrackPointExtension/v1"
-             " http://www.garmin.com/xmlschemas/TrackPointExtensionv1.xsd\""
-           " version=\"1.1\""
-           " creator=\"HrmGpx\""
-           " xmlns=\"http://www.topografix.com/GPX/1/1\""
-           " xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\""
-           " xmlns:gpxtpx=\"http://www.garmin.com/xmlschemas/TrackPointExtension/v1\""
-           " xmlns:gpxx=\"http://www.garmin.com/xmlschemas/GpxExtensions/v3\">\n";
-    stream << "  <metadata>\n";
-    stream << "    <name>" << metaData.name << "</name>\n";
-    stream << "    <desc>" << metaData.description << "</desc>\n";
-    stream << "    <author>\n";
-    stream << "      <name>Jan-Arve Saether</name>\n";
-    stream << "    </author>\n";
-    stream << "    <link href=\"jans@tihlde.org\">\n";
-    stream << "      <text>HrmGpx</text>\n";
-    stream << "    </link>\n";
-    stream << "  </metadata>\n";
-    stream << "  <trk>\n";
-    stream << "      <trkseg>\n";
-
-    Q_FOREACH (const GpsSample &sample, (*this)) {
-        stream.setRealNumberPrecision(15);
-        stream << "        <trkpt lat=\"" << sample.lat << "\" lon=\"" << sample.lon << "\">\n";
-        stream.setRealNumberPrecision(1);
-        stream << "          <ele>" << sample.ele << "</ele>\n";
-        stream << "          <time>" << msToDateTimeString(sample.time) << "</time>\n";
-        stream << "          <extensions><gpxtpx:TrackPointExtension><gpxtpx:hr>"
-                                << sample.hr
-                                << "</gpxtpx:hr></gpxtpx:TrackPointExtension></extensions>\n";
-        stream << "        </trkpt>\n";
-    }
-
-    stream << "    </trkseg>\n";
-    stream << "  </trk>\n";
-    stream << "</gpx>\n";
-    out.close();
-    return true;
+    return GpxWriter().write(*this, &out);
 }
@@ -5,9 +5,12 @@
 #include <QtCore/qpair.h>
 #include <QtCore/qdebug.h>
 
+class TimeIndex;
+class SampleStatistics;
+
 struct GpsSample {
     GpsSample()
-        : time(0), ele(0), lat(0), lon(0), hr(0), speed(-1)
+        : time(0), ele(0), lat(0), lon(0), hr(0), speed(-1), cadence(-1)
     {
     }
                     // Supported by:
@@ -17,17 +20,25 @@ struct GpsSample {
     double lon;     // GPX
     int hr;         // HRM
     float speed;    // HRM
+    int cadence;    // HRM, -1 if not recorded
 
 };
 
 QDebug operator<<(QDebug dbg, const GpsSample &s);
 
+// The samples from first to last, inclusive
+struct SampleRange {
+    SampleRange(int first = 0, int last = -1) : first(first), last(last) {}
+    int first;
+    int last;
+};
+
 class SampleData : public QVector<GpsSample> {
 public:
     QVector<GpsSample>::const_iterator atTime(qint64 time) const {
         GpsSample search;
         search.time = time;
-        QVector<GpsSample>::const_iterator it = qLowerBound(constBegin(), constEnd(), search, &lessThanTime);
+        QVector<GpsSample>::const_iterator it = qUpperBound(constBegin(), constEnd(), search, &lessThanTime);
         if (it != constBegin())
             --it;
         return it;
@@ -36,6 +47,9 @@ public:
     int indexOfTime(qint64 time) const {
         return atTime(time) - constBegin();
     }
+
+    // For repeated lookups, see TimeIndex
+    TimeIndex buildTimeIndex() const;
     
     qint64 startTime() const;
     qint64 endTime() const;
@@ -46,7 +60,10 @@ public:
     float averageHR() const;
     int maximumHR() const;
 
-    void correctTimeErrors();
+    // Everything print() shows, in one pass over the samples
+    SampleStatistics statistics() const;
+
+    QVector<SampleRange> correctTimeErrors(QVector<SampleRange> *uncorrected = 0);
     void correctAltitudes(float startAltitude, float endAltitude);
     void print() const;
     void printSamples() const;
@@ -74,7 +91,7 @@ public:
     } metaData;
 
 private:
-    static bool lessThanTime(const GpsSample &a, const GpsSample &b) { return a.time <= b.time; }
+    static bool lessThanTime(const GpsSample &a, const GpsSample &b) { return a.time < b.time; }
 };
 
 
@@ -1,9 +1,14 @@
 #include "gpxparser.h"
 #include <QtCore/QXmlStreamReader>
 #include <QtCore/qfile.h>
-#include <QtCore/qdatetime.h>
-#include <QtCore/qregularexpression.h>
+#include <QtConcurrent/qtconcurrentmap.h>
 
+#include <string.h>
+#include <algorithm>
+
+#include "compresseddevice.h"
+#include "iso8601.h"
+#include "numberparser.h"
 
 class GpxStreamReader : public QXmlStreamReader
 {
@@ -76,42 +81,12 @@ bool GpxStreamReader::read(SampleData *sampleData)
                     trkpt.ele = ele;
                     eleElement = false;
                 } else if (timeElement) {
-                    QString timeStr = text().toString();
-                    //yyyy-MM-ddThh:mm:ss(.z)
-                    // Local? time: yyyy-MM-ddThh:mm:ss(.z)
-                    // UTC  time  : yyyy-MM-ddThh:mm:ss(.z)Z
-                    // Timezone   : yyyy-MM-ddThh:mm:ss(.z)+03:00
-                    //yyyy-MM-ddThh:mm:ss(.z)?(Z|+hh:mm)
-                    //2013-07-09T15:26:48Z
-                    uint milliseconds = 0;
-                    const int indexOfDot = timeStr.indexOf(QLatin1Char('.'));
-
-                    if (indexOfDot >= 0) {
-                        int i = indexOfDot;
-                        ++i;
-                        while (i < timeStr.count() && timeStr.at(i++).isDigit()) {  }
-
-                        // The spec is unclear whether there can be more than 3 fractional digits
-                        const QString strMS = timeStr.mid(indexOfDot + 1, qMax(3, i - indexOfDot - 1));
-                        if (!strMS.isEmpty()) {
-                            static int powers[] = {100, 10, 1};
-                            const int numberAfterDot = strMS.toUInt(&ok);
-                            if (!ok)
-                                break;
-                            const int digits = strMS.count();
-                            Q_ASSERT(digits >= 1);
-                            milliseconds = numberAfterDot * powers[digits - 1];
-                            timeStr.remove(indexOfDot, i - indexOfDot);
-                        }
-                    }
-                    QDateTime dt = QDateTime::fromString(timeStr,Qt::ISODate);
-                    ok = dt.isValid();
+                    const QByteArray timeStr = text().toString().toLatin1();
+                    ok = parseIsoDateTime(timeStr.constData(), timeStr.constData() + timeStr.size(), &trkpt.time);
                     if (!ok) {
-                        qWarning("(%d): Error reading time data", lineNumber());
+                        qWarning("(%lld): Error reading time data", lineNumber());
                         break;
                     }
-                    trkpt.time = dt.toMSecsSinceEpoch();
-                    trkpt.time += milliseconds;
                     timeElement = false;
                 }
             }
@@ -121,76 +96,590 @@ bool GpxStreamReader::read(SampleData *sampleData)
     return ok;
 }
 
+/*
+    GpxScanner reads the elements hrmgpx cares about (<metadata>, <trkpt>, <ele>
+    and <time>) directly from a byte buffer, usually a memory mapped file.
+    Unlike GpxStreamReader it does not build a QString for every token; it only
+    understands the subset of XML found in GPX files, and skips comments,
+    processing instructions, CDATA sections and DOCTYPE declarations.
+*/
+class GpxScanner
+{
+public:
+    // \a firstLine is the line number of \a document, for error messages
+    GpxScanner(const char *document, const char *begin, const char *end, qint64 firstLine = 1)
+        : m_document(document), m_firstLine(firstLine), m_pos(begin), m_end(end), m_error(0),
+          m_hasRoot(false), m_samplesBeforeElevation(-1), m_samplesBeforeTime(-1)
+    {
+    }
+    bool read(SampleData *sampleData);
+
+    // The <trkpt> being built; elements missing from a <trkpt> keep the previous value
+    const GpsSample &state() const { return m_trkpt; }
+    // Whether a <gpx> start tag was read
+    bool hasRoot() const { return m_hasRoot; }
+    // The number of samples read before the first <ele> or <time>, or -1 if none was read
+    int samplesBeforeElevation() const { return m_samplesBeforeElevation; }
+    int samplesBeforeTime() const { return m_samplesBeforeTime; }
+
+private:
+    struct Tag {
+        const char *name;           // local name, without any namespace prefix
+        int nameLength;
+        const char *attributes;
+        const char *attributesEnd;
+        bool isEndElement;
+        bool isEmptyElement;        // <foo/>
+    };
+
+    bool nextTag(Tag *tag);
+    bool readMetaData(SampleData *sampleData);
+    bool readText(const char **begin, const char **end);
+    QString readElementText();
+    qint64 lineNumber() const;
+
+    static bool isName(const Tag &tag, const char *name, int length)
+    {
+        return tag.nameLength == length && memcmp(tag.name, name, length) == 0;
+    }
+    static bool attributeValue(const Tag &tag, const char *name, int length,
+                               const char **begin, const char **end);
+
+    const char *m_document;
+    qint64 m_firstLine;
+    const char *m_pos;
+    const char *m_end;
+    const char *m_error;
+    bool m_hasRoot;
+    GpsSample m_trkpt;
+    int m_samplesBeforeElevation;
+    int m_samplesBeforeTime;
+};
+
+static inline bool isXmlSpace(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+static const char *findString(const char *from, const char *end, const char *str, int length)
+{
+    while (end - from >= length) {
+        const char *candidate = static_cast<const char *>(memchr(from, str[0], end - from - length + 1));
+        if (!candidate)
+            break;
+        if (memcmp(candidate, str, length) == 0)
+            return candidate;
+        from = candidate + 1;
+    }
+    return 0;
+}
+
+qint64 GpxScanner::lineNumber() const
+{
+    return m_firstLine + std::count(m_document, m_pos, '\n');
+}
+
+bool GpxScanner::nextTag(Tag *tag)
+{
+    while (m_pos < m_end) {
+        const char *lt = static_cast<const char *>(memchr(m_pos, '<', m_end - m_pos));
+        if (!lt) {
+            m_pos = m_end;
+            return false;
+        }
+        m_pos = lt + 1;
+        if (m_pos == m_end)
+            break;
+
+        if (*m_pos == '!' || *m_pos == '?') {
+            const char *close = 0;
+            int closeLength = 1;
+            if (m_end - m_pos >= 3 && memcmp(m_pos, "!--", 3) == 0) {
+                close = findString(m_pos + 3, m_end, "-->", 3);
+                closeLength = 3;
+            } else if (m_end - m_pos >= 8 && memcmp(m_pos, "![CDATA[", 8) == 0) {
+                close = findString(m_pos + 8, m_end, "]]>", 3);
+                closeLength = 3;
+            } else if (*m_pos == '?') {
+                close = findString(m_pos + 1, m_end, "?>", 2);
+                closeLength = 2;
+            } else {
+                close = static_cast<const char *>(memchr(m_pos, '>', m_end - m_pos));
+            }
+            if (!close)
+                break;
+            m_pos = close + closeLength;
+            continue;
+        }
+
+        tag->isEndElement = (*m_pos == '/');
+        if (tag->isEndElement)
+            ++m_pos;
+        tag->name = m_pos;
+        while (m_pos < m_end && !isXmlSpace(*m_pos) && *m_pos != '>' && *m_pos != '/') {
+            if (*m_pos == ':')
+                tag->name = m_pos + 1;
+            ++m_pos;
+        }
+        tag->nameLength = m_pos - tag->name;
+        tag->attributes = m_pos;
+
+        // Find the closing '>', ignoring any '>' inside quoted attribute values
+        char quote = 0;
+        while (m_pos < m_end) {
+            const char ch = *m_pos;
+            if (quote) {
+                if (ch == quote)
+                    quote = 0;
+            } else if (ch == '"' || ch == '\'') {
+                quote = ch;
+            } else if (ch == '>') {
+                break;
+            }
+            ++m_pos;
+        }
+        if (m_pos == m_end)
+            break;
+        tag->isEmptyElement = (m_pos > tag->attributes && m_pos[-1] == '/');
+        tag->attributesEnd = tag->isEmptyElement ? m_pos - 1 : m_pos;
+        ++m_pos;
+        return true;
+    }
+    m_error = "Premature end of document";
+    m_pos = m_end;
+    return false;
+}
+
+bool GpxScanner::attributeValue(const Tag &tag, const char *name, int length,
+                                const char **begin, const char **end)
+{
+    const char *p = tag.attributes;
+    const char *e = tag.attributesEnd;
+    while (p < e) {
+        while (p < e && isXmlSpace(*p))
+            ++p;
+        const char *attrName = p;
+        while (p < e && *p != '=' && !isXmlSpace(*p))
+            ++p;
+        const int attrNameLength = p - attrName;
+        while (p < e && isXmlSpace(*p))
+            ++p;
+        if (p == e || *p != '=')
+            return false;
+        ++p;
+        while (p < e && isXmlSpace(*p))
+            ++p;
+        if (p == e || (*p != '"' && *p != '\''))
+            return false;
+        const char quote = *p++;
+        const char *value = p;
+        p = static_cast<const char *>(memchr(p, quote, e - p));
+        if (!p)
+            return false;
+        if (attrNameLength == length && memcmp(attrName, name, length) == 0) {
+            const char *valueEnd = p;
+            while (value < valueEnd && isXmlSpace(*value))
+                ++value;
+            while (valueEnd > value && isXmlSpace(valueEnd[-1]))
+                --valueEnd;
+            *begin = value;
+            *end = valueEnd;
+            return true;
+        }
+        ++p;
+    }
+    return false;
+}
+
+/*
+    Returns the character data from the current position up to the next tag,
+    with surrounding whitespace removed.
+*/
+bool GpxScanner::readText(const char **begin, const char **end)
+{
+    const char *lt = static_cast<const char *>(memchr(m_pos, '<', m_end - m_pos));
+    const char *b = m_pos;
+    const char *e = lt ? lt : m_end;
+    m_pos = e;
+    while (b < e && isXmlSpace(*b))
+        ++b;
+    while (e > b && isXmlSpace(e[-1]))
+        --e;
+    *begin = b;
+    *end = e;
+    return b != e;
+}
+
+static QString decodeEntities(const char *begin, const char *end)
+{
+    QString text = QString::fromUtf8(begin, end - begin);
+    int amp = text.indexOf(QLatin1Char('&'));
+    while (amp >= 0) {
+        const int semicolon = text.indexOf(QLatin1Char(';'), amp);
+        if (semicolon < 0)
+            break;
+        const QString entity = text.mid(amp + 1, semicolon - amp - 1);
+        QString replacement;
+        if (entity == QLatin1String("lt"))
+            replacement = QLatin1String("<");
+        else if (entity == QLatin1String("gt"))
+            replacement = QLatin1String(">");
+        else if (entity == QLatin1String("amp"))
+            replacement = QLatin1String("&");
+        else if (entity == QLatin1String("quot"))
+            replacement = QLatin1String("\"");
+        else if (entity == QLatin1String("apos"))
+            replacement = QLatin1String("'");
+        else if (entity.startsWith(QLatin1String("#x")))
+            replacement = QChar(entity.mid(2).toUInt(0, 16));
+        else if (entity.startsWith(QLatin1Char('#')))
+            replacement = QChar(entity.mid(1).toUInt());
+        if (!replacement.isNull())
+            text.replace(amp, semicolon - amp + 1, replacement);
+        amp = text.indexOf(QLatin1Char('&'), amp + 1);
+    }
+    return text;
+}
+
+/*
+    Reads the text of a simple element, including CDATA sections, and consumes
+    its end tag. Metadata is only read once per file, so this is allowed to
+    allocate.
+*/
+QString GpxScanner::readElementText()
+{
+    QString text;
+    for (;;) {
+        const char *lt = static_cast<const char *>(memchr(m_pos, '<', m_end - m_pos));
+        const char *e = lt ? lt : m_end;
+        text += decodeEntities(m_pos, e);
+        m_pos = e;
+        if (m_end - m_pos < 9 || memcmp(m_pos, "<![CDATA[", 9) != 0)
+            break;
+        const char *close = findString(m_pos + 9, m_end, "]]>", 3);
+        if (!close)
+            break;
+        text += QString::fromUtf8(m_pos + 9, close - m_pos - 9);
+        m_pos = close + 3;
+    }
+    Tag tag;
+    nextTag(&tag);
+    return text;
+}
+
+bool GpxScanner::readMetaData(SampleData *sampleData)
+{
+    int depth = 0;
+    Tag tag;
+    while (nextTag(&tag)) {
+        if (tag.isEndElement) {
+            if (depth == 0)
+                return true;
+            --depth;
+        } else if (depth == 0 && isName(tag, "name", 4)) {
+            sampleData->metaData.name = tag.isEmptyElement ? QString() : readElementText();
+        } else if (depth == 0 && isName(tag, "desc", 4)) {
+            sampleData->metaData.description = tag.isEmptyElement ? QString() : readElementText();
+        } else if (!tag.isEmptyElement) {
+            ++depth;
+        }
+    }
+    return false;
+}
+
+bool GpxScanner::read(SampleData *sampleData)
+{
+    GpsSample &trkpt = m_trkpt;
+    const int firstSample = sampleData->count();
+    Tag tag;
+    const char *begin;
+    const char *end;
+    while (nextTag(&tag)) {
+        if (tag.isEndElement) {
+            if (isName(tag, "trkpt", 5))
+                sampleData->append(trkpt);
+        } else if (isName(tag, "trkpt", 5)) {
+            bool ok = attributeValue(tag, "lat", 3, &begin, &end)
+                    && parseDouble(begin, end, &trkpt.lat) == end
+                    && attributeValue(tag, "lon", 3, &begin, &end)
+                    && parseDouble(begin, end, &trkpt.lon) == end;
+            if (!ok) {
+                qWarning("(%lld): Error reading longitude and latitude data", lineNumber());
+                return false;
+            }
+            if (tag.isEmptyElement)
+                sampleData->append(trkpt);
+        } else if (isName(tag, "gpx", 3)) {
+            m_hasRoot = true;
+        } else if (tag.isEmptyElement) {
+            // nothing to read
+        } else if (isName(tag, "ele", 3)) {
+            if (!readText(&begin, &end) || parseFloat(begin, end, &trkpt.ele) != end) {
+                qWarning("(%lld): Error reading elevation data", lineNumber());
+                return false;
+            }
+            if (m_samplesBeforeElevation < 0)
+                m_samplesBeforeElevation = sampleData->count() - firstSample;
+        } else if (isName(tag, "time", 4)) {
+            bool ok = readText(&begin, &end);
+            if (ok)
+                ok = parseIsoDateTime(begin, end, &trkpt.time);
+            if (!ok) {
+                qWarning("(%lld): Error reading time data", lineNumber());
+                return false;
+            }
+            if (m_samplesBeforeTime < 0)
+                m_samplesBeforeTime = sampleData->count() - firstSample;
+        } else if (isName(tag, "metadata", 8)) {
+            if (!readMetaData(sampleData))
+                break;
+        }
+    }
+    if (m_error) {
+        qWarning("error at line: %lld (%s)\n", lineNumber(), m_error);
+        return false;
+    }
+    return true;
+}
+
+/*
+    Parallel parsing splits the buffer in front of <trkpt> start tags, so that
+    every chunk only contains complete track points. The first chunk also holds
+    the header with <metadata>.
+*/
+struct GpxChunk
+{
+    GpxChunk() : document(0), firstLine(1), begin(0), end(0), ok(false), hasRoot(false), samplesBeforeElevation(-1), samplesBeforeTime(-1) {}
+    const char *document;
+    qint64 firstLine;           // of document
+    const char *begin;
+    const char *end;
+    SampleData samples;
+    bool ok;
+    GpsSample state;
+    bool hasRoot;
+    int samplesBeforeElevation;
+    int samplesBeforeTime;
+};
+
+static const char *findTrackPoint(const char *from, const char *end)
+{
+    while ((from = findString(from, end, "<trkpt", 6))) {
+        const char ch = (from + 6 < end ? from[6] : '>');
+        if (isXmlSpace(ch) || ch == '>' || ch == '/')
+            return from;
+        from += 6;
+    }
+    return end;
+}
+
+static void scanChunk(GpxChunk &chunk)
+{
+    GpxScanner scanner(chunk.document, chunk.begin, chunk.end, chunk.firstLine);
+    chunk.ok = scanner.read(&chunk.samples);
+    chunk.state = scanner.state();
+    chunk.hasRoot = scanner.hasRoot();
+    chunk.samplesBeforeElevation = scanner.samplesBeforeElevation();
+    chunk.samplesBeforeTime = scanner.samplesBeforeTime();
+}
+
+/*
+    Appends the samples of \a chunk. A <trkpt> without <ele> or <time> inherits
+    the value from the previous one, which might have been read by the previous
+    chunk; \a state carries those values from chunk to chunk.
+*/
+static void appendChunk(SampleData *sampleData, GpxChunk &chunk, GpsSample *state)
+{
+    const int count = chunk.samples.count();
+    const int withoutElevation = chunk.samplesBeforeElevation < 0 ? count : chunk.samplesBeforeElevation;
+    const int withoutTime = chunk.samplesBeforeTime < 0 ? count : chunk.samplesBeforeTime;
+    for (int j = 0; j < withoutElevation; ++j)
+        chunk.samples[j].ele = state->ele;
+    for (int j = 0; j < withoutTime; ++j)
+        chunk.samples[j].time = state->time;
+    if (chunk.samplesBeforeElevation >= 0)
+        state->ele = chunk.state.ele;
+    if (chunk.samplesBeforeTime >= 0)
+        state->time = chunk.state.time;
+
+    *sampleData += chunk.samples;
+    if (!chunk.samples.metaData.name.isNull())
+        sampleData->metaData.name = chunk.samples.metaData.name;
+    if (!chunk.samples.metaData.description.isNull())
+        sampleData->metaData.description = chunk.samples.metaData.description;
+}
+
+static bool noRootElement()
+{
+    qWarning("Not a GPX document: no <gpx> element");
+    return false;
+}
+
+static bool scanGPX(SampleData *sampleData, const char *begin, const char *end, int threadCount)
+{
+    static const qint64 MinimumChunkSize = 1024 * 1024;
+    const qint64 size = end - begin;
+    const int chunkCount = int(qMin<qint64>(threadCount * 4, size / MinimumChunkSize));
+    if (threadCount <= 1 || chunkCount <= 1) {
+        GpxScanner scanner(begin, begin, end);
+        if (!scanner.read(sampleData))
+            return false;
+        return scanner.hasRoot() || noRootElement();
+    }
+
+    QVector<GpxChunk> chunks;
+    const char *chunkBegin = begin;
+    for (int i = 1; i <= chunkCount && chunkBegin < end; ++i) {
+        const char *chunkEnd = end;
+        if (i < chunkCount)
+            chunkEnd = findTrackPoint(qMax(chunkBegin + 1, begin + size * i / chunkCount), end);
+        GpxChunk chunk;
+        chunk.document = begin;
+        chunk.begin = chunkBegin;
+        chunk.end = chunkEnd;
+        chunks.append(chunk);
+        chunkBegin = chunkEnd;
+    }
+
+    QtConcurrent::blockingMap(chunks, scanChunk);
+    if (chunks.first().ok && !chunks.first().hasRoot)
+        return noRootElement();
+
+    int total = sampleData->count();
+    for (int i = 0; i < chunks.count(); ++i) {
+        if (!chunks.at(i).ok)
+            return false;
+        total += chunks.at(i).samples.count();
+    }
+    sampleData->reserve(total);
+
+    GpsSample state;
+    for (int i = 0; i < chunks.count(); ++i)
+        appendChunk(sampleData, chunks[i], &state);
+    return true;
+}
+
+static const char *lastTrackPoint(const char *from, const char *end)
+{
+    // Track points are short, so one is almost always found near the end
+    const char *search = qMax(from, end - 4096);
+    for (;;) {
+        const char *last = end;
+        for (const char *p = findTrackPoint(search, end); p != end; p = findTrackPoint(p + 6, end))
+            last = p;
+        if (last != end || search == from)
+            return last;
+        search = from;
+    }
+}
+
+/*
+    Scans GPX data read from a sequential \a device, such as a CompressedDevice,
+    while it arrives: whenever a block has been read, everything in front of
+    the last <trkpt> start tag is scanned as one chunk and dropped from the
+    buffer. Only the unscanned tail is kept, so memory does not grow with the
+    size of the document.
+*/
+static bool streamGPX(SampleData *sampleData, QIODevice *device)
+{
+    enum { BlockSize = 256 * 1024 };
+    QByteArray buffer;          // data that has not been scanned yet
+    qint64 line = 1;            // line number of the start of buffer
+    bool hasRoot = false;
+    GpsSample state;
+    for (;;) {
+        const int size = buffer.size();
+        buffer.resize(size + BlockSize);
+        const qint64 read = device->read(buffer.data() + size, BlockSize);
+        if (read < 0) {
+            qWarning("Failed to read GPX data: %s", qPrintable(device->errorString()));
+            return false;
+        }
+        buffer.resize(size + int(read));
+
+        const char *begin = buffer.constData();
+        const char *end = begin + buffer.size();
+        const char *chunkEnd = read ? lastTrackPoint(begin + 1, end) : end;
+        if (chunkEnd != end || !read) {
+            GpxChunk chunk;
+            chunk.document = begin;
+            chunk.firstLine = line;
+            chunk.begin = begin;
+            chunk.end = chunkEnd;
+            scanChunk(chunk);
+            if (!chunk.ok)
+                return false;
+            appendChunk(sampleData, chunk, &state);
+            hasRoot = hasRoot || chunk.hasRoot;
+            const qint64 scanned = chunkEnd - begin;
+            line += std::count(begin, chunkEnd, '\n');
+            buffer.remove(0, int(scanned));
+        }
+        if (!read)
+            return hasRoot || noRootElement();
+    }
+}
+
+static bool loadCompressedGPX(SampleData *sampleData, QIODevice *device, CompressedDevice::Format format)
+{
+    if (!CompressedDevice::isSupported(format)) {
+        qWarning("Unsupported compression format");
+        return false;
+    }
+    CompressedDevice decompressor(device, format);
+    return decompressor.open(QIODevice::ReadOnly) && streamGPX(sampleData, &decompressor);
+}
+
+/*!
+    Loads GPX data from \a device. gzip and zstd compressed data is detected
+    and decompressed while it is scanned.
+*/
 bool loadGPX(SampleData *sampleData, QIODevice *device)
 {
+    const CompressedDevice::Format format = CompressedDevice::detectFormat(device->peek(4));
+    if (format != CompressedDevice::Uncompressed)
+        return loadCompressedGPX(sampleData, device, format);
     GpxStreamReader reader(device);
     return reader.read(sampleData);
 }
 
-bool saveGPX(const SampleData &sampleData, QIODevice *device)
+/*!
+    Loads the GPX file \a fileName into \a sampleData.
+    The file is memory mapped and scanned in place, which is much faster than
+    going through QXmlStreamReader for large tracks.
+
+    Large files are split into chunks that are parsed on up to \a threadCount
+    threads from the global thread pool.
+
+    gzip and zstd compressed files are detected by their magic number and
+    decompressed on a separate thread while they are scanned.
+*/
+bool loadGPX(SampleData *sampleData, const QString &fileName, int threadCount)
 {
-    if (sampleData.isEmpty()) {
-        qWarning("Data contains no samples");
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning("Failed to open '%s'", qPrintable(fileName));
         return false;
     }
-    QTextStream stream(device);
-    stream.setCodec("UTF-8");
-
-    const GpsSample &sample = sampleData.first();
-    QDateTime dt;
-    dt.setMSecsSinceEpoch(sample.time);
-    const QString strDateTime = dt.toString(QLatin1String("dd/MM/yyyy hh:mm:ss"));
-
-    stream.setRealNumberNotation(QTextStream::FixedNotation);
-    stream << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
-    stream << "<gpx xsi:schemaLocation=\"http://www.topografix.com/GPX/1/1"
-             " http://www.topografix.com/GPX/1/1/gpx.xsd"
-             " http://www.garmin.com/xmlschemas/GpxExtensions/v3"
-             " http://www.garmin.com/xmlschemas/GpxExtensionsv3.xsd"
-             " http://www.garmin.com/xmlschemas/TrackPointExtension/v1"
-             " http://www.garmin.com/xmlschemas/TrackPointExtensionv1.xsd\""
-           " version=\"1.1\""
-           " creator=\"HrmGpx\""
-           " xmlns=\"http://www.topografix.com/GPX/1/1\""
-           " xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\""
-           " xmlns:gpxtpx=\"http://www.garmin.com/xmlschemas/TrackPointExtension/v1\""
-           " xmlns:gpxx=\"http://www.garmin.com/xmlschemas/GpxExtensions/v3\">\n";
-    stream << "  <metadata>\n";
-    // In case the name contains the time, replace it with the new time
-    // This is how www.sports-tracker.com does it.
-    // 27/05/2013/15:24:01.000
-    QRegularExpression re(QStringLiteral("\\d\\d/\\d\\d/\\d{4}/\\d\\d:\\d\\d:\\d\\d\\.\\d+$"));
-    const GpsSample first = sampleData.first();
-    QString name = sampleData.metaData.name;
-    QString strTime = msToDateTimeStringHuman(first.time);
-    name.replace(re, strTime);
-    stream << "    <name>" << name << "</name>\n";
-    stream << "    <desc>" << sampleData.metaData.description << "</desc>\n";
-    stream << "    <author>\n";
-    stream << "      <name>Jan Arve S\xe6ther</name>\n";    //&aelig;
-    stream << "    </author>\n";
-    stream << "    <link href=\"sjarve@gmail.com\">\n";
-    stream << "      <text>HrmGpx</text>\n";
-    stream << "    </link>\n";
-    stream << "  </metadata>\n";
-    stream << "  <trk>\n";
-    stream << "      <trkseg>\n";
-
-    Q_FOREACH (const GpsSample &sample, sampleData) {
-        stream.setRealNumberPrecision(15);
-        stream << "        <trkpt lat=\"" << sample.lat << "\" lon=\"" << sample.lon << "\">\n";
-        stream.setRealNumberPrecision(1);
-        stream << "          <ele>" << sample.ele << "</ele>\n";
-        stream << "          <time>" << msToDateTimeString(sample.time) << "</time>\n";
-        stream << "          <!--speed>" << sample.speed << "</speed-->\n";
-        stream << "          <extensions><gpxtpx:TrackPointExtension><gpxtpx:hr>"
-                                << sample.hr
-                                << "</gpxtpx:hr></gpxtpx:TrackPointExtension></extensions>\n";
-        stream << "        </trkpt>\n";
-    }
-
-    stream << "    </trkseg>\n";
-    stream << "  </trk>\n";
-    stream << "</gpx>\n";
-    return true;
+    const CompressedDevice::Format format = CompressedDevice::detectFormat(file.peek(4));
+    if (format != CompressedDevice::Uncompressed)
+        return loadCompressedGPX(sampleData, &file, format);
+
+    const qint64 size = file.size();
+    const char *data = reinterpret_cast<const char *>(size > 0 ? file.map(0, size) : 0);
+    QByteArray contents;
+    if (!data) {
+        // Not mappable (e.g. a pipe or an empty file), read it instead
+        contents = file.readAll();
+        data = contents.constData();
+    }
+    return scanGPX(sampleData, data, data + (contents.isNull() ? size : contents.size()), threadCount);
+}
+
+/*!
+    Writes \a sampleData as GPX to \a device, see GpxWriter.
+*/
+bool saveGPX(const SampleData &sampleData, QIODevice *device, GpxWriter::Mode mode)
+{
+    return GpxWriter(mode).write(sampleData, device);
 }
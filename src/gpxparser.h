@@ -5,8 +5,10 @@
 #include <QtCore/QVector>
 #include <QtCore/QXmlStreamReader>
 #include "gpssample.h"
+#include "gpxwriter.h"
 
 bool loadGPX(SampleData *sampleData, QIODevice *device);
-bool saveGPX(const SampleData &sampleData, QIODevice *device);
+bool loadGPX(SampleData *sampleData, const QString &fileName, int threadCount = 1);
+bool saveGPX(const SampleData &sampleData, QIODevice *device, GpxWriter::Mode mode = GpxWriter::Standard);
 
 #endif // GPXPARSER_H
@@ -0,0 +1,440 @@
+#include "gpxwriter.h"
+#include <QtCore/qbuffer.h>
+#include <QtCore/qfiledevice.h>
+#include <QtCore/qregularexpression.h>
+#include <QtCore/qthreadpool.h>
+#include <QtCore/qvarlengtharray.h>
+#include <QtConcurrent/qtconcurrentmap.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef Q_OS_UNIX
+# include <errno.h>
+# include <limits.h>
+# include <sys/uio.h>
+#endif
+
+namespace {
+
+// Upper bound for one formatted trackpoint, including the slow path of
+// formatFixed() for huge values
+enum { MaxTrackpointSize = 2048 };
+
+/*
+    Accumulates output in a fixed buffer and writes it to the device when it
+    is full. Callers ensure() room for what they append through pos.
+*/
+class OutputBuffer {
+public:
+    explicit OutputBuffer(QIODevice *device)
+        : m_device(device), m_ok(true)
+    {
+        m_data.resize(GpxWriter::BlockSize + MaxTrackpointSize);
+        pos = m_data.data();
+    }
+
+    void ensure(int size)
+    {
+        if (pos + size > m_data.constData() + m_data.size())
+            flush();
+    }
+
+    void append(const char *str, int length)
+    {
+        while (length > 0) {
+            ensure(1);
+            const int chunk = qMin(length, int(m_data.constData() + m_data.size() - pos));
+            memcpy(pos, str, chunk);
+            pos += chunk;
+            str += chunk;
+            length -= chunk;
+        }
+    }
+
+    template <int N>
+    void append(const char (&literal)[N]) { append(literal, N - 1); }
+
+    void append(const QByteArray &data) { append(data.constData(), data.size()); }
+
+    bool flush()
+    {
+        const qint64 size = pos - m_data.constData();
+        if (size && m_ok)
+            m_ok = m_device->write(m_data.constData(), size) == size;
+        pos = m_data.data();
+        return m_ok;
+    }
+
+    char *pos;
+
+private:
+    QIODevice *m_device;
+    QByteArray m_data;
+    bool m_ok;
+};
+
+template <int N>
+inline char *appendLiteral(char *out, const char (&literal)[N])
+{
+    memcpy(out, literal, N - 1);
+    return out + N - 1;
+}
+
+inline char *formatUnsigned(char *out, quint64 value, int minimumDigits = 1)
+{
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = char('0' + value % 10);
+        value /= 10;
+    } while (value);
+    while (n < minimumDigits)
+        digits[n++] = '0';
+    while (n)
+        *out++ = digits[--n];
+    return out;
+}
+
+inline char *formatInt(char *out, int value)
+{
+    if (value < 0) {
+        *out++ = '-';
+        return formatUnsigned(out, quint64(-qint64(value)));
+    }
+    return formatUnsigned(out, quint64(value));
+}
+
+// Computes the 128 bit product of \a a and \a b as \a high and \a low halves
+inline void multiply128(quint64 a, quint64 b, quint64 *high, quint64 *low)
+{
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 product = (unsigned __int128)a * b;
+    *high = quint64(product >> 64);
+    *low = quint64(product);
+#else
+    const quint64 aLow = a & 0xffffffff, aHigh = a >> 32;
+    const quint64 bLow = b & 0xffffffff, bHigh = b >> 32;
+    const quint64 lowLow = aLow * bLow;
+    const quint64 lowHigh = aLow * bHigh;
+    const quint64 highLow = aHigh * bLow;
+    const quint64 middle = (lowLow >> 32) + (lowHigh & 0xffffffff) + (highLow & 0xffffffff);
+    *low = (middle << 32) | (lowLow & 0xffffffff);
+    *high = aHigh * bHigh + (lowHigh >> 32) + (highLow >> 32) + (middle >> 32);
+#endif
+}
+
+// The low 64 bits of high:low >> shift, for shift in [0, 128)
+inline quint64 shiftRight128(quint64 high, quint64 low, int shift)
+{
+    if (shift == 0)
+        return low;
+    if (shift >= 64)
+        return high >> (shift - 64);
+    return (low >> shift) | (high << (64 - shift));
+}
+
+/*
+    formatFixed() for values of at least 100, which have at most 46 binary
+    digits after the point, so printing 64 decimals is exact. Rounding the
+    exact digits half away from zero only needs the first dropped digit.
+*/
+char *formatLarge(char *out, double value, int decimals)
+{
+    char digits[400];           // up to 309 digits before the point
+    char *point = digits + sprintf(digits, "%.64f", fabs(value)) - 65;
+    char *end = decimals ? point + 1 + decimals : point;
+    if (point[decimals + 1] >= '5') {
+        char *p = end - 1;
+        for (; p >= digits; --p) {
+            if (*p == '.')
+                continue;
+            if (*p != '9') {
+                ++*p;
+                break;
+            }
+            *p = '0';
+        }
+        if (p < digits) {
+            memmove(digits + 1, digits, end - digits);
+            digits[0] = '1';
+            ++end;
+        }
+    }
+    if (value < 0)
+        *out++ = '-';
+    memcpy(out, digits, end - digits);
+    return out + (end - digits);
+}
+
+/*
+    Formats \a value with \a decimals digits after the point, like
+    QTextStream::FixedNotation does: the exact binary value is rounded half
+    away from zero, and there is no minus sign if all printed digits are zero.
+
+    The value is scaled exactly in 128 bit arithmetic. Values too large for
+    that are printed with sprintf() with enough digits to be exact, and those
+    digits are rounded instead.
+*/
+char *formatFixed(char *out, double value, int decimals)
+{
+    static const quint64 powersOf10[] = {
+        1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+        100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+        10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+        100000000000000000ull
+    };
+    Q_ASSERT(decimals >= 0 && decimals <= 17);
+
+    if (qIsNaN(value))
+        return appendLiteral(out, "nan");
+    if (qIsInf(value))
+        return value < 0 ? appendLiteral(out, "-inf") : appendLiteral(out, "inf");
+
+    const quint64 scale = powersOf10[decimals];
+    const double magnitude = fabs(value);
+    if (magnitude * scale >= 1e19)
+        return formatLarge(out, value, decimals);
+
+    // magnitude == mantissa * 2^-shift
+    quint64 bits;
+    memcpy(&bits, &magnitude, sizeof(bits));
+    const int biasedExponent = int(bits >> 52);
+    quint64 mantissa = bits & ((1ull << 52) - 1);
+    int shift = 1074;
+    if (biasedExponent) {
+        mantissa |= 1ull << 52;
+        shift = 1075 - biasedExponent;
+    }
+
+    quint64 scaled = 0;
+    if (shift <= 0) {
+        scaled = (mantissa * scale) << -shift;
+    } else if (shift < 128) {
+        quint64 high, low;
+        multiply128(mantissa, scale, &high, &low);
+        scaled = shiftRight128(high, low, shift);
+        if (shiftRight128(high, low, shift - 1) & 1)
+            ++scaled;
+    }
+
+    if (scaled && value < 0)
+        *out++ = '-';
+    out = formatUnsigned(out, scaled / scale);
+    if (decimals) {
+        *out++ = '.';
+        out = formatUnsigned(out, scaled % scale, decimals);
+    }
+    return out;
+}
+
+char *formatTrackpoint(char *out, const GpsSample &sample, bool writeSpeed, TimestampFormatter &timestamps)
+{
+    out = appendLiteral(out, "        <trkpt lat=\"");
+    out = formatFixed(out, sample.lat, 15);
+    out = appendLiteral(out, "\" lon=\"");
+    out = formatFixed(out, sample.lon, 15);
+    out = appendLiteral(out, "\">\n          <ele>");
+    out = formatFixed(out, sample.ele, 1);
+    out = appendLiteral(out, "</ele>\n          <time>");
+    out = timestamps.format(sample.time, out);
+    out = appendLiteral(out, "</time>\n");
+    if (writeSpeed) {
+        out = appendLiteral(out, "          <!--speed>");
+        out = formatFixed(out, sample.speed, 1);
+        out = appendLiteral(out, "</speed-->\n");
+    }
+    out = appendLiteral(out, "          <extensions><gpxtpx:TrackPointExtension><gpxtpx:hr>");
+    out = formatInt(out, sample.hr);
+    return appendLiteral(out, "</gpxtpx:hr></gpxtpx:TrackPointExtension></extensions>\n"
+                              "        </trkpt>\n");
+}
+
+struct TrackpointChunk
+{
+    TrackpointChunk() : samples(0), count(0), writeSpeed(false), timeSpec(TimestampFormatter::LocalTime) {}
+    const GpsSample *samples;
+    int count;
+    bool writeSpeed;
+    TimestampFormatter::TimeSpec timeSpec;
+    QByteArray data;
+};
+
+void formatChunk(TrackpointChunk &chunk)
+{
+    enum { TypicalTrackpointSize = 256 };
+    TimestampFormatter timestamps(chunk.timeSpec);
+    chunk.data.resize(chunk.count * TypicalTrackpointSize + MaxTrackpointSize);
+    char *out = chunk.data.data();
+    for (int i = 0; i < chunk.count; ++i) {
+        if (chunk.data.constData() + chunk.data.size() - out < MaxTrackpointSize) {
+            const int size = out - chunk.data.constData();
+            chunk.data.resize(chunk.data.size() * 2);
+            out = chunk.data.data() + size;
+        }
+        out = formatTrackpoint(out, chunk.samples[i], chunk.writeSpeed, timestamps);
+    }
+    chunk.data.resize(out - chunk.data.constData());
+}
+
+/*
+    Writes \a parts to \a device in order. Files are written with writev()
+    directly on the file descriptor, other devices with one write() per part.
+*/
+bool writeParts(QIODevice *device, const QVector<QByteArray> &parts)
+{
+#ifdef Q_OS_UNIX
+    QFileDevice *file = qobject_cast<QFileDevice *>(device);
+    if (file && file->handle() != -1 && !file->isTextModeEnabled()
+        && !(file->openMode() & QIODevice::Append) && file->flush()) {
+        QVarLengthArray<iovec, 64> vectors(parts.count());
+        qint64 total = 0;
+        for (int i = 0; i < parts.count(); ++i) {
+            vectors[i].iov_base = const_cast<char *>(parts.at(i).constData());
+            vectors[i].iov_len = parts.at(i).size();
+            total += parts.at(i).size();
+        }
+
+        int index = 0;
+        while (index < vectors.count()) {
+            const ssize_t written = ::writev(file->handle(), vectors.data() + index,
+                                             qMin(vectors.count() - index, int(IOV_MAX)));
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            size_t remaining = written;
+            while (index < vectors.count() && remaining >= vectors[index].iov_len)
+                remaining -= vectors[index++].iov_len;
+            if (index < vectors.count()) {
+                vectors[index].iov_base = static_cast<char *>(vectors[index].iov_base) + remaining;
+                vectors[index].iov_len -= remaining;
+            }
+        }
+        // Bring the position of the QFileDevice in sync with the descriptor
+        return file->seek(file->pos() + total);
+    }
+#endif
+    for (int i = 0; i < parts.count(); ++i) {
+        if (device->write(parts.at(i)) != parts.at(i).size())
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+/*!
+    Writes \a samples as a GPX document to \a device, which must be open for
+    writing. Returns false if there are no samples or the device fails.
+*/
+bool GpxWriter::write(const SampleData &samples, QIODevice *device) const
+{
+    if (samples.isEmpty()) {
+        qWarning("Data contains no samples");
+        return false;
+    }
+
+    // In case the name contains the time, replace it with the new time
+    // This is how www.sports-tracker.com does it.
+    // 27/05/2013/15:24:01.000
+    QRegularExpression re(QStringLiteral("\\d\\d/\\d\\d/\\d{4}/\\d\\d:\\d\\d:\\d\\d\\.\\d+$"));
+    QString name = samples.metaData.name;
+    name.replace(re, msToDateTimeStringHuman(samples.first().time));
+    QString description = samples.metaData.description;
+    if (m_mode == Standard) {
+        name = name.toHtmlEscaped();
+        description = description.toHtmlEscaped();
+    }
+
+    QByteArray header("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                      "<gpx xsi:schemaLocation=\"http://www.topografix.com/GPX/1/1"
+                      " http://www.topografix.com/GPX/1/1/gpx.xsd"
+                      " http://www.garmin.com/xmlschemas/GpxExtensions/v3"
+                      " http://www.garmin.com/xmlschemas/GpxExtensionsv3.xsd"
+                      " http://www.garmin.com/xmlschemas/TrackPointExtension/v1"
+                      " http://www.garmin.com/xmlschemas/TrackPointExtensionv1.xsd\""
+                      " version=\"1.1\""
+                      " creator=\"HrmGpx\""
+                      " xmlns=\"http://www.topografix.com/GPX/1/1\""
+                      " xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\""
+                      " xmlns:gpxtpx=\"http://www.garmin.com/xmlschemas/TrackPointExtension/v1\""
+                      " xmlns:gpxx=\"http://www.garmin.com/xmlschemas/GpxExtensions/v3\">\n"
+                      "  <metadata>\n"
+                      "    <name>");
+    header += name.toUtf8();
+    header += "</name>\n"
+              "    <desc>";
+    header += description.toUtf8();
+    header += "</desc>\n"
+              "    <author>\n"
+              "      <name>Jan Arve S\xc3\xa6ther</name>\n"
+              "    </author>\n"
+              "    <link href=\"sjarve@gmail.com\">\n"
+              "      <text>HrmGpx</text>\n"
+              "    </link>\n"
+              "  </metadata>\n"
+              "  <trk>\n"
+              "      <trkseg>\n";
+    static const char footer[] = "    </trkseg>\n"
+                                 "  </trk>\n"
+                                 "</gpx>\n";
+
+    const bool writeSpeed = m_mode == Compatible;
+    const int threadCount = QThreadPool::globalInstance()->maxThreadCount();
+    const int chunkCount = qMin(threadCount, samples.count() / MinimumChunkSize);
+    bool ok;
+    if (chunkCount > 1) {
+        // Format the trackpoints in parallel and write everything at once
+        QVector<TrackpointChunk> chunks(chunkCount);
+        const int chunkSize = (samples.count() + chunkCount - 1) / chunkCount;
+        for (int i = 0; i < chunkCount; ++i) {
+            TrackpointChunk &chunk = chunks[i];
+            chunk.samples = samples.constData() + i * chunkSize;
+            chunk.count = qMin(chunkSize, samples.count() - i * chunkSize);
+            chunk.writeSpeed = writeSpeed;
+            chunk.timeSpec = m_timeSpec;
+        }
+        QtConcurrent::blockingMap(chunks, formatChunk);
+
+        QVector<QByteArray> parts;
+        parts.reserve(chunkCount + 2);
+        parts.append(header);
+        for (int i = 0; i < chunkCount; ++i)
+            parts.append(chunks.at(i).data);
+        parts.append(QByteArray::fromRawData(footer, sizeof(footer) - 1));
+        ok = writeParts(device, parts);
+    } else {
+        OutputBuffer buffer(device);
+        buffer.append(header);
+        TimestampFormatter timestamps(m_timeSpec);
+        const GpsSample *sample = samples.constData();
+        const GpsSample *end = sample + samples.count();
+        for (; sample != end; ++sample) {
+            buffer.ensure(MaxTrackpointSize);
+            buffer.pos = formatTrackpoint(buffer.pos, *sample, writeSpeed, timestamps);
+        }
+        buffer.append(footer);
+        ok = buffer.flush();
+    }
+
+    if (!ok) {
+        qWarning("Failed to write GPX data: %s", qPrintable(device->errorString()));
+        return false;
+    }
+    return true;
+}
+
+/*!
+    Returns \a samples as a GPX document.
+*/
+QByteArray GpxWriter::toByteArray(const SampleData &samples) const
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    write(samples, &buffer);
+    return data;
+}
@@ -0,0 +1,52 @@
+#ifndef GPXWRITER_H
+#define GPXWRITER_H
+
+#include <QtCore/qbytearray.h>
+#include "gpssample.h"
+#include "timestampformatter.h"
+
+class QIODevice;
+
+/*
+    Writes SampleData as GPX 1.1, with HR in the Garmin TrackPointExtension.
+
+    The document is formatted directly into a UTF-8 byte buffer that is handed
+    to the device in blocks of BlockSize bytes. Tracks of at least two
+    MinimumChunkSize chunks are formatted in parallel on the global thread
+    pool, one buffer per chunk, and written with a single gathered write.
+
+    Numbers are formatted with the fixed precision and rounding of
+    QTextStream::FixedNotation, so in Compatible mode the output is
+    byte-identical to the old QTextStream based writer.
+*/
+class GpxWriter {
+public:
+    enum {
+        BlockSize = 1 << 20,
+        MinimumChunkSize = 16 * 1024
+    };
+
+    enum Mode {
+        Standard,       // XML escaped name and description, no speed comment
+        Compatible      // byte-identical to the QTextStream based writer
+    };
+
+    explicit GpxWriter(Mode mode = Standard)
+        : m_mode(mode), m_timeSpec(TimestampFormatter::LocalTime)
+    {
+    }
+
+    void setMode(Mode mode) { m_mode = mode; }
+    Mode mode() const { return m_mode; }
+    void setTimeSpec(TimestampFormatter::TimeSpec spec) { m_timeSpec = spec; }
+    TimestampFormatter::TimeSpec timeSpec() const { return m_timeSpec; }
+
+    bool write(const SampleData &samples, QIODevice *device) const;
+    QByteArray toByteArray(const SampleData &samples) const;
+
+private:
+    Mode m_mode;
+    TimestampFormatter::TimeSpec m_timeSpec;
+};
+
+#endif // GPXWRITER_H
@@ -0,0 +1,66 @@
+# The sources shared by the hrmgpx application and the tests
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/gpxparser.cpp \
+    $$PWD/hrmparser.cpp \
+    $$PWD/gpssample.cpp \
+    $$PWD/geo.cpp \
+    $$PWD/iso8601.cpp \
+    $$PWD/numberparser.cpp \
+    $$PWD/samplecolumns.cpp \
+    $$PWD/compactsamplestore.cpp \
+    $$PWD/timeindex.cpp \
+    $$PWD/trackmerger.cpp \
+    $$PWD/samplestatistics.cpp \
+    $$PWD/activityanalytics.cpp \
+    $$PWD/outlierfilter.cpp \
+    $$PWD/routeindex.cpp \
+    $$PWD/clockalignment.cpp \
+    $$PWD/tracksimplifier.cpp \
+    $$PWD/resampler.cpp \
+    $$PWD/gpxwriter.cpp \
+    $$PWD/timestampformatter.cpp \
+    $$PWD/samplecache.cpp \
+    $$PWD/compresseddevice.cpp \
+    $$PWD/fitfile.cpp
+
+HEADERS += \
+    $$PWD/gpxparser.h \
+    $$PWD/hrmparser.h \
+    $$PWD/gpssample.h \
+    $$PWD/geo.h \
+    $$PWD/iso8601.h \
+    $$PWD/numberparser.h \
+    $$PWD/samplecolumns.h \
+    $$PWD/compactsamplestore.h \
+    $$PWD/timeindex.h \
+    $$PWD/trackmerger.h \
+    $$PWD/samplestatistics.h \
+    $$PWD/activityanalytics.h \
+    $$PWD/outlierfilter.h \
+    $$PWD/routeindex.h \
+    $$PWD/clockalignment.h \
+    $$PWD/tracksimplifier.h \
+    $$PWD/resampler.h \
+    $$PWD/gpxwriter.h \
+    $$PWD/timestampformatter.h \
+    $$PWD/samplecache.h \
+    $$PWD/compresseddevice.h \
+    $$PWD/fitfile.h
+
+packagesExist(zlib) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += zlib
+    DEFINES *= HAVE_ZLIB
+} else {
+    message("zlib not found, disabling gzip compressed GPX support")
+}
+
+packagesExist(libzstd) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libzstd
+    DEFINES *= HAVE_ZSTD
+} else {
+    message("zstd not found, disabling zstd compressed GPX support")
+}
@@ -1,4 +1,220 @@
 #include "hrmparser.h"
+#include "numberparser.h"
+
+#include <QtConcurrent/qtconcurrentmap.h>
+
+#include <string.h>
+
+/*
+    A line or column in the file, pointing directly into the file buffer.
+*/
+struct HrmToken
+{
+    HrmToken() : begin(0), end(0) {}
+    HrmToken(const char *b, const char *e) : begin(b), end(e) {}
+
+    bool isEmpty() const { return begin == end; }
+    int size() const { return end - begin; }
+    bool equals(const char *str, int length) const
+    {
+        return size() == length && memcmp(begin, str, length) == 0;
+    }
+    // Stores the remainder after \a prefix in \a value
+    bool startsWith(const char *prefix, int length, HrmToken *value) const
+    {
+        if (size() < length || memcmp(begin, prefix, length) != 0)
+            return false;
+        *value = HrmToken(begin + length, end);
+        return true;
+    }
+
+    const char *begin;
+    const char *end;
+};
+
+static inline bool isSpace(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '\v' || ch == '\f';
+}
+
+// Returns the next line with surrounding whitespace removed, like QIODevice::readLine().trimmed()
+static inline bool nextLine(const char **pos, const char *end, HrmToken *line)
+{
+    if (*pos == end)
+        return false;
+    const char *newline = static_cast<const char *>(memchr(*pos, '\n', end - *pos));
+    const char *b = *pos;
+    const char *e = newline ? newline : end;
+    *pos = newline ? newline + 1 : end;
+    while (b < e && isSpace(*b))
+        ++b;
+    while (e > b && isSpace(e[-1]))
+        --e;
+    *line = HrmToken(b, e);
+    return true;
+}
+
+// Returns the next tab separated column of \a line
+static inline HrmToken nextColumn(const char **pos, const char *end)
+{
+    const char *tab = static_cast<const char *>(memchr(*pos, '\t', end - *pos));
+    const HrmToken column(*pos, tab ? tab : end);
+    *pos = tab ? tab + 1 : end;
+    return column;
+}
+
+// Like QByteArray::toInt() and toFloat(), 0 if the column is not a number
+static inline int columnToInt(const HrmToken &column)
+{
+    int value = 0;
+    return parseInt(column.begin, column.end, &value) == column.end ? value : 0;
+}
+
+static inline float columnToFloat(const HrmToken &column)
+{
+    float value = 0;
+    return parseFloat(column.begin, column.end, &value) == column.end ? value : 0;
+}
+
+static inline bool readNumber(const char *p, int digits, int *value)
+{
+    int v = 0;
+    for (int i = 0; i < digits; ++i) {
+        if (unsigned(p[i] - '0') > 9)
+            return false;
+        v = v * 10 + (p[i] - '0');
+    }
+    *value = v;
+    return true;
+}
+
+/*
+    Parses "hh:mm:ss.f" into milliseconds, the fraction is optional
+*/
+static bool parseClockTime(const HrmToken &value, qint64 *msecs)
+{
+    int hour, minute, second;
+    if (value.size() < 8 || value.begin[2] != ':' || value.begin[5] != ':'
+        || !readNumber(value.begin, 2, &hour)
+        || !readNumber(value.begin + 3, 2, &minute)
+        || !readNumber(value.begin + 6, 2, &second)
+        || hour > 23 || minute > 59 || second > 59) {
+        return false;
+    }
+    const HrmToken fraction(value.begin + 8, value.end);
+    const int ms = qRound(columnToFloat(fraction) * 1000);
+    *msecs = (hour * 3600 + minute * 60 + second) * 1000 + qMax(ms, 0);
+    return true;
+}
+
+/*
+    [HRData] is normally the last section, otherwise it ends at the next line starting with '['
+*/
+static const char *findSectionEnd(const char *pos, const char *end)
+{
+    const char *lineStart = pos;
+    while (pos < end) {
+        const char *bracket = static_cast<const char *>(memchr(pos, '[', end - pos));
+        if (!bracket)
+            break;
+        if (bracket == lineStart || bracket[-1] == '\n')
+            return bracket;
+        pos = bracket + 1;
+    }
+    return end;
+}
+
+/*
+    A line aligned part of the [HRData] section. Rows are independent and evenly
+    spaced in time, so once the number of rows in each chunk is known, the chunks
+    can be decoded in parallel directly into their slots of the SampleData.
+*/
+struct HrmChunk
+{
+    HrmChunk() : begin(0), end(0), rows(0), lines(0), firstRow(0), samples(0), time(0), interval(0), reader(0) {}
+    const char *begin;
+    const char *end;
+    int rows;               // non-empty lines
+    int lines;
+    int firstRow;
+    GpsSample *samples;     // destination of the first row
+    qint64 time;            // time of the first row
+    qint64 interval;
+    const HRMReader *reader;
+};
+
+static void countRows(HrmChunk &chunk)
+{
+    const char *pos = chunk.begin;
+    HrmToken line;
+    while (nextLine(&pos, chunk.end, &line)) {
+        ++chunk.lines;
+        if (!line.isEmpty())
+            ++chunk.rows;
+    }
+}
+
+void HRMReader::decodeChunk(HrmChunk &chunk)
+{
+    const char *pos = chunk.begin;
+    HrmToken line;
+    GpsSample *sample = chunk.samples;
+    qint64 time = chunk.time;
+    while (nextLine(&pos, chunk.end, &line)) {
+        if (line.isEmpty())
+            continue;
+        sample->time = time;
+        chunk.reader->decodeRow(line, sample);
+        ++sample;
+        time += chunk.interval;
+    }
+}
+
+/*
+    Decodes the rows in [\a begin, \a end) into \a sampleData using the global
+    thread pool. \a time is the time of the first row, and is advanced past the
+    last one. Returns the number of lines read.
+*/
+int HRMReader::decodeParallel(const char *begin, const char *end, SampleData *sampleData, qint64 *time) const
+{
+    const int chunkCount = m_threadCount * 4;
+    const qint64 size = end - begin;
+    QVector<HrmChunk> chunks;
+    const char *chunkBegin = begin;
+    for (int i = 1; i <= chunkCount && chunkBegin < end; ++i) {
+        const char *chunkEnd = end;
+        if (i < chunkCount) {
+            chunkEnd = qMax(chunkBegin, begin + size * i / chunkCount);
+            const char *newline = static_cast<const char *>(memchr(chunkEnd, '\n', end - chunkEnd));
+            chunkEnd = newline ? newline + 1 : end;
+        }
+        HrmChunk chunk;
+        chunk.begin = chunkBegin;
+        chunk.end = chunkEnd;
+        chunk.interval = m_interval * 1000;
+        chunk.reader = this;
+        chunks.append(chunk);
+        chunkBegin = chunkEnd;
+    }
+    QtConcurrent::blockingMap(chunks, countRows);
+
+    int row = sampleData->count();
+    int lines = 0;
+    for (int i = 0; i < chunks.count(); ++i) {
+        HrmChunk &chunk = chunks[i];
+        chunk.time = *time;
+        *time += chunk.rows * chunk.interval;
+        chunk.firstRow = row;
+        row += chunk.rows;
+        lines += chunk.lines;
+    }
+    sampleData->resize(row);
+    GpsSample *samples = sampleData->data();
+    for (int i = 0; i < chunks.count(); ++i)
+        chunks[i].samples = samples + chunks.at(i).firstRow;
+    QtConcurrent::blockingMap(chunks, decodeChunk);
+    return lines;
+}
 
 qint64 HRMReader::startTime() const
 {
@@ -10,165 +226,163 @@ qint64 HRMReader::endTime() const
     return m_startTime + m_length;
 }
 
+void HRMReader::readParams(const HrmToken &line, SampleData *sampleData)
+{
+    HrmToken value;
+    if (line.startsWith("Interval=", 9, &value)) {
+        int interval;
+        if (parseInt(value.begin, value.end, &interval) == value.end)
+            m_interval = interval;
+    } else if (line.startsWith("Date=", 5, &value)) {
+        int year = 0, month = 0, day = 0;
+        if (value.size() == 8) {
+            readNumber(value.begin, 4, &year);
+            readNumber(value.begin + 4, 2, &month);
+            readNumber(value.begin + 6, 2, &day);
+        }
+        const QDate date(year, month, day);
+        if (!date.isValid()) {
+            error("Params.Date is invalid");
+        }
+        QDateTime dt(date);
+        m_startTime += dt.toMSecsSinceEpoch();
+    } else if (line.startsWith("StartTime=", 10, &value)) {
+        qint64 msecs;
+        if (parseClockTime(value, &msecs))
+            m_startTime += msecs;
+        else
+            error("Params.StartTime is invalid");
+    } else if (line.startsWith("Length=", 7, &value)) {
+        qint64 msecs;
+        if (parseClockTime(value, &msecs))
+            m_length = msecs;
+        else
+            error("Params.Length is invalid");
+    } else if (line.startsWith("SMode=", 6, &value) && value.size() >= 8) {
+        const char *ss = value.begin;
+        m_hasSpeed = (ss[0] == '1');
+        m_hasCadence = (ss[1] == '1');
+        m_hasAltitude = (ss[2] == '1');
+        //bool power = (ss[3] == '1');
+        // bool power_left_right_balance = (ss[4] == '1');
+        // bool power_pedalling_index = (ss[5] == '1');
+        if (ss[6] == '1') {
+            //0 = HR data only
+            //1 = HR + cycling data
+            sampleData->metaData.activity = SampleData::Cycling;
+        }
+        m_unitIsUS = (ss[7] == '1');    //0 = Euro (km, km/h, m, C)
+                                        //1 = US (miles, mph, ft, F)
+
+        //bool airpressure = (value.size() < 9 ? false : (ss[8] == '1'));  //i) Air pressure (0=off, 1=on) &
+        /*
+        bits: abcdefghi
+        Data type parameters
+
+        [version >= 1.06]
+        a) Speed (0=off, 1=on)
+        b) Cadence (0=off, 1=on)
+        c) Altitude (0=off, 1=on)
+        d) Power (0=off, 1=on)
+        e) Power Left Right Balance (0=off, 1=on)
+        f) Power Pedalling Index (0=off, 1=on)
+        g) HR/CC data
+
+        h) US / Euro unit
+        0 = Euro (km, km/h, m, C)
+        1 = US (miles, mph, ft, F)
+        All distance, speed, altitude and temperature values depend on US/Euro unit
+        selection (km / miles, km/h / mph, m / ft, C / F).
+
+        [version >= 1.07]
+        i) Air pressure (0=off, 1=on) &
+        */
+    }
+}
+
+/*
+    hrm spd [cad] alt
+    82  0         204
+    151 184       207
+*/
+void HRMReader::decodeRow(const HrmToken &line, GpsSample *sample) const
+{
+    const char *pos = line.begin;
+    sample->hr = columnToInt(nextColumn(&pos, line.end));
+    if (m_hasSpeed)
+        sample->speed = columnToFloat(nextColumn(&pos, line.end))/10.0;
+    if (m_hasCadence)
+        sample->cadence = columnToInt(nextColumn(&pos, line.end));
+    if (m_hasAltitude)
+        sample->ele = columnToFloat(nextColumn(&pos, line.end));
+}
+
 bool HRMReader::read(SampleData *sampleData)
 {
     QFile file(m_fileName);
-    if (file.open(QIODevice::ReadOnly)) {
-        bool speed = false;
-        bool cadence;
-        bool altitude = false;
-        //bool power;
-        // power left right balance
-        // power pedalling index
-        bool unitIsUS = false;
-        //bool airpressure;
-
-        m_lineNumber = 1;
-        m_startTime = 0;
-        qint64 time = -1;
-        do {
-            QByteArray line = file.readLine(1000).trimmed();
-            Section section;
-            if (line.count() > 0 && line.at(0) == '[') {
-                if (line == "[Params]") {
-                    section = Params;
-                } else if (line == "[HRData]") {
-                    time = m_startTime;
-                    section = HRData;
-                } else {
-                    section = None;
+    if (!file.open(QIODevice::ReadOnly)) {
+        error("Could not open hrm file");
+        return false;
+    }
+    const qint64 size = file.size();
+    const char *data = reinterpret_cast<const char *>(size > 0 ? file.map(0, size) : 0);
+    QByteArray contents;
+    if (!data) {
+        contents = file.readAll();
+        data = contents.constData();
+    }
+    const char *pos = data;
+    const char *end = data + (contents.isNull() ? size : contents.size());
+
+    m_hasSpeed = false;
+    m_hasCadence = false;
+    m_hasAltitude = false;
+    m_unitIsUS = false;
+    m_lineNumber = 1;
+    m_startTime = 0;
+    qint64 time = -1;
+    Section section = None;
+    HrmToken line;
+    for (; nextLine(&pos, end, &line); ++m_lineNumber) {
+        if (!line.isEmpty() && *line.begin == '[') {
+            if (line.equals("[Params]", 8)) {
+                section = Params;
+            } else if (line.equals("[HRData]", 8)) {
+                time = m_startTime;
+                section = HRData;
+                const char *sectionEnd = findSectionEnd(pos, end);
+                if (m_threadCount > 1 && sectionEnd - pos >= MinimumParallelSize) {
+                    m_lineNumber += decodeParallel(pos, sectionEnd, sampleData, &time);
+                    pos = sectionEnd;
+                } else if (m_interval > 0 && m_length > 0) {
+                    sampleData->reserve(sampleData->count() + m_length / (m_interval * 1000) + 2);
                 }
             } else {
-                switch (section) {
-                    case Params:
-                        if (line.indexOf("Interval=") == 0) {
-                            QByteArray ss = line.mid(9);
-                            bool ok;
-                            int interval = ss.toInt(&ok);
-                            if (ok)
-                                m_interval = interval;
-                        } else if (line.indexOf("Date=") == 0) {
-                            QByteArray ss = line.mid(5);
-                            QDate date = QDate::fromString(ss, QLatin1String("yyyyMMdd"));
-                            if (!date.isValid()) {
-                                error("Params.Date is invalid");
-                            }
-                            QDateTime dt(date);
-                            m_startTime += dt.toMSecsSinceEpoch();
-                        } else if (line.indexOf("StartTime=") == 0) {
-                            QByteArray ss = line.mid(10, 8);
-                            QTime time = QTime::fromString(ss, QLatin1String("hh:mm:ss"));
-                            if (time.isValid()) {
-                                ss = line.mid(18);  // ".79"
-                                float sec = ss.toFloat();
-                                int ms = qRound(sec * 1000);
-                                if (ms >= 0) {
-                                    QTime midnight(0,0);
-                                    int msecs = midnight.msecsTo(time) + ms;
-                                    m_startTime += msecs;
-                                }
-                            } else {
-                                error("Params.StartTime is invalid");
-                            }
-                        } else if (line.indexOf("Length=") == 0) {
-                            QByteArray ss = line.mid(7, 8);
-                            QTime time = QTime::fromString(ss, QLatin1String("hh:mm:ss"));
-                            if (time.isValid()) {
-                                ss = line.mid(15);
-                                float sec = ss.toFloat();
-                                int ms = qRound(sec * 1000);
-                                if (ms >= 0) {
-                                    QTime midnight(0,0);
-                                    int msecs = midnight.msecsTo(time) + ms;
-                                    m_length = msecs;
-                                }
-                            } else {
-                                error("Params.StartTime is invalid");
-                            }
-                        } else if (line.indexOf("SMode=") == 0) {
-                            QByteArray ss = line.mid(6);
-                            speed = (ss.at(0) == '1');
-                            cadence = (ss.at(1) == '1');
-                            altitude = (ss.at(2) == '1');
-                            //bool power = (ss.at(3) == '1');
-                            // bool power_left_right_balance = (ss.at(4) == '1');
-                            // bool power_pedalling_index = (ss.at(5) == '1');
-                            if (ss.at(6) == '1') {
-                                //0 = HR data only
-                                //1 = HR + cycling data
-                                sampleData->metaData.activity = SampleData::Cycling;
-                            }
-                            unitIsUS = (ss.at(7) == '1');  //0 = Euro (km, km/h, m, C)
-                                                            //1 = US (miles, mph, ft, F)
-
-                            //bool airpressure = (ss.count() < 8 ? false : (ss.at(8) == '1'));  //i) Air pressure (0=off, 1=on) &
-                            /*
-                            bits: abcdefghi
-                            Data type parameters
-
-                            [version >= 1.06]
-                            a) Speed (0=off, 1=on)
-                            b) Cadence (0=off, 1=on)
-                            c) Altitude (0=off, 1=on)
-                            d) Power (0=off, 1=on)
-                            e) Power Left Right Balance (0=off, 1=on)
-                            f) Power Pedalling Index (0=off, 1=on)
-                            g) HR/CC data
-
-                            h) US / Euro unit
-                            0 = Euro (km, km/h, m, C)
-                            1 = US (miles, mph, ft, F)
-                            All distance, speed, altitude and temperature values depend on US/Euro unit
-                            selection (km / miles, km/h / mph, m / ft, C / F).
-
-                            [version >= 1.07]
-                            i) Air pressure (0=off, 1=on) &
-                            */
-                        }
-                    break;
-                    case HRData: {
-                        if (line.count() > 0) {
-                            /*
-                            hrm spd [cad] alt
-                            82  0         204
-                            151 184       207
-                            */
-                            GpsSample sample;
-                            QList<QByteArray> list = line.split('\t');
-                            sample.time = time;
-                            int index = 0;
-                            sample.hr = list.at(index++).toInt();
-                            if (speed)
-                                sample.speed = list.at(index++).toFloat()/10.0;
-                            if (cadence)
-                                // ignored
-                                index++;
-                            if (altitude)
-                                sample.ele = list.at(index++).toFloat();
-                            sampleData->append(sample);
-                            time += m_interval * 1000;
-                        }
-                    break;}
-                    default:
-                    break;
-                }
+                section = None;
             }
-            ++m_lineNumber;
-        }  while (!file.atEnd());
-        
-        /* Since the HRM monitor will store data in fixed intervals, the last sample
-           will usually be before the monitor was stopped, thus if the Interval is 
-           60 seconds, it might be up to one minute off.
-           We then add another "sample" corresponding to the time the monitor was stopped.
-           This sample is just a copy of the previous one, but with time adjusted.
-        */
+        } else if (section == Params) {
+            readParams(line, sampleData);
+        } else if (section == HRData && !line.isEmpty()) {
+            GpsSample sample;
+            sample.time = time;
+            decodeRow(line, &sample);
+            sampleData->append(sample);
+            time += m_interval * 1000;
+        }
+    }
+
+    /* Since the HRM monitor will store data in fixed intervals, the last sample
+       will usually be before the monitor was stopped, thus if the Interval is 
+       60 seconds, it might be up to one minute off.
+       We then add another "sample" corresponding to the time the monitor was stopped.
+       This sample is just a copy of the previous one, but with time adjusted.
+    */
+    if (!sampleData->isEmpty()) {
         GpsSample sample = sampleData->last();
         if (sample.time < m_startTime + m_length) {
             sample.time = m_startTime + m_length;
             sampleData->append(sample);
         }
-    } else {
-        error("Could not open hrm file");
     }
     return true;
 }
@@ -10,6 +10,8 @@
 
 #include "gpssample.h"
 
+struct HrmToken;
+struct HrmChunk;
 
 class HRMReader {
 public:
@@ -20,12 +22,16 @@ public:
     };
 
     HRMReader(const QString &fileName)
-        : m_lineNumber(-1), m_startTime(-1), m_length(-1), m_interval(-1), m_isCyclingData(0)
+        : m_lineNumber(-1), m_startTime(-1), m_length(-1), m_interval(-1), m_isCyclingData(0),
+          m_hasSpeed(false), m_hasCadence(false), m_hasAltitude(false), m_unitIsUS(false), m_threadCount(1)
     {
         m_fileName = fileName;
     }
     bool read(SampleData *sampleData);
 
+    // Large [HRData] sections are decoded on up to \a threadCount threads
+    void setThreadCount(int threadCount) { m_threadCount = threadCount; }
+
     float startAltitude() const;
     float endAltitude() const;
     qint64 startTime() const;
@@ -61,14 +67,27 @@ public:
     }
 
     int interval() const { return m_interval;}    
+    bool hasAltitude() const { return m_hasAltitude; }
 
 private:
+    void readParams(const HrmToken &line, SampleData *sampleData);
+    void decodeRow(const HrmToken &line, GpsSample *sample) const;
+    int decodeParallel(const char *begin, const char *end, SampleData *sampleData, qint64 *time) const;
+    static void decodeChunk(HrmChunk &chunk);
+
+    enum { MinimumParallelSize = 256 * 1024 };
+
 public:
     int m_lineNumber;
     qint64 m_startTime;
     qint64 m_length;
     int m_interval;
     bool m_isCyclingData;
+    bool m_hasSpeed;
+    bool m_hasCadence;
+    bool m_hasAltitude;
+    bool m_unitIsUS;
+    int m_threadCount;
     QTime m_time;
     QString m_fileName;
 };
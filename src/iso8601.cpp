@@ -0,0 +1,156 @@
+#include "iso8601.h"
+#include <QtCore/qdatetime.h>
+
+/*
+    Days since 1970-01-01 in the proleptic Gregorian calendar.
+    From http://howardhinnant.github.io/date_algorithms.html
+*/
+qint64 daysFromCivil(int year, int month, int day)
+{
+    year -= month <= 2;
+    const qint64 era = (year >= 0 ? year : year - 399) / 400;
+    const int yearOfEra = year - era * 400;                                         // [0, 399]
+    const int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1; // [0, 365]
+    const int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+/*
+    The inverse of daysFromCivil(), from the same source.
+*/
+void civilFromDays(qint64 days, int *year, int *month, int *day)
+{
+    days += 719468;
+    const qint64 era = (days >= 0 ? days : days - 146096) / 146097;
+    const int dayOfEra = int(days - era * 146097);                                            // [0, 146096]
+    const int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365; // [0, 399]
+    const int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);      // [0, 365]
+    const int mp = (5 * dayOfYear + 2) / 153;                                                 // [0, 11]
+    *day = dayOfYear - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = int(yearOfEra + era * 400) + (*month <= 2);
+}
+
+static inline bool isLeapYear(int year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static inline int daysInMonth(int year, int month)
+{
+    static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    return (month == 2 && isLeapYear(year)) ? 29 : days[month - 1];
+}
+
+// Reads exactly \a count digits
+static inline bool readDigits(const char *&p, const char *end, int count, int *value)
+{
+    if (end - p < count)
+        return false;
+    int v = 0;
+    for (int i = 0; i < count; ++i) {
+        const unsigned digit = unsigned(p[i] - '0');
+        if (digit > 9)
+            return false;
+        v = v * 10 + digit;
+    }
+    p += count;
+    *value = v;
+    return true;
+}
+
+static inline bool expect(const char *&p, const char *end, char ch)
+{
+    if (p == end || *p != ch)
+        return false;
+    ++p;
+    return true;
+}
+
+/*!
+    Parses an ISO 8601 timestamp of the form yyyy-MM-ddThh:mm:ss(.f*)(Z|+hh:mm|-hh:mm)
+    from the range [\a begin, \a end) and stores the number of milliseconds since
+    1970-01-01T00:00:00Z in \a msecsSinceEpoch.
+
+    Any number of fractional digits is accepted; the fraction is rounded to the
+    nearest millisecond. Timestamps with a UTC designator or an offset are converted
+    without any allocation. Timestamps without either are in local time, as with
+    QDateTime::fromString(), and are converted through QDateTime.
+
+    Returns false if the range is not a valid timestamp.
+*/
+bool parseIsoDateTime(const char *begin, const char *end, qint64 *msecsSinceEpoch)
+{
+    const char *p = begin;
+    int year, month, day, hour, minute, second;
+    if (!(readDigits(p, end, 4, &year) && expect(p, end, '-')
+          && readDigits(p, end, 2, &month) && expect(p, end, '-')
+          && readDigits(p, end, 2, &day) && expect(p, end, 'T')
+          && readDigits(p, end, 2, &hour) && expect(p, end, ':')
+          && readDigits(p, end, 2, &minute) && expect(p, end, ':')
+          && readDigits(p, end, 2, &second))) {
+        return false;
+    }
+
+    int msecs = 0;
+    if (p != end && (*p == '.' || *p == ',')) {
+        ++p;
+        const char *fraction = p;
+        static const int scale[] = {100, 10, 1};
+        while (p != end && unsigned(*p - '0') <= 9) {
+            const int digits = p - fraction;
+            if (digits < 3)
+                msecs += (*p - '0') * scale[digits];
+            else if (digits == 3 && *p >= '5')
+                ++msecs;   // round to nearest, 999.5 becomes the next second
+            ++p;
+        }
+        if (p == fraction)
+            return false;
+    }
+
+    if (month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month)
+        || minute > 59 || second > 59
+        || (hour > 23 && !(hour == 24 && minute == 0 && second == 0 && msecs == 0))) {
+        return false;
+    }
+
+    const qint64 days = daysFromCivil(year, month, day);
+    const qint64 secs = days * 86400 + hour * 3600 + minute * 60 + second;
+
+    if (p != end && *p == 'Z' && p + 1 == end) {
+        // Fast path, UTC
+        *msecsSinceEpoch = secs * 1000 + msecs;
+        return true;
+    }
+
+    if (p == end) {
+        // No designator, local time
+        QDate date(year, month, day);
+        if (hour == 24) {
+            date = date.addDays(1);
+            hour = 0;
+        }
+        const QDateTime dt(date, QTime(hour, minute, second));
+        if (!dt.isValid())
+            return false;
+        *msecsSinceEpoch = dt.toMSecsSinceEpoch() + msecs;
+        return true;
+    }
+
+    if (*p != '+' && *p != '-')
+        return false;
+    const int sign = (*p++ == '-') ? -1 : 1;
+    int offsetHours, offsetMinutes = 0;
+    if (!readDigits(p, end, 2, &offsetHours))
+        return false;
+    if (p != end) {
+        expect(p, end, ':');
+        if (!readDigits(p, end, 2, &offsetMinutes) || p != end)
+            return false;
+    }
+    if (offsetHours > 23 || offsetMinutes > 59)
+        return false;
+    *msecsSinceEpoch = (secs - sign * (offsetHours * 3600 + offsetMinutes * 60)) * 1000 + msecs;
+    return true;
+}
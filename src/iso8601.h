@@ -0,0 +1,10 @@
+#ifndef ISO8601_H
+#define ISO8601_H
+
+#include <QtCore/qglobal.h>
+
+bool parseIsoDateTime(const char *begin, const char *end, qint64 *msecsSinceEpoch);
+qint64 daysFromCivil(int year, int month, int day);
+void civilFromDays(qint64 days, int *year, int *month, int *day);
+
+#endif // ISO8601_H
@@ -4,9 +4,18 @@
 #include <stdio.h>
 
 #include "gpxparser.h"
+#include "gpxwriter.h"
 #include "hrmparser.h"
-#include "geolocationiterator.h"
-#include "geolocationinterpolator.h"
+#include "routeindex.h"
+#include "samplecache.h"
+#include "clockalignment.h"
+#include "compresseddevice.h"
+#include "fitfile.h"
+#include "tracksimplifier.h"
+#include "resampler.h"
+#include "trackmerger.h"
+#include "activityanalytics.h"
+#include "geo.h"
 
 #include <float.h>
 
@@ -24,102 +33,194 @@ void usage()
 #endif
            " --error-correction             Try to detect errors and correct them\n"
            " --ignore-gpx-timestamps        Use HRM speeds to create trackpoints in a route\n"
+           " --interpolate-hr               Interpolate HR and speed between HRM samples\n"
+           " --auto-align                   Find the offset and drift of the HRM clock from the GPX data\n"
            " --altitude <start>[:<end>]     Adjust altitude to <start>, <end> or both\n"
+           " --compatible-output            Write the GPX exactly like older versions did\n"
+           " --cache                        Keep parsed input files in a binary cache next to them\n"
+           " --compress <gzip|zstd>         Compress the merged GPX file\n"
+           " --fit                          Write the merged track as a FIT activity instead of GPX\n"
+           " --utc                          Write GPX timestamps in UTC\n"
+           " --resample <s>                 Resample the merged track to one trackpoint every <s> seconds\n"
+           " --resample-gap <s>             Do not resample across gaps longer than <s> seconds (default: from the input)\n"
+           " --simplify <m>[:dp|vw]         Drop trackpoints within <m> meters of the simplified track\n"
+           " --max-hr <hr>                  Maximum HR, used for time in HR zone\n"
+           " --distance-model <model>       haversine, equirectangular or enu\n"
+           " --jobs <n>                     Number of threads used for large files (default: all cores)\n"
            );
 }
 
 
-int mergeTracks(const QString &hrmFile, const QString &gpxFilename, bool errorCorrection = false, bool ignoreGpxTimestamps = false,
-                float startAltitude = -FLT_MAX, float endAltitude = -FLT_MAX)
+struct MergeOptions {
+    MergeOptions()
+        : errorCorrection(false), ignoreGpxTimestamps(false), interpolateHR(false), autoAlign(false), useCache(false), fitOutput(false),
+          maximumHR(0), resampleInterval(0), resampleMaximumGap(0), simplifyTolerance(0), simplifyMethod(TrackSimplifier::DouglasPeucker), startAltitude(-FLT_MAX), endAltitude(-FLT_MAX),
+          gpxMode(GpxWriter::Standard), timeSpec(TimestampFormatter::LocalTime),
+          compression(CompressedDevice::Uncompressed)
+    {
+    }
+    bool errorCorrection;
+    bool ignoreGpxTimestamps;
+    bool interpolateHR;
+    bool autoAlign;
+    bool useCache;
+    bool fitOutput;
+    int maximumHR;
+    qint64 resampleInterval;
+    qint64 resampleMaximumGap;
+    double simplifyTolerance;
+    TrackSimplifier::Method simplifyMethod;
+    float startAltitude;
+    float endAltitude;
+    GpxWriter::Mode gpxMode;
+    TimestampFormatter::TimeSpec timeSpec;
+    CompressedDevice::Format compression;
+};
+
+static bool readGPX(const QString &gpxFilename, bool useCache, SampleData *samples)
+{
+    SampleCacheInfo info;
+    if (useCache && loadCachedSamples(samples, &info, gpxFilename))
+        return true;
+    if (gpxFilename.endsWith(QLatin1String(".fit"), Qt::CaseInsensitive)) {
+        if (!loadFIT(samples, gpxFilename))
+            return false;
+    } else if (!loadGPX(samples, gpxFilename, QThreadPool::globalInstance()->maxThreadCount())) {
+        return false;
+    }
+    if (useCache)
+        saveCachedSamples(*samples, info, gpxFilename);
+    return true;
+}
+
+static bool readHRM(const QString &hrmFile, bool useCache, SampleData *samples, SampleCacheInfo *info)
+{
+    if (useCache && loadCachedSamples(samples, info, hrmFile))
+        return true;
+    HRMReader hrmReader(hrmFile);
+    hrmReader.setThreadCount(QThreadPool::globalInstance()->maxThreadCount());
+    const bool ok = hrmReader.read(samples);
+    info->startTime = hrmReader.startTime();
+    info->endTime = hrmReader.endTime();
+    info->interval = hrmReader.interval();
+    info->flags = hrmReader.hasAltitude() ? SampleCacheInfo::HasAltitude : 0;
+    if (ok && useCache)
+        saveCachedSamples(*samples, *info, hrmFile);
+    return ok;
+}
+
+int mergeTracks(const QString &hrmFile, const QString &gpxFilename, const MergeOptions &options)
 {
     SampleData gpxSampleData;
     if (!gpxFilename.isNull()) {
-        QFile gpxFile(gpxFilename);
-        if (gpxFile.open(QIODevice::ReadOnly)) {
+        if (QFile::exists(gpxFilename)) {
             printf("Analyzing GPX file: %s\n", qPrintable(gpxFilename));
-            if (!loadGPX(&gpxSampleData, &gpxFile))
+            if (!readGPX(gpxFilename, options.useCache, &gpxSampleData))
                 return -1;
             gpxSampleData.print();
         }
-        gpxFile.close();
     }
     printf("Analyzing HRM file: %s\n", qPrintable(hrmFile));
     SampleData hrmSampleData;
-
-    HRMReader hrmReader(hrmFile);
-    if (hrmReader.read(&hrmSampleData)) {
+    SampleCacheInfo hrmInfo;
+    if (readHRM(hrmFile, options.useCache, &hrmSampleData, &hrmInfo)) {
         hrmSampleData.print();
-        printf("Interval:       %d\n", hrmReader.interval());
+        printf("Interval:       %d\n", hrmInfo.interval);
         printf("Samples:        %d\n", hrmSampleData.count());
     }
 
-    if (startAltitude != -FLT_MAX || endAltitude != -FLT_MAX)
-        hrmSampleData.correctAltitudes(startAltitude, endAltitude);
+    if (options.startAltitude != -FLT_MAX || options.endAltitude != -FLT_MAX)
+        hrmSampleData.correctAltitudes(options.startAltitude, options.endAltitude);
 
     SampleData mergedSamples;
 
     if (gpxSampleData.isEmpty()) {
         mergedSamples = hrmSampleData;
     } else {
-        mergedSamples.metaData.activity = hrmSampleData.metaData.activity;
-        mergedSamples.metaData.name = gpxSampleData.metaData.name;
-        mergedSamples.metaData.description = gpxSampleData.metaData.description;
-        qint64 hrmStartTime = hrmReader.startTime();
-        qint64 hrmEndTime = hrmReader.endTime();
-        if (ignoreGpxTimestamps) {
-            GeoLocationIterator gpxIter(&gpxSampleData);
-            GeoLocationInterpolator interpolator(gpxIter);
-            for (int i = 0; i < hrmSampleData.count(); ++i) {
-                GpsSample &hrmSample = hrmSampleData[i];
+        qint64 hrmStartTime = hrmInfo.startTime;
+        qint64 hrmEndTime = hrmInfo.endTime;
+        if (options.autoAlign && !options.ignoreGpxTimestamps) {
+            ClockAlignment alignment;
+            alignment.setUseAltitude(hrmInfo.flags & SampleCacheInfo::HasAltitude);
+            alignment.setEstimateDrift(true);
+            if (alignment.align(hrmSampleData, gpxSampleData)) {
+                printf("Clock offset:   %+.1f s (drift %+.2f s/h, correlation %.2f)\n",
+                       alignment.offset() / 1000.0, alignment.drift() * 3600.0, alignment.score());
+                hrmStartTime += alignment.offsetAt(hrmStartTime);
+                hrmEndTime += alignment.offsetAt(hrmEndTime);
+                alignment.apply(&hrmSampleData);
+            } else {
+                printf("Clock offset:   not found, using the HRM clock\n");
+            }
+        }
+        if (options.ignoreGpxTimestamps) {
+            mergedSamples.metaData.activity = hrmSampleData.metaData.activity;
+            mergedSamples.metaData.name = gpxSampleData.metaData.name;
+            mergedSamples.metaData.description = gpxSampleData.metaData.description;
+            // Place each HRM sample at the distance its speed has covered so far
+            const RouteIndex route(gpxSampleData);
+            const int n = hrmSampleData.count();
+            QVector<double> distances(n);
+            double distance = 0;
+            for (int i = 0; i < n; ++i) {
+                const GpsSample &hrmSample = hrmSampleData.at(i);
                 float speed = hrmSample.speed;  // km/h
                 qint64 time = hrmSample.time;
                 qint64 speedDuration = 0;
-                if (i == 0 && i < hrmSampleData.count() - 1) {
-                    speedDuration = hrmSampleData.at(i + 1).time - time;
+                if (i == 0) {
+                    if (n > 1)
+                        speedDuration = hrmSampleData.at(i + 1).time - time;
                 } else {
                     speedDuration = time - hrmSampleData.at(i - 1).time;
                 }
-                double hrmDist = speed * speedDuration/3600.0;    // meters
-                double lat, lon;
-                interpolator.advance(hrmDist, &lat, &lon);
-                hrmSample.lat = lat;
-                hrmSample.lon = lon;
+                distance += speed * speedDuration/3600.0;    // meters
+                distances[i] = distance;
+            }
+            QVector<double> lat(n);
+            QVector<double> lon(n);
+            route.positionsAt(distances.constData(), n, lat.data(), lon.data());
+            mergedSamples.reserve(n);
+            for (int i = 0; i < n; ++i) {
+                GpsSample hrmSample = hrmSampleData.at(i);
+                hrmSample.lat = lat.at(i);
+                hrmSample.lon = lon.at(i);
                 mergedSamples << hrmSample;
             }
         } else {
-
-            int gpxStart = gpxSampleData.indexOfTime(hrmStartTime);
-            int gpxEnd = gpxSampleData.indexOfTime(hrmEndTime);
-
-            for (int i = gpxStart; i < gpxEnd; ++i) {
-                GpsSample sample = gpxSampleData.at(i);
-                if (i == gpxStart)
-                    sample.time = hrmStartTime;
-                if (i == gpxEnd - 1) {
-                    if (sample.time < hrmEndTime)
-                        sample.time = hrmEndTime;
-                }
-                if (sample.time > hrmEndTime) {
-                    sample.time = hrmEndTime;
-                    i = gpxEnd;     // finish iteration and leave loop
-                }
-                const GpsSample hrmSample = *hrmSampleData.atTime(sample.time);
-
-                const float hr = hrmSample.hr;
-                const float speed = hrmSample.speed;
-
-                sample.hr = hr;
-                sample.speed = speed;
-                mergedSamples << sample;
-            }
+            TrackMerger merger;
+            if (options.interpolateHR)
+                merger.setInterpolation(TrackMerger::Linear);
+            merger.merge(gpxSampleData, hrmSampleData, hrmStartTime, hrmEndTime, &mergedSamples);
         }
     }
     
-    if (errorCorrection)
-        mergedSamples.correctTimeErrors();
+    if (options.errorCorrection) {
+        QVector<SampleRange> uncorrected;
+        const QVector<SampleRange> corrected = mergedSamples.correctTimeErrors(&uncorrected);
+        foreach (const SampleRange &range, corrected)
+            printf("Invalid data in range [%d,%d], fixed with interpolation\n", range.first, range.last);
+        foreach (const SampleRange &range, uncorrected)
+            qWarning("Invalid data in range [%d,%d] is too long to fix, left unchanged", range.first, range.last);
+    }
+    if (options.resampleInterval > 0) {
+        Resampler resampler;
+        resampler.setInterval(options.resampleInterval);
+        if (options.resampleMaximumGap > 0)
+            resampler.setMaximumGap(options.resampleMaximumGap);
+        else // the HRM interval is never a pause
+            resampler.setMaximumGap(qMax(Resampler::defaultMaximumGap(mergedSamples), qint64(hrmInfo.interval) * 1000));
+        if (options.interpolateHR)
+            resampler.setHRInterpolation(Resampler::Linear);
+        mergedSamples = resampler.resample(mergedSamples);
+    }
     printf("Result of merge:\n");
-    if (mergedSamples.count())
+    if (mergedSamples.count()) {
         mergedSamples.print();
+        ActivityAnalytics analytics;
+        analytics.setMaximumHR(options.maximumHR);
+        analytics.addSamples(mergedSamples);
+        analytics.print();
+    }
 
 
     /* gOOGLE Elevation API
@@ -171,18 +272,52 @@ int mergeTracks(const QString &hrmFile, const QString &gpxFilename, bool errorCo
 
       3/11 = x/13
                   */
+    if (options.simplifyTolerance > 0) {
+        TrackSimplifier simplifier;
+        simplifier.setMethod(options.simplifyMethod);
+        simplifier.setTolerance(options.simplifyTolerance);
+        const int count = mergedSamples.count();
+        mergedSamples = simplifier.simplify(mergedSamples);
+        printf("Simplified:     %d of %d trackpoints kept\n", mergedSamples.count(), count);
+    }
+
     QFileInfo fi(gpxFilename);
     qint64 startTime = mergedSamples.startTime();
     QDateTime dt;
     dt.setMSecsSinceEpoch(startTime);
     const QString dateString = dt.toString(QLatin1String("yyyyMMdd"));
-    const QString outputFileName(QString::fromLatin1("combined/%1-%2.gpx").arg(dateString, fi.baseName()));
+    const QString outputFileName(QString::fromLatin1(options.fitOutput ? "combined/%1-%2.fit" : "combined/%1-%2.gpx")
+                                 .arg(dateString, fi.baseName())
+                                 + CompressedDevice::fileSuffix(options.compression));
     QFile gpxFile(outputFileName);
     if (!gpxFile.open(QIODevice::WriteOnly)) {
         return -1;
     }
-    if (!saveGPX(mergedSamples, &gpxFile))
+    QIODevice *output = &gpxFile;
+    CompressedDevice compressor(&gpxFile, options.compression);
+    if (options.compression != CompressedDevice::Uncompressed) {
+        if (!compressor.open(QIODevice::WriteOnly))
+            return -1;
+        output = &compressor;
+    }
+    if (options.fitOutput) {
+        if (!saveFIT(mergedSamples, output))
+            return -1;
+    } else {
+        GpxWriter writer(options.gpxMode);
+        writer.setTimeSpec(options.timeSpec);
+        if (!writer.write(mergedSamples, output))
+            return -1;
+    }
+    if (output == &compressor && !compressor.finish()) {
+        qWarning("Failed to write '%s': %s", qPrintable(outputFileName), qPrintable(compressor.errorString()));
+        return -1;
+    }
+    if (!gpxFile.flush()) {
+        qWarning("Failed to write '%s': %s", qPrintable(outputFileName), qPrintable(gpxFile.errorString()));
         return -1;
+    }
+    compressor.close();
     gpxFile.close();
     printf("Merged file written to: %s\n", qPrintable(outputFileName));
     return 0;
@@ -194,29 +329,117 @@ int main(int argc, char **argv)
 #ifdef HAVE_HRMCOM
     bool fetch_hrm = false;
 #endif
-    bool error_correction = false;
-    bool ignore_gpx_timestamps = false;
+    MergeOptions options;
     QString gpxFilename, hrmFile;
     bool firstPass = true;
     bool altitudeDataIsHere = false;
+    bool jobsIsHere = false;
+    bool maximumHRIsHere = false;
+    bool distanceModelIsHere = false;
+    bool simplifyIsHere = false;
+    bool resampleIsHere = false;
+    bool resampleGapIsHere = false;
+    bool compressIsHere = false;
     bool commandLineOk = true;
-    float startAltitude = -FLT_MAX;
-    float endAltitude = -FLT_MAX;
     foreach (const QString &arg, app.arguments()) {
         if (firstPass) {
             firstPass = false;
             continue;
         }
-        if (arg == QLatin1String("--altitude")) {
+        if (jobsIsHere) {
+            const int jobs = arg.toInt(&commandLineOk);
+            if (!commandLineOk || jobs < 1) {
+                commandLineOk = false;
+                break;
+            }
+            QThreadPool::globalInstance()->setMaxThreadCount(jobs);
+            jobsIsHere = false;
+        } else if (maximumHRIsHere) {
+            options.maximumHR = arg.toInt(&commandLineOk);
+            if (!commandLineOk || options.maximumHR < 1) {
+                commandLineOk = false;
+                break;
+            }
+            maximumHRIsHere = false;
+        } else if (distanceModelIsHere) {
+            DistanceModel model;
+            if (!distanceModelFromName(qPrintable(arg), &model)) {
+                commandLineOk = false;
+                break;
+            }
+            setDistanceModel(model);
+            distanceModelIsHere = false;
+        } else if (simplifyIsHere) {
+            const QStringList parts = arg.split(QLatin1Char(':'));
+            options.simplifyTolerance = parts.at(0).toDouble(&commandLineOk);
+            if (commandLineOk && parts.count() == 2) {
+                if (parts.at(1) == QLatin1String("vw"))
+                    options.simplifyMethod = TrackSimplifier::VisvalingamWhyatt;
+                else if (parts.at(1) != QLatin1String("dp"))
+                    commandLineOk = false;
+            }
+            if (!commandLineOk || parts.count() > 2 || options.simplifyTolerance <= 0) {
+                commandLineOk = false;
+                break;
+            }
+            simplifyIsHere = false;
+        } else if (resampleIsHere) {
+            options.resampleInterval = qRound64(arg.toDouble(&commandLineOk) * 1000);
+            if (!commandLineOk || options.resampleInterval <= 0) {
+                commandLineOk = false;
+                break;
+            }
+            resampleIsHere = false;
+        } else if (resampleGapIsHere) {
+            options.resampleMaximumGap = qRound64(arg.toDouble(&commandLineOk) * 1000);
+            if (!commandLineOk || options.resampleMaximumGap <= 0) {
+                commandLineOk = false;
+                break;
+            }
+            resampleGapIsHere = false;
+        } else if (compressIsHere) {
+            if (!CompressedDevice::formatFromName(arg, &options.compression)
+                || !CompressedDevice::isSupported(options.compression)) {
+                commandLineOk = false;
+                break;
+            }
+            compressIsHere = false;
+        } else if (arg == QLatin1String("--altitude")) {
             altitudeDataIsHere = true;
+        } else if (arg == QLatin1String("--jobs")) {
+            jobsIsHere = true;
+        } else if (arg == QLatin1String("--max-hr")) {
+            maximumHRIsHere = true;
+        } else if (arg == QLatin1String("--distance-model")) {
+            distanceModelIsHere = true;
+        } else if (arg == QLatin1String("--simplify")) {
+            simplifyIsHere = true;
+        } else if (arg == QLatin1String("--resample")) {
+            resampleIsHere = true;
+        } else if (arg == QLatin1String("--resample-gap")) {
+            resampleGapIsHere = true;
+        } else if (arg == QLatin1String("--compress")) {
+            compressIsHere = true;
 #ifdef HAVE_HRMCOM
         } else if (arg == QLatin1String("--fetch-hrm")) {
             fetch_hrm = true;
 #endif
         } else if (arg == QLatin1String("--error-correction")) {
-            error_correction = true;
+            options.errorCorrection = true;
         } else if (arg == QLatin1String("--ignore-gpx-timestamps")) {
-            ignore_gpx_timestamps = true;
+            options.ignoreGpxTimestamps = true;
+        } else if (arg == QLatin1String("--interpolate-hr")) {
+            options.interpolateHR = true;
+        } else if (arg == QLatin1String("--auto-align")) {
+            options.autoAlign = true;
+        } else if (arg == QLatin1String("--compatible-output")) {
+            options.gpxMode = GpxWriter::Compatible;
+        } else if (arg == QLatin1String("--cache")) {
+            options.useCache = true;
+        } else if (arg == QLatin1String("--fit")) {
+            options.fitOutput = true;
+        } else if (arg == QLatin1String("--utc")) {
+            options.timeSpec = TimestampFormatter::UTC;
         } else {
             if (altitudeDataIsHere) {
                 // Hilton: 160.44
@@ -224,14 +447,14 @@ int main(int argc, char **argv)
                 QStringList altitudes = arg.split(QLatin1Char(':'));
                 if (altitudes.count() >= 1) {
                     if (!altitudes.at(0).isEmpty())
-                        startAltitude = altitudes.at(0).toFloat(&commandLineOk);
+                        options.startAltitude = altitudes.at(0).toFloat(&commandLineOk);
                 }
                 if (commandLineOk && altitudes.count() == 2) {
                     if (!altitudes.at(1).isEmpty())
-                        endAltitude = altitudes.at(1).toFloat(&commandLineOk);
+                        options.endAltitude = altitudes.at(1).toFloat(&commandLineOk);
                 }
 
-                if (startAltitude == -FLT_MAX && endAltitude == -FLT_MAX) {
+                if (options.startAltitude == -FLT_MAX && options.endAltitude == -FLT_MAX) {
                     commandLineOk = false;
                     break;
                 }
@@ -252,7 +475,7 @@ int main(int argc, char **argv)
             readHRMData(0);
 #endif
         } else if (!hrmFile.isNull()) {
-            mergeTracks(hrmFile, gpxFilename, error_correction, ignore_gpx_timestamps, startAltitude, endAltitude);
+            mergeTracks(hrmFile, gpxFilename, options);
         } else {
             usage();
         }
@@ -0,0 +1,217 @@
+#include "numberparser.h"
+#include <QtCore/qbytearray.h>
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+static const double exactPowersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool isDigit(char ch)
+{
+    return unsigned(ch - '0') <= 9;
+}
+
+/*
+    Coordinates are usually written with a fixed number of decimals, so most of
+    the digits can be converted eight at a time within a 64 bit register.
+    See http://0x80.pl/articles/simd-parsing-int-sequences.html
+*/
+static inline bool isEightDigits(quint64 v)
+{
+    return (((v & Q_UINT64_C(0xF0F0F0F0F0F0F0F0))
+             | (((v + Q_UINT64_C(0x0606060606060606)) & Q_UINT64_C(0xF0F0F0F0F0F0F0F0)) >> 4))
+            == Q_UINT64_C(0x3333333333333333));
+}
+
+static inline quint32 parseEightDigits(quint64 v)
+{
+    v -= Q_UINT64_C(0x3030303030303030);
+    v = (v * 10) + (v >> 8);
+    v = (((v & Q_UINT64_C(0x000000FF000000FF)) * Q_UINT64_C(0x000F424000000064))
+         + (((v >> 16) & Q_UINT64_C(0x000000FF000000FF)) * Q_UINT64_C(0x0000271000000001))) >> 32;
+    return quint32(v);
+}
+
+/*
+    Accumulates digits into \a mantissa, eight at a time where possible.
+    Digits beyond the 19th do not fit in 64 bits; they are only counted in
+    \a dropped so that the caller can fall back to a slower conversion.
+*/
+static inline const char *readDigits(const char *p, const char *end, quint64 *mantissa, int *digits, int *dropped)
+{
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    while (end - p >= 8 && *digits + 8 <= 19) {
+        quint64 v;
+        memcpy(&v, p, 8);
+        if (!isEightDigits(v))
+            break;
+        *mantissa = *mantissa * 100000000 + parseEightDigits(v);
+        *digits += (*mantissa == 0 ? 0 : 8);
+        p += 8;
+    }
+#endif
+    while (p != end && isDigit(*p)) {
+        if (*digits < 19) {
+            *mantissa = *mantissa * 10 + (*p - '0');
+            if (*mantissa)
+                ++*digits;
+        } else {
+            ++*dropped;
+        }
+        ++p;
+    }
+    return p;
+}
+
+#if defined(__SIZEOF_INT128__)
+typedef unsigned __int128 quint128;
+
+/*
+    Computes the correctly rounded value of \a mantissa / 10^\a scale.
+    The quotient of two exactly representable doubles is within an ulp of the
+    right answer; the candidate is then verified against the two neighbouring
+    halfway points in 128 bit integer arithmetic and adjusted if needed.
+*/
+static bool correctlyRoundedQuotient(quint64 mantissa, int scale, double *value)
+{
+    if (scale < 1 || scale > 19)
+        return false;
+    quint64 pow10 = 1;
+    for (int i = 0; i < scale; ++i)
+        pow10 *= 10;
+
+    double d = double(mantissa) / exactPowersOf10[scale];
+    const int mantissaBits = 64 - __builtin_clzll(mantissa);
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        int exponent;
+        const quint64 m = quint64(ldexp(frexp(d, &exponent), 53));    // d == m * 2^(exponent - 53)
+        const int shift = 54 - exponent;                                // mantissa * 2^shift compared to (2m +- 1) * pow10
+        if (m == (Q_UINT64_C(1) << 52) || shift < 0 || shift + mantissaBits > 127 || d < DBL_MIN)
+            return false;
+        const quint128 x = quint128(mantissa) << shift;
+        const quint128 upper = quint128(2 * m + 1) * pow10;
+        const quint128 lower = quint128(2 * m - 1) * pow10;
+        if (x > upper || (x == upper && (m & 1))) {
+            d = nextafter(d, HUGE_VAL);
+        } else if (x < lower || (x == lower && (m & 1))) {
+            d = nextafter(d, 0.0);
+        } else {
+            *value = d;
+            return true;
+        }
+    }
+    return false;
+}
+#else
+static bool correctlyRoundedQuotient(quint64, int, double *)
+{
+    return false;
+}
+#endif
+
+const char *parseDouble(const char *begin, const char *end, double *value)
+{
+    const char *p = begin;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    quint64 mantissa = 0;
+    int digits = 0;
+    int dropped = 0;
+    const char *integerPart = p;
+    p = readDigits(p, end, &mantissa, &digits, &dropped);
+    int exponent = dropped;
+    bool haveDigits = (p != integerPart);
+    if (p != end && *p == '.') {
+        ++p;
+        const char *fraction = p;
+        int fractionDropped = 0;
+        p = readDigits(p, end, &mantissa, &digits, &fractionDropped);
+        exponent -= (p - fraction) - fractionDropped;
+        dropped += fractionDropped;
+        haveDigits = haveDigits || (p != fraction);
+    }
+    if (!haveDigits)
+        return 0;
+
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        const char *e = p + 1;
+        bool negativeExponent = false;
+        if (e != end && (*e == '-' || *e == '+')) {
+            negativeExponent = (*e == '-');
+            ++e;
+        }
+        if (e != end && isDigit(*e)) {
+            int exp = 0;
+            while (e != end && isDigit(*e)) {
+                if (exp < 100000)
+                    exp = exp * 10 + (*e - '0');
+                ++e;
+            }
+            exponent += negativeExponent ? -exp : exp;
+            p = e;
+        }
+    }
+
+    double d;
+    if (mantissa == 0) {
+        d = 0.0;
+    } else if (dropped == 0 && mantissa <= (Q_UINT64_C(1) << 53) && exponent >= -22 && exponent <= 22) {
+        // Clinger's fast path, both operands are exact so the result is correctly rounded
+        d = double(mantissa);
+        d = exponent < 0 ? d / exactPowersOf10[-exponent] : d * exactPowersOf10[exponent];
+    } else if (!(dropped == 0 && exponent < 0 && correctlyRoundedQuotient(mantissa, -exponent, &d))) {
+        // Rare: more than 19 significant digits, large exponents or subnormals
+        bool ok;
+        d = QByteArray(begin, p - begin).toDouble(&ok);
+        if (!ok)
+            return 0;
+        *value = d;
+        return p;
+    }
+    *value = negative ? -d : d;
+    return p;
+}
+
+const char *parseFloat(const char *begin, const char *end, float *value)
+{
+    double d;
+    const char *p = parseDouble(begin, end, &d);
+    if (!p || qAbs(d) > FLT_MAX)
+        return 0;
+    *value = float(d);
+    return p;
+}
+
+const char *parseInt(const char *begin, const char *end, int *value)
+{
+    const char *p = begin;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+    const char *digits = p;
+    qint64 v = 0;
+    while (p != end && isDigit(*p)) {
+        v = v * 10 + (*p - '0');
+        if (v > qint64(INT_MAX) + 1)
+            return 0;
+        ++p;
+    }
+    if (p == digits)
+        return 0;
+    v = negative ? -v : v;
+    if (v > INT_MAX)
+        return 0;
+    *value = int(v);
+    return p;
+}
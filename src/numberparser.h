@@ -0,0 +1,19 @@
+#ifndef NUMBERPARSER_H
+#define NUMBERPARSER_H
+
+#include <QtCore/qglobal.h>
+
+/*
+    Locale independent number parsing from raw byte ranges, in the style of
+    std::from_chars: each function returns a pointer past the last character
+    consumed, or 0 if [begin, end) does not start with a number. The value is
+    only written on success, so a complete token was parsed if the returned
+    pointer equals \a end.
+
+    The results are bit-identical to QByteArray::toDouble(), toFloat() and toInt().
+*/
+const char *parseDouble(const char *begin, const char *end, double *value);
+const char *parseFloat(const char *begin, const char *end, float *value);
+const char *parseInt(const char *begin, const char *end, int *value);
+
+#endif // NUMBERPARSER_H
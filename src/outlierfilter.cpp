@@ -0,0 +1,155 @@
+#include "outlierfilter.h"
+
+#include <math.h>
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+static const double EarthRadius = 6371000.0;                // meters
+static const double DegreesToMeters = EarthRadius * M_PI / 180.0;
+static const double MeasurementVariance = 10.0 * 10.0;      // GPS error of 10 m
+static const double AccelerationVariance = 3.0 * 3.0;       // m/s^2
+static const double InitialVelocityVariance = 10.0 * 10.0;
+static const double GateThreshold = 25.0;                   // squared Mahalanobis distance (5 sigma)
+
+OutlierFilter::OutlierFilter()
+    : m_maximumSpeed(150.0), m_maximumGap(60)
+{
+    reset();
+}
+
+void OutlierFilter::reset()
+{
+    m_started = false;
+    m_lat = m_lon = 0;
+    m_velocityEast = m_velocityNorth = 0;
+    m_p00 = m_p01 = m_p11 = 0;
+}
+
+void OutlierFilter::start(const GpsSample &sample)
+{
+    m_started = true;
+    m_last = sample;
+    m_lat = sample.lat;
+    m_lon = sample.lon;
+    m_velocityEast = m_velocityNorth = 0;
+    m_p00 = MeasurementVariance;
+    m_p01 = 0;
+    m_p11 = InitialVelocityVariance;
+}
+
+/*!
+    Feeds the next sample of the track to the filter, and returns true if it
+    is consistent with the samples accepted so far. A rejected sample does not
+    change the estimated track.
+*/
+bool OutlierFilter::accept(const GpsSample &sample)
+{
+    if (!m_started) {
+        start(sample);
+        return true;
+    }
+    if (sample.time <= m_last.time)
+        return false;
+
+    const double cosLat = cos(m_last.lat * (M_PI / 180.0));
+    const double sinceLast = (sample.time - m_last.time) / 1000.0;
+    const double east = (sample.lon - m_last.lon) * DegreesToMeters * cosLat;
+    const double north = (sample.lat - m_last.lat) * DegreesToMeters;
+    if ((east * east + north * north) > (m_maximumSpeed / 3.6 * sinceLast) * (m_maximumSpeed / 3.6 * sinceLast))
+        return false;
+
+    // Predict the position at the time of the sample
+    const double dt = sinceLast;
+    const double predictedEast = m_velocityEast * dt;
+    const double predictedNorth = m_velocityNorth * dt;
+    const double dt2 = dt * dt;
+    const double p00 = m_p00 + 2 * dt * m_p01 + dt2 * m_p11 + AccelerationVariance * dt2 * dt / 3;
+    const double p01 = m_p01 + dt * m_p11 + AccelerationVariance * dt2 / 2;
+    const double p11 = m_p11 + AccelerationVariance * dt;
+
+    // Gate on the distance between the sample and the prediction
+    const double estimateEast = (m_lon - m_last.lon) * DegreesToMeters * cosLat + predictedEast;
+    const double estimateNorth = (m_lat - m_last.lat) * DegreesToMeters + predictedNorth;
+    const double innovationEast = east - estimateEast;
+    const double innovationNorth = north - estimateNorth;
+    const double s = p00 + MeasurementVariance;
+    if ((innovationEast * innovationEast + innovationNorth * innovationNorth) / s > GateThreshold)
+        return false;
+
+    // Update
+    const double k0 = p00 / s;
+    const double k1 = p01 / s;
+    const double updatedEast = estimateEast + k0 * innovationEast;
+    const double updatedNorth = estimateNorth + k0 * innovationNorth;
+    m_velocityEast += k1 * innovationEast;
+    m_velocityNorth += k1 * innovationNorth;
+    m_p00 = (1 - k0) * p00;
+    m_p01 = (1 - k0) * p01;
+    m_p11 = p11 - k1 * p01;
+
+    m_lat = m_last.lat + updatedNorth / DegreesToMeters;
+    m_lon = m_last.lon + updatedEast / (DegreesToMeters * cosLat);
+    m_last = sample;
+    return true;
+}
+
+/*!
+    Replaces the rejected samples of \a samples with a linear interpolation
+    (of time and position) between the accepted samples around them, and
+    returns the ranges that were replaced. Rejected samples at the end of the
+    track have no accepted sample after them, so they keep the position of the
+    last accepted sample instead.
+
+    If more than maximumGap() samples in a row are rejected, the track is
+    assumed to really have moved. The rejected samples are left unchanged,
+    their range is added to \a uncorrected, and the filter starts over from
+    the last of them.
+*/
+QVector<SampleRange> OutlierFilter::correct(SampleData *samples, QVector<SampleRange> *uncorrected)
+{
+    QVector<SampleRange> corrected;
+    reset();
+    GpsSample *data = samples->data();
+    const int count = samples->count();
+    int lastGood = -1;
+    for (int i = 0; i < count; ++i) {
+        if (accept(data[i])) {
+            if (lastGood != -1 && lastGood < i - 1) {
+                const GpsSample &good = data[lastGood];
+                const GpsSample &curr = data[i];
+                const qint64 deltaTime = curr.time - good.time;
+                const double deltaLat = curr.lat - good.lat;
+                const double deltaLon = curr.lon - good.lon;
+                const int deltaIndex = i - lastGood;
+                for (int j = lastGood + 1; j < i; ++j) {
+                    GpsSample &fix = data[j];
+                    fix.time = good.time + deltaTime * (j - lastGood) / deltaIndex;
+                    fix.lat = good.lat + deltaLat * (j - lastGood) / deltaIndex;
+                    fix.lon = good.lon + deltaLon * (j - lastGood) / deltaIndex;
+                }
+                corrected.append(SampleRange(lastGood + 1, i - 1));
+            }
+            lastGood = i;
+        } else if (i - lastGood > m_maximumGap) {
+            // Start over from this sample rather than rescanning the run,
+            // so that every sample is fed to the filter once
+            if (uncorrected)
+                uncorrected->append(SampleRange(lastGood + 1, i - 1));
+            reset();
+            accept(data[i]);
+            lastGood = i;
+        }
+    }
+
+    // The run is at most maximumGap() samples long here
+    if (lastGood != -1 && lastGood < count - 1) {
+        const GpsSample &good = data[lastGood];
+        for (int j = lastGood + 1; j < count; ++j) {
+            data[j].lat = good.lat;
+            data[j].lon = good.lon;
+        }
+        corrected.append(SampleRange(lastGood + 1, count - 1));
+    }
+    return corrected;
+}
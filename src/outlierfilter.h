@@ -0,0 +1,45 @@
+#ifndef OUTLIERFILTER_H
+#define OUTLIERFILTER_H
+
+#include "gpssample.h"
+
+/*
+    Detects GPS positions that are inconsistent with the rest of the track.
+
+    The filter tracks position and velocity with a constant velocity Kalman
+    filter (in meters, on a plane tangent to the last position). A sample is
+    rejected if it would mean moving faster than maximumSpeed() since the last
+    accepted sample, if its time is not after the last accepted sample, or if
+    it is too far from the predicted position. The state is a handful of
+    numbers, so samples can be streamed through accept() one at a time.
+*/
+class OutlierFilter {
+public:
+    OutlierFilter();
+
+    void setMaximumSpeed(double kmh) { m_maximumSpeed = kmh; }
+    double maximumSpeed() const { return m_maximumSpeed; }
+    void setMaximumGap(int samples) { m_maximumGap = samples; }
+    int maximumGap() const { return m_maximumGap; }
+
+    void reset();
+    bool accept(const GpsSample &sample);
+
+    QVector<SampleRange> correct(SampleData *samples, QVector<SampleRange> *uncorrected = 0);
+
+private:
+    void start(const GpsSample &sample);
+
+    double m_maximumSpeed;      // km/h
+    int m_maximumGap;
+
+    bool m_started;
+    GpsSample m_last;           // last accepted sample
+    double m_lat;               // estimated position, degrees
+    double m_lon;
+    double m_velocityEast;      // m/s
+    double m_velocityNorth;
+    double m_p00, m_p01, m_p11; // covariance of (position, velocity), same for both axes
+};
+
+#endif // OUTLIERFILTER_H
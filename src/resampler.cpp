@@ -0,0 +1,95 @@
+#include "resampler.h"
+
+#include <algorithm>
+
+static const int GapFactor = 4;
+static const qint64 MinimumGap = 10000;    // ms
+
+/*!
+    Returns \a samples resampled to interval(). The samples must be sorted by
+    time. Samples without speed (-1) are not interpolated with, the speed of
+    the nearest sample is used instead. No samples are made up inside gaps
+    longer than maximumGap(), such as a pause with the GPS turned off.
+*/
+SampleData Resampler::resample(const SampleData &samples) const
+{
+    SampleData result;
+    result.metaData = samples.metaData;
+    if (samples.isEmpty() || m_interval <= 0)
+        return result;
+
+    const qint64 maximumGap = m_maximumGap > 0 ? m_maximumGap : defaultMaximumGap(samples);
+    const GpsSample *input = samples.constData();
+    const int inputCount = samples.count();
+    const qint64 start = input[0].time;
+    const int count = int((input[inputCount - 1].time - start) / m_interval) + 1;
+    result.resize(count);
+    GpsSample *output = result.data();
+
+    int j = 0;
+    int outputCount = 0;
+    for (int i = 0; i < count; ++i) {
+        const qint64 time = start + i * m_interval;
+        while (j + 1 < inputCount && input[j + 1].time <= time)
+            ++j;
+        const GpsSample &prev = input[j];
+        if (j + 1 == inputCount || prev.time == time) {
+            GpsSample &sample = output[outputCount++];
+            sample = prev;
+            sample.time = time;
+            continue;
+        }
+
+        const GpsSample &next = input[j + 1];
+        if (next.time - prev.time > maximumGap)
+            continue;
+        GpsSample &sample = output[outputCount++];
+        const double progress = double(time - prev.time) / (next.time - prev.time);
+        const GpsSample &nearest = progress < 0.5 ? prev : next;
+        sample.time = time;
+        sample.lat = prev.lat + (next.lat - prev.lat) * progress;
+        sample.lon = prev.lon + (next.lon - prev.lon) * progress;
+        sample.ele = prev.ele + (next.ele - prev.ele) * progress;
+        if (prev.speed < 0 || next.speed < 0)
+            sample.speed = nearest.speed;
+        else
+            sample.speed = prev.speed + (next.speed - prev.speed) * progress;
+        sample.cadence = nearest.cadence;
+        if (m_hrInterpolation == Linear)
+            sample.hr = qRound(prev.hr + (next.hr - prev.hr) * progress);
+        else
+            sample.hr = nearest.hr;
+    }
+    result.resize(outputCount);
+    return result;
+}
+
+/*!
+    Returns the median time between two samples of \a samples, or 0 if there
+    are less than two samples with different times.
+*/
+qint64 Resampler::medianInterval(const SampleData &samples)
+{
+    QVector<qint64> intervals;
+    intervals.reserve(samples.count());
+    for (int i = 1; i < samples.count(); ++i) {
+        const qint64 interval = samples.at(i).time - samples.at(i - 1).time;
+        if (interval > 0)
+            intervals.append(interval);
+    }
+    if (intervals.isEmpty())
+        return 0;
+    qint64 *median = intervals.data() + intervals.count() / 2;
+    std::nth_element(intervals.data(), median, intervals.data() + intervals.count());
+    return *median;
+}
+
+/*!
+    Returns the maximum gap used when none is set: a few times the median
+    interval of \a samples, so that a slow recording interval is not taken
+    for a pause, but at least 10 seconds.
+*/
+qint64 Resampler::defaultMaximumGap(const SampleData &samples)
+{
+    return qMax(GapFactor * medianInterval(samples), MinimumGap);
+}
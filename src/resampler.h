@@ -0,0 +1,46 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include "gpssample.h"
+
+/*
+    Resamples a track onto a fixed time grid, starting at the time of the
+    first sample. Position, elevation and speed are interpolated linearly, HR
+    is taken from the nearest sample or interpolated linearly, and cadence is
+    taken from the nearest sample.
+
+    Grid points inside a gap of more than maximumGap() between two input
+    samples are left out, so the output has the same gaps as the input. If no
+    maximum gap is set, it is derived from the input with defaultMaximumGap().
+
+    The output is allocated up front and filled in a single forward sweep
+    over the input.
+*/
+class Resampler {
+public:
+    enum HRInterpolation {
+        NearestSample,
+        Linear
+    };
+
+    Resampler() : m_interval(1000), m_maximumGap(0), m_hrInterpolation(NearestSample) {}
+
+    void setInterval(qint64 ms) { m_interval = ms; }
+    qint64 interval() const { return m_interval; }
+    void setMaximumGap(qint64 ms) { m_maximumGap = ms; }
+    qint64 maximumGap() const { return m_maximumGap; }
+    void setHRInterpolation(HRInterpolation interpolation) { m_hrInterpolation = interpolation; }
+    HRInterpolation hrInterpolation() const { return m_hrInterpolation; }
+
+    SampleData resample(const SampleData &samples) const;
+
+    static qint64 medianInterval(const SampleData &samples);
+    static qint64 defaultMaximumGap(const SampleData &samples);
+
+private:
+    qint64 m_interval;
+    qint64 m_maximumGap;
+    HRInterpolation m_hrInterpolation;
+};
+
+#endif // RESAMPLER_H
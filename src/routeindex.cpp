@@ -0,0 +1,106 @@
+#include "routeindex.h"
+#include "gpssample.h"
+#include "geo.h"
+
+#include <algorithm>
+
+RouteIndex::RouteIndex()
+{
+}
+
+RouteIndex::RouteIndex(const SampleData &route)
+{
+    const int n = route.count();
+    if (n == 0)
+        return;
+    m_lat.resize(n);
+    m_lon.resize(n);
+    m_distances.resize(n);
+    for (int i = 0; i < n; ++i) {
+        m_lat[i] = route.at(i).lat;
+        m_lon[i] = route.at(i).lon;
+    }
+
+    // Segment lengths in km, then the prefix sum in meters
+    double *distances = m_distances.data();
+    distances[0] = 0;
+    segmentDistances(m_lat.constData(), m_lon.constData(), n, distances + 1);
+    for (int i = 1; i < n; ++i)
+        distances[i] = distances[i - 1] + 1000 * distances[i];
+}
+
+/*
+    Returns the index of the segment that contains \a distance, that is the
+    last point at or before it, limited to [0, count - 2].
+*/
+int RouteIndex::segmentAt(double distance) const
+{
+    const double *distances = m_distances.constData();
+    const int i = int(std::upper_bound(distances, distances + count(), distance) - distances) - 1;
+    return qBound(0, i, count() - 2);
+}
+
+/*
+    Like segmentAt(), but searches forward from the segment \a from, doubling
+    the step until \a distance is passed. This makes a sweep over increasing
+    distances cost O(1) per distance when they are close together.
+*/
+int RouteIndex::gallop(double distance, int from) const
+{
+    const double *distances = m_distances.constData();
+    const int n = count();
+    if (distances[from] > distance)
+        return segmentAt(distance);
+    int lo = from;
+    int step = 1;
+    while (lo + step < n && distances[lo + step] <= distance) {
+        lo += step;
+        step *= 2;
+    }
+    const int hi = qMin(lo + step, n);
+    const int i = int(std::upper_bound(distances + lo, distances + hi, distance) - distances) - 1;
+    return qMin(i, n - 2);
+}
+
+/*!
+    Writes the position at \a distance meters along the route to \a lat and
+    \a lon. Returns false if the route has no points.
+*/
+bool RouteIndex::positionAt(double distance, double *lat, double *lon) const
+{
+    return positionsAt(&distance, 1, lat, lon);
+}
+
+/*!
+    Writes the positions at each of the \a count \a distances to \a lat and
+    \a lon. The distances are found with a forward galloping search, so a
+    sorted array of distances (like a cumulative speed profile) is mapped in
+    a single sweep over the route. Returns false if the route has no points.
+*/
+bool RouteIndex::positionsAt(const double *distances, int count, double *lat, double *lon) const
+{
+    const int n = this->count();
+    if (n == 0)
+        return false;
+    if (n == 1) {
+        for (int i = 0; i < count; ++i) {
+            lat[i] = m_lat.first();
+            lon[i] = m_lon.first();
+        }
+        return true;
+    }
+
+    const double *cumulative = m_distances.constData();
+    const double *routeLat = m_lat.constData();
+    const double *routeLon = m_lon.constData();
+    int segment = 0;
+    for (int i = 0; i < count; ++i) {
+        segment = gallop(distances[i], segment);
+        const double length = cumulative[segment + 1] - cumulative[segment];
+        double progress = length > 0 ? (distances[i] - cumulative[segment]) / length : 0.0;
+        progress = qBound(0.0, progress, 1.0);
+        lat[i] = routeLat[segment] + (routeLat[segment + 1] - routeLat[segment]) * progress;
+        lon[i] = routeLon[segment] + (routeLon[segment + 1] - routeLon[segment]) * progress;
+    }
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef ROUTEINDEX_H
+#define ROUTEINDEX_H
+
+#include <QtCore/qvector.h>
+
+class SampleData;
+
+/*
+    Maps a distance along a route to a position on it.
+
+    The index keeps the cumulative distance (in meters) at each point of the
+    route, so positionAt() is a binary search followed by a linear
+    interpolation between the two points around the distance. Distances
+    before the start or beyond the end of the route map to its first or
+    last point.
+
+    The index keeps its own copy of the positions, like TimeIndex.
+*/
+class RouteIndex {
+public:
+    RouteIndex();
+    explicit RouteIndex(const SampleData &route);
+
+    int count() const { return m_distances.count(); }
+    double length() const { return m_distances.isEmpty() ? 0.0 : m_distances.last(); }
+
+    bool positionAt(double distance, double *lat, double *lon) const;
+    bool positionsAt(const double *distances, int count, double *lat, double *lon) const;
+
+private:
+    int segmentAt(double distance) const;
+    int gallop(double distance, int from) const;
+
+    QVector<double> m_distances;    // cumulative, meters
+    QVector<double> m_lat;
+    QVector<double> m_lon;
+};
+
+#endif // ROUTEINDEX_H
@@ -0,0 +1,325 @@
+#include "samplecache.h"
+#include <QtCore/qdatetime.h>
+#include <QtCore/qendian.h>
+#include <QtCore/qfileinfo.h>
+#include <QtCore/qsavefile.h>
+
+#include <stddef.h>
+#include <string.h>
+
+#include "samplecolumns.h"
+
+namespace {
+
+enum {
+    ColumnCount = 7,
+    ByteOrderMark = 0x01020304
+};
+
+const char Magic[8] = {'H', 'R', 'M', 'G', 'P', 'X', 'S', 'C'};
+const int ElementSizes[ColumnCount] = {
+    sizeof(qint64), sizeof(double), sizeof(double), sizeof(float), sizeof(qint32), sizeof(float), sizeof(qint32)
+};
+
+struct Block {
+    quint64 offset;
+    quint64 size;
+    quint32 crc;
+    quint32 reserved;
+};
+
+struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 byteOrder;
+    qint64 sourceSize;
+    qint64 sourceModified;
+    qint64 startTime;
+    qint64 endTime;
+    qint32 interval;
+    quint32 flags;
+    qint32 count;
+    qint32 activity;
+    quint32 nameSize;           // the metadata block is the name followed by the description
+    quint32 descriptionSize;
+    Block metaData;
+    Block columns[ColumnCount];
+    quint32 reserved;
+    quint32 headerCrc;          // of everything above
+};
+
+Q_STATIC_ASSERT(sizeof(Header) % 8 == 0);
+
+/*
+    CRC-32 (IEEE 802.3, as zlib), slicing by 8 bytes.
+*/
+class Crc32 {
+public:
+    Crc32()
+    {
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+            m_table[0][i] = crc;
+        }
+        for (int i = 0; i < 256; ++i) {
+            for (int slice = 1; slice < 8; ++slice)
+                m_table[slice][i] = (m_table[slice - 1][i] >> 8) ^ m_table[0][m_table[slice - 1][i] & 0xff];
+        }
+    }
+
+    quint32 operator()(const void *data, quint64 size) const
+    {
+        const uchar *p = static_cast<const uchar *>(data);
+        quint32 crc = 0xffffffff;
+        for (; size >= 8; size -= 8, p += 8) {
+            quint32 low, high;
+            memcpy(&low, p, 4);
+            memcpy(&high, p + 4, 4);
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+            low = qbswap(low);
+            high = qbswap(high);
+#endif
+            low ^= crc;
+            crc = m_table[7][low & 0xff] ^ m_table[6][(low >> 8) & 0xff]
+                ^ m_table[5][(low >> 16) & 0xff] ^ m_table[4][low >> 24]
+                ^ m_table[3][high & 0xff] ^ m_table[2][(high >> 8) & 0xff]
+                ^ m_table[1][(high >> 16) & 0xff] ^ m_table[0][high >> 24];
+        }
+        for (; size; --size, ++p)
+            crc = (crc >> 8) ^ m_table[0][(crc ^ *p) & 0xff];
+        return ~crc;
+    }
+
+private:
+    quint32 m_table[8][256];
+};
+
+quint32 crc32(const void *data, quint64 size)
+{
+    static const Crc32 crc;
+    return crc(data, size);
+}
+
+quint64 align(quint64 offset)
+{
+    return (offset + SampleCache::Alignment - 1) & ~quint64(SampleCache::Alignment - 1);
+}
+
+bool writePadding(QIODevice *device, quint64 from, quint64 to)
+{
+    static const char zeros[SampleCache::Alignment] = {};
+    return device->write(zeros, to - from) == qint64(to - from);
+}
+
+} // namespace
+
+/*!
+    Maps \a fileName and checks the header, the block layout and all checksums.
+    Returns false if the file can not be used.
+*/
+bool SampleCache::open(const QString &fileName)
+{
+    close();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+        return false;
+    const qint64 size = m_file.size();
+    m_data = size > 0 ? m_file.map(0, size) : 0;
+    if (!m_data) {
+        m_contents = m_file.readAll();
+        m_data = reinterpret_cast<const uchar *>(m_contents.constData());
+    }
+    if (!validate(m_contents.isNull() ? size : m_contents.size())) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool SampleCache::validate(qint64 size)
+{
+    if (size < qint64(sizeof(Header)))
+        return false;
+    Header header;
+    memcpy(&header, m_data, sizeof(Header));
+    if (memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version
+        || header.byteOrder != ByteOrderMark
+        || header.headerCrc != crc32(&header, offsetof(Header, headerCrc))
+        || header.count < 0) {
+        return false;
+    }
+
+    const Block &meta = header.metaData;
+    if (meta.offset > quint64(size) || meta.size > quint64(size) - meta.offset
+        || meta.size != quint64(header.nameSize) + header.descriptionSize
+        || meta.crc != crc32(m_data + meta.offset, meta.size)) {
+        return false;
+    }
+    for (int i = 0; i < ColumnCount; ++i) {
+        const Block &column = header.columns[i];
+        if (column.offset % Alignment || column.offset > quint64(size)
+            || column.size != quint64(header.count) * ElementSizes[i]
+            || column.size > quint64(size) - column.offset
+            || column.crc != crc32(m_data + column.offset, column.size)) {
+            return false;
+        }
+        m_columnOffsets[i] = column.offset;
+    }
+
+    m_count = header.count;
+    m_info.sourceSize = header.sourceSize;
+    m_info.sourceModified = header.sourceModified;
+    m_info.startTime = header.startTime;
+    m_info.endTime = header.endTime;
+    m_info.interval = header.interval;
+    m_info.flags = header.flags;
+    const char *strings = reinterpret_cast<const char *>(m_data + meta.offset);
+    m_metaData.activity = SampleData::Activity(qBound(0, header.activity, int(SampleData::Running)));
+    m_metaData.name = QString::fromUtf8(strings, header.nameSize);
+    m_metaData.description = QString::fromUtf8(strings + header.nameSize, header.descriptionSize);
+    return true;
+}
+
+void SampleCache::close()
+{
+    if (m_data && m_contents.isNull())
+        m_file.unmap(const_cast<uchar *>(m_data));
+    m_file.close();
+    m_contents = QByteArray();
+    m_data = 0;
+    m_count = 0;
+    m_info = SampleCacheInfo();
+    m_metaData = SampleData::MetaData();
+}
+
+SampleData SampleCache::toSampleData() const
+{
+    SampleData samples;
+    samples.metaData = m_metaData;
+    samples.resize(m_count);
+    GpsSample *out = samples.data();
+    const qint64 *times = time();
+    const double *lats = lat();
+    const double *lons = lon();
+    const float *eles = ele();
+    const qint32 *hrs = hr();
+    const float *speeds = speed();
+    const qint32 *cadences = cadence();
+    for (int i = 0; i < m_count; ++i) {
+        out[i].time = times[i];
+        out[i].lat = lats[i];
+        out[i].lon = lons[i];
+        out[i].ele = eles[i];
+        out[i].hr = hrs[i];
+        out[i].speed = speeds[i];
+        out[i].cadence = cadences[i];
+    }
+    return samples;
+}
+
+/*!
+    Writes \a samples and \a info to \a device in the cache format.
+*/
+bool SampleCache::save(const SampleData &samples, const SampleCacheInfo &info, QIODevice *device)
+{
+    Q_STATIC_ASSERT(sizeof(int) == sizeof(qint32));
+    const SampleColumns columns(samples);
+    const void *data[ColumnCount] = {
+        columns.time(), columns.lat(), columns.lon(), columns.ele(), columns.hr(), columns.speed(),
+        columns.cadence()
+    };
+    const QByteArray name = samples.metaData.name.toUtf8();
+    const QByteArray description = samples.metaData.description.toUtf8();
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.byteOrder = ByteOrderMark;
+    header.sourceSize = info.sourceSize;
+    header.sourceModified = info.sourceModified;
+    header.startTime = info.startTime;
+    header.endTime = info.endTime;
+    header.interval = info.interval;
+    header.flags = info.flags;
+    header.count = samples.count();
+    header.activity = samples.metaData.activity;
+    header.nameSize = name.size();
+    header.descriptionSize = description.size();
+
+    QByteArray strings = name;
+    strings += description;
+    header.metaData.offset = sizeof(Header);
+    header.metaData.size = strings.size();
+    header.metaData.crc = crc32(strings.constData(), strings.size());
+    quint64 offset = header.metaData.offset + header.metaData.size;
+    for (int i = 0; i < ColumnCount; ++i) {
+        Block &column = header.columns[i];
+        column.offset = align(offset);
+        column.size = quint64(samples.count()) * ElementSizes[i];
+        column.crc = crc32(data[i], column.size);
+        offset = column.offset + column.size;
+    }
+    header.headerCrc = crc32(&header, offsetof(Header, headerCrc));
+
+    if (device->write(reinterpret_cast<const char *>(&header), sizeof(header)) != qint64(sizeof(header))
+        || device->write(strings) != strings.size()) {
+        return false;
+    }
+    offset = header.metaData.offset + header.metaData.size;
+    for (int i = 0; i < ColumnCount; ++i) {
+        const Block &column = header.columns[i];
+        if (!writePadding(device, offset, column.offset)
+            || device->write(static_cast<const char *>(data[i]), column.size) != qint64(column.size)) {
+            return false;
+        }
+        offset = column.offset + column.size;
+    }
+    return true;
+}
+
+QString sampleCacheFileName(const QString &sourceFileName)
+{
+    return sourceFileName + QLatin1String(".cache");
+}
+
+/*!
+    Loads \a samples and \a info from the sidecar cache of \a sourceFileName.
+    Returns false if there is no cache, or if it was written for a source file
+    with another size or modification time.
+*/
+bool loadCachedSamples(SampleData *samples, SampleCacheInfo *info, const QString &sourceFileName)
+{
+    const QFileInfo source(sourceFileName);
+    SampleCache cache;
+    if (!source.exists() || !cache.open(sampleCacheFileName(sourceFileName)))
+        return false;
+    if (cache.info().sourceSize != source.size()
+        || cache.info().sourceModified != source.lastModified().toMSecsSinceEpoch()) {
+        return false;
+    }
+    *samples = cache.toSampleData();
+    *info = cache.info();
+    return true;
+}
+
+/*!
+    Writes the sidecar cache of \a sourceFileName. The size and modification
+    time in \a info are replaced with those of the source file.
+*/
+bool saveCachedSamples(const SampleData &samples, const SampleCacheInfo &info, const QString &sourceFileName)
+{
+    const QFileInfo source(sourceFileName);
+    SampleCacheInfo sourceInfo = info;
+    sourceInfo.sourceSize = source.size();
+    sourceInfo.sourceModified = source.lastModified().toMSecsSinceEpoch();
+
+    QSaveFile file(sampleCacheFileName(sourceFileName));
+    if (!file.open(QIODevice::WriteOnly) || !SampleCache::save(samples, sourceInfo, &file)) {
+        qWarning("Failed to write cache for '%s'", qPrintable(sourceFileName));
+        return false;
+    }
+    return file.commit();
+}
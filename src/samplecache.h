@@ -0,0 +1,96 @@
+#ifndef SAMPLECACHE_H
+#define SAMPLECACHE_H
+
+#include <QtCore/qfile.h>
+#include <QtCore/qstring.h>
+#include "gpssample.h"
+
+class QIODevice;
+
+// What is known about the source of cached samples, besides the samples
+struct SampleCacheInfo {
+    enum Flag {
+        HasAltitude = 0x1
+    };
+
+    SampleCacheInfo()
+        : sourceSize(-1), sourceModified(-1), startTime(-1), endTime(-1), interval(0), flags(0)
+    {
+    }
+
+    qint64 sourceSize;
+    qint64 sourceModified;      // ms since the epoch
+    qint64 startTime;           // recording start and end, as given by the source
+    qint64 endTime;
+    int interval;               // recording interval of the source, 0 if irregular
+    quint32 flags;
+};
+
+/*
+    A versioned binary container for SampleData, used to cache parsed GPX and
+    HRM files next to their source.
+
+    The file starts with a fixed size header (magic, version, byte order
+    mark, SampleCacheInfo, sample count and a directory of blocks), followed
+    by the metadata strings as UTF-8 and one column per GpsSample field: time,
+    lat, lon, ele, hr, speed and cadence. Every column starts at a multiple of
+    Alignment bytes. The header and every block have a CRC-32.
+
+    Files are written in native byte order. A file with another byte order,
+    version or a failed checksum does not open, and is simply rewritten.
+
+    open() maps the file and validates it; the column accessors then point
+    straight into the mapping.
+*/
+class SampleCache {
+public:
+    enum {
+        Version = 2,
+        Alignment = 64
+    };
+
+    SampleCache() : m_data(0), m_count(0) {}
+    ~SampleCache() { close(); }
+
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const { return m_data != 0; }
+
+    const SampleCacheInfo &info() const { return m_info; }
+    int count() const { return m_count; }
+    const SampleData::MetaData &metaData() const { return m_metaData; }
+    SampleData toSampleData() const;
+
+    const qint64 *time() const { return column<qint64>(0); }
+    const double *lat() const { return column<double>(1); }
+    const double *lon() const { return column<double>(2); }
+    const float *ele() const { return column<float>(3); }
+    const qint32 *hr() const { return column<qint32>(4); }
+    const float *speed() const { return column<float>(5); }
+    const qint32 *cadence() const { return column<qint32>(6); }
+
+    static bool save(const SampleData &samples, const SampleCacheInfo &info, QIODevice *device);
+
+private:
+    template <typename T>
+    const T *column(int index) const
+    {
+        return reinterpret_cast<const T *>(m_data + m_columnOffsets[index]);
+    }
+    bool validate(qint64 size);
+
+    QFile m_file;
+    QByteArray m_contents;      // when the file could not be mapped
+    const uchar *m_data;
+    int m_count;
+    SampleCacheInfo m_info;
+    quint64 m_columnOffsets[7];
+    SampleData::MetaData m_metaData;
+};
+
+// The sidecar cache of a GPX or HRM file
+QString sampleCacheFileName(const QString &sourceFileName);
+bool loadCachedSamples(SampleData *samples, SampleCacheInfo *info, const QString &sourceFileName);
+bool saveCachedSamples(const SampleData &samples, const SampleCacheInfo &info, const QString &sourceFileName);
+
+#endif // SAMPLECACHE_H
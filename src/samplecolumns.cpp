@@ -0,0 +1,175 @@
+#include "samplecolumns.h"
+
+#include <algorithm>
+
+SampleColumns::SampleColumns(const SampleData &samples)
+    : metaData(samples.metaData)
+{
+    resize(samples.count());
+    for (int i = 0; i < samples.count(); ++i) {
+        const GpsSample &sample = samples.at(i);
+        m_time[i] = sample.time;
+        m_lat[i] = sample.lat;
+        m_lon[i] = sample.lon;
+        m_ele[i] = sample.ele;
+        m_hr[i] = sample.hr;
+        m_speed[i] = sample.speed;
+        m_cadence[i] = sample.cadence;
+    }
+}
+
+SampleData SampleColumns::toSampleData() const
+{
+    SampleData samples;
+    samples.metaData = metaData;
+    samples.resize(count());
+    for (int i = 0; i < count(); ++i)
+        samples[i] = at(i);
+    return samples;
+}
+
+void SampleColumns::reserve(int size)
+{
+    m_time.reserve(size);
+    m_lat.reserve(size);
+    m_lon.reserve(size);
+    m_ele.reserve(size);
+    m_hr.reserve(size);
+    m_speed.reserve(size);
+    m_cadence.reserve(size);
+}
+
+void SampleColumns::resize(int size)
+{
+    m_time.resize(size);
+    m_lat.resize(size);
+    m_lon.resize(size);
+    m_ele.resize(size);
+    m_hr.resize(size);
+    m_speed.resize(size);
+    m_cadence.resize(size);
+}
+
+void SampleColumns::clear()
+{
+    m_time.clear();
+    m_lat.clear();
+    m_lon.clear();
+    m_ele.clear();
+    m_hr.clear();
+    m_speed.clear();
+    m_cadence.clear();
+}
+
+void SampleColumns::append(const GpsSample &sample)
+{
+    m_time.append(sample.time);
+    m_lat.append(sample.lat);
+    m_lon.append(sample.lon);
+    m_ele.append(sample.ele);
+    m_hr.append(sample.hr);
+    m_speed.append(sample.speed);
+    m_cadence.append(sample.cadence);
+}
+
+GpsSample SampleColumns::at(int i) const
+{
+    GpsSample sample;
+    sample.time = m_time.at(i);
+    sample.lat = m_lat.at(i);
+    sample.lon = m_lon.at(i);
+    sample.ele = m_ele.at(i);
+    sample.hr = m_hr.at(i);
+    sample.speed = m_speed.at(i);
+    sample.cadence = m_cadence.at(i);
+    return sample;
+}
+
+/*!
+    Returns the index of the last sample at or before \a time, or 0 if
+    all samples are after \a time. Same as SampleData::indexOfTime().
+*/
+int SampleColumns::indexOfTime(qint64 time) const
+{
+    const qint64 *begin = m_time.constData();
+    const qint64 *it = std::upper_bound(begin, begin + count(), time);
+    return it == begin ? 0 : int(it - begin) - 1;
+}
+
+qint64 SampleColumns::startTime() const
+{
+    return isEmpty() ? -1 : m_time.first();
+}
+
+qint64 SampleColumns::endTime() const
+{
+    return isEmpty() ? -1 : m_time.last();
+}
+
+float SampleColumns::startAltitude() const
+{
+    return isEmpty() ? -1.0 : m_ele.first();
+}
+
+float SampleColumns::endAltitude() const
+{
+    return isEmpty() ? -1.0 : m_ele.last();
+}
+
+float SampleColumns::averageHR() const
+{
+    const int *hr = m_hr.constData();
+    const int n = count();
+    qint64 sum = 0;
+    for (int i = 0; i < n; ++i)
+        sum += hr[i];
+    return n ? double(sum) / n : 0;
+}
+
+int SampleColumns::maximumHR() const
+{
+    const int *hr = m_hr.constData();
+    const int n = count();
+    int max = 0;
+    for (int i = 0; i < n; ++i)
+        max = hr[i] > max ? hr[i] : max;
+    return max;
+}
+
+/*!
+    Returns the highest recorded speed, and its index in \a index.
+    Returns 0 and an index of -1 if no sample has a speed.
+*/
+float SampleColumns::maximumSpeed(int *index) const
+{
+    const float *speed = m_speed.constData();
+    const int n = count();
+    float max = 0;
+    for (int i = 0; i < n; ++i)
+        max = speed[i] > max ? speed[i] : max;
+    if (index) {
+        *index = -1;
+        if (max > 0)
+            *index = std::find(speed, speed + n, max) - speed;
+    }
+    return max;
+}
+
+/*!
+    Same as SampleData::correctAltitudes()
+*/
+void SampleColumns::correctAltitudes(float startAltitude, float endAltitude)
+{
+    if (!isEmpty() && (startAltitude != -FLT_MAX || endAltitude != -FLT_MAX)) {
+        float startDelta = (startAltitude == -FLT_MAX ? 0 : startAltitude - m_ele.first());
+        float endDelta = (endAltitude == -FLT_MAX ? startDelta : endAltitude - m_ele.last());
+        if (startAltitude == -FLT_MAX)
+            startDelta = endDelta;
+
+        const float ascent = (endDelta - startDelta)/count();
+        float *ele = m_ele.data();
+        const int n = count();
+        for (int i = 0; i < n; ++i)
+            ele[i] += startDelta + ascent * i;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef SAMPLECOLUMNS_H
+#define SAMPLECOLUMNS_H
+
+#include <QtCore/qvector.h>
+#include <float.h>
+#include "gpssample.h"
+
+/*
+    A structure-of-arrays variant of SampleData. Every field of GpsSample is
+    stored in its own contiguous column, so passes that only look at one field
+    (HR statistics, time lookups, altitude correction) only touch that column
+    and can be vectorized by the compiler.
+    The interface mirrors SampleData where it makes sense.
+*/
+class SampleColumns {
+public:
+    SampleColumns() {}
+    explicit SampleColumns(const SampleData &samples);
+    SampleData toSampleData() const;
+
+    int count() const { return m_time.count(); }
+    bool isEmpty() const { return m_time.isEmpty(); }
+    void reserve(int size);
+    void resize(int size);
+    void clear();
+    void append(const GpsSample &sample);
+    GpsSample at(int i) const;
+
+    // Column accessors
+    const qint64 *time() const { return m_time.constData(); }
+    const double *lat() const { return m_lat.constData(); }
+    const double *lon() const { return m_lon.constData(); }
+    const float *ele() const { return m_ele.constData(); }
+    const int *hr() const { return m_hr.constData(); }
+    const float *speed() const { return m_speed.constData(); }
+    const int *cadence() const { return m_cadence.constData(); }
+    qint64 *time() { return m_time.data(); }
+    double *lat() { return m_lat.data(); }
+    double *lon() { return m_lon.data(); }
+    float *ele() { return m_ele.data(); }
+    int *hr() { return m_hr.data(); }
+    float *speed() { return m_speed.data(); }
+    int *cadence() { return m_cadence.data(); }
+
+    int indexOfTime(qint64 time) const;
+
+    qint64 startTime() const;
+    qint64 endTime() const;
+
+    float startAltitude() const;
+    float endAltitude() const;
+
+    float averageHR() const;
+    int maximumHR() const;
+    float maximumSpeed(int *index = 0) const;
+
+    void correctAltitudes(float startAltitude, float endAltitude = -FLT_MAX);
+
+    SampleData::MetaData metaData;
+
+private:
+    QVector<qint64> m_time;
+    QVector<double> m_lat;
+    QVector<double> m_lon;
+    QVector<float> m_ele;
+    QVector<int> m_hr;
+    QVector<float> m_speed;
+    QVector<int> m_cadence;
+};
+
+#endif // SAMPLECOLUMNS_H
@@ -0,0 +1,135 @@
+#include "samplestatistics.h"
+#include "geo.h"
+
+SampleStatistics::SampleStatistics()
+    : m_count(0), m_firstIndex(0),
+      m_hrSum(0), m_maxHR(0), m_ascent(0), m_descent(0), m_distance(0), m_distanceError(0),
+      m_maxSampleSpeed(0), m_maxSampleSpeedIndex(-1), m_maxSegmentSpeed(0), m_maxSegmentSpeedIndex(-1)
+{
+}
+
+SampleStatistics::SampleStatistics(const SampleData &samples)
+    : m_count(0), m_firstIndex(0),
+      m_hrSum(0), m_maxHR(0), m_ascent(0), m_descent(0), m_distance(0), m_distanceError(0),
+      m_maxSampleSpeed(0), m_maxSampleSpeedIndex(-1), m_maxSegmentSpeed(0), m_maxSegmentSpeedIndex(-1)
+{
+    addSamples(samples.constData(), samples.count(), 0);
+}
+
+/*!
+    Adds \a count samples, which are the samples starting at \a firstIndex in
+    the SampleData. The samples must follow directly after the samples that
+    were added before.
+*/
+void SampleStatistics::addSamples(const GpsSample *samples, int count, int firstIndex)
+{
+    if (count <= 0)
+        return;
+    if (m_count == 0) {
+        m_first = samples[0];
+        m_firstIndex = firstIndex;
+        m_maxHR = samples[0].hr;
+        addSample(samples[0], firstIndex);
+    } else {
+        addSample(samples[0], firstIndex);
+        addSegment(m_last, samples[0], firstIndex,
+                   segmentDistance(m_last.lat, m_last.lon, samples[0].lat, samples[0].lon));
+    }
+
+    // The distances are computed a block at a time with the batch functions
+    enum { BlockSize = 256 };
+    double distances[BlockSize];
+    for (int block = 0; block < count - 1; block += BlockSize) {
+        const int segments = qMin(int(BlockSize), count - 1 - block);
+        segmentDistances(&samples[block].lat, &samples[block].lon, segments + 1, distances, sizeof(GpsSample));
+        for (int j = 0; j < segments; ++j) {
+            const int i = block + j + 1;
+            addSample(samples[i], firstIndex + i);
+            addSegment(samples[i - 1], samples[i], firstIndex + i, distances[j]);
+        }
+    }
+    m_count += count;
+    m_last = samples[count - 1];
+}
+
+void SampleStatistics::addSample(const GpsSample &sample, int index)
+{
+    m_hrSum += sample.hr;
+    m_maxHR = qMax(sample.hr, m_maxHR);
+    if (sample.speed > m_maxSampleSpeed) {
+        m_maxSampleSpeed = sample.speed;
+        m_maxSampleSpeedIndex = index;
+    }
+}
+
+void SampleStatistics::addSegment(const GpsSample &prev, const GpsSample &curr, int index, double dist)
+{
+    const float climb = curr.ele - prev.ele;
+    if (climb > 0)
+        m_ascent += climb;
+    else
+        m_descent -= climb;
+
+    addDistance(dist);
+    if (curr.time != prev.time) {
+        const double speed = dist * 3600000.0 /(curr.time - prev.time);
+        if (speed > m_maxSegmentSpeed) {
+            m_maxSegmentSpeed = speed;
+            m_maxSegmentSpeedIndex = index;
+        }
+    }
+}
+
+void SampleStatistics::addDistance(double dist)
+{
+    const double y = dist - m_distanceError;
+    const double t = m_distance + y;
+    m_distanceError = (t - m_distance) - y;
+    m_distance = t;
+}
+
+/*!
+    Adds the statistics of \a other, which must be the statistics of the
+    samples directly following the samples of this.
+*/
+void SampleStatistics::combine(const SampleStatistics &other)
+{
+    if (other.m_count == 0)
+        return;
+    if (m_count == 0) {
+        *this = other;
+        return;
+    }
+    addSegment(m_last, other.m_first, other.m_firstIndex,
+               segmentDistance(m_last.lat, m_last.lon, other.m_first.lat, other.m_first.lon));
+    addDistance(other.m_distance);
+    addDistance(-other.m_distanceError);
+    m_ascent += other.m_ascent;
+    m_descent += other.m_descent;
+    m_hrSum += other.m_hrSum;
+    m_maxHR = qMax(m_maxHR, other.m_maxHR);
+    if (other.m_maxSampleSpeed > m_maxSampleSpeed) {
+        m_maxSampleSpeed = other.m_maxSampleSpeed;
+        m_maxSampleSpeedIndex = other.m_maxSampleSpeedIndex;
+    }
+    if (other.m_maxSegmentSpeed > m_maxSegmentSpeed) {
+        m_maxSegmentSpeed = other.m_maxSegmentSpeed;
+        m_maxSegmentSpeedIndex = other.m_maxSegmentSpeedIndex;
+    }
+    m_count += other.m_count;
+    m_last = other.m_last;
+}
+
+double SampleStatistics::maximumSpeed() const
+{
+    if (m_first.speed == -1 && m_maxSegmentSpeed >= m_maxSampleSpeed)
+        return m_maxSegmentSpeed;
+    return m_maxSampleSpeed;
+}
+
+int SampleStatistics::maximumSpeedIndex() const
+{
+    if (m_first.speed == -1 && m_maxSegmentSpeed >= m_maxSampleSpeed)
+        return m_maxSegmentSpeedIndex;
+    return m_maxSampleSpeedIndex;
+}
@@ -0,0 +1,66 @@
+#ifndef SAMPLESTATISTICS_H
+#define SAMPLESTATISTICS_H
+
+#include "gpssample.h"
+
+/*
+    Summary of a SampleData, gathered in a single pass over the samples.
+
+    A SampleStatistics can be fed a range of samples at a time, and two
+    statistics of adjacent ranges can be combined into the statistics of the
+    whole range. SampleData::statistics() uses this to split large tracks in
+    chunks that are summed up in parallel.
+
+    The maximum speed is found like SampleData::print() always did: if the
+    first sample has no speed (GPX data), the speed of each segment between
+    two samples is considered as well as the speed of the samples themselves.
+*/
+class SampleStatistics {
+public:
+    SampleStatistics();
+    explicit SampleStatistics(const SampleData &samples);
+
+    void addSamples(const GpsSample *samples, int count, int firstIndex);
+    void combine(const SampleStatistics &other);
+
+    int count() const { return m_count; }
+    bool isEmpty() const { return m_count == 0; }
+
+    qint64 startTime() const { return m_count ? m_first.time : -1; }
+    qint64 endTime() const { return m_count ? m_last.time : -1; }
+    float startAltitude() const { return m_count ? m_first.ele : -1.0f; }
+    float endAltitude() const { return m_count ? m_last.ele : -1.0f; }
+    double ascent() const { return m_ascent; }
+    double descent() const { return m_descent; }
+
+    double averageHR() const { return double(m_hrSum) / m_count; }
+    int maximumHR() const { return m_maxHR; }
+
+    double distance() const { return m_distance; }
+    double maximumSpeed() const;
+    int maximumSpeedIndex() const;
+
+private:
+    void addSample(const GpsSample &sample, int index);
+    void addSegment(const GpsSample &prev, const GpsSample &curr, int index, double dist);
+    void addDistance(double dist);
+
+    int m_count;
+    int m_firstIndex;
+    GpsSample m_first;
+    GpsSample m_last;
+
+    qint64 m_hrSum;
+    int m_maxHR;
+    double m_ascent;
+    double m_descent;
+    double m_distance;
+    double m_distanceError;     // Kahan compensation of m_distance
+
+    double m_maxSampleSpeed;
+    int m_maxSampleSpeedIndex;
+    double m_maxSegmentSpeed;   // computed from positions
+    int m_maxSegmentSpeedIndex;
+};
+
+#endif // SAMPLESTATISTICS_H
@@ -3,30 +3,18 @@
 ######################################################################
 
 TEMPLATE = app
-QT += core gui
+QT += core gui concurrent
 TARGET = hrmgpx
 DESTDIR = bin
 #DEPENDPATH += .
 INCLUDEPATH += .
 
 # Input
-SOURCES += main.cpp \
-    gpxparser.cpp \
-    hrmparser.cpp \
-    gpssample.cpp \ 
-    geo.cpp \
-    geolocationinterpolator.cpp \
-    geolocationiterator.cpp
+SOURCES += main.cpp
 
-CONFIG += console
+include(hrmgpx.pri)
 
-HEADERS += \
-    gpxparser.h \
-    hrmparser.h \
-    gpssample.h \
-    geo.h \
-    geolocationinterpolator.h \
-    geolocationiterator.h
+CONFIG += console
 
 exists(hrmcom/hrmcom.pri) {
     include(hrmcom/hrmcom.pri)
@@ -0,0 +1,108 @@
+#include "timeindex.h"
+#include "gpssample.h"
+
+#include <algorithm>
+
+TimeIndex::TimeIndex()
+    : m_interval(0), m_gridCount(0), m_monotonic(true)
+{
+}
+
+TimeIndex::TimeIndex(const SampleData &samples)
+    : m_interval(0), m_gridCount(0), m_monotonic(true)
+{
+    const int n = samples.count();
+    m_times.resize(n);
+    qint64 *times = m_times.data();
+    for (int i = 0; i < n; ++i) {
+        times[i] = samples.at(i).time;
+        if (i > 0 && times[i] < times[i - 1])
+            m_monotonic = false;
+    }
+
+    if (m_monotonic && n >= 3 && times[1] > times[0]) {
+        const qint64 interval = times[1] - times[0];
+        int gridCount = 2;
+        while (gridCount < n && times[gridCount] - times[gridCount - 1] == interval)
+            ++gridCount;
+        if (gridCount >= n - 1) {
+            m_interval = interval;
+            m_gridCount = gridCount;
+        }
+    }
+}
+
+/*
+    Returns the last index in [lo, hi) with a time at or before \a time, given that
+    times[lo] <= time < times[hi] (or hi == count). The search starts at \a from and
+    doubles its step until the time is bracketed, then finishes with a binary search.
+    The cost is logarithmic in the distance between \a from and the result.
+*/
+int TimeIndex::gallop(qint64 time, int from, int lo, int hi) const
+{
+    const qint64 *times = m_times.constData();
+    from = qBound(lo, from, hi - 1);
+    int step = 1;
+    if (times[from] <= time) {
+        lo = from;
+        while (lo + step < hi && times[lo + step] <= time) {
+            lo += step;
+            step *= 2;
+        }
+        hi = qMin(lo + step, hi);
+    } else {
+        hi = from;
+        while (hi - step > lo && times[hi - step] > time) {
+            hi -= step;
+            step *= 2;
+        }
+        lo = qMax(hi - step, lo);
+    }
+    return int(std::upper_bound(times + lo, times + hi, time) - times) - 1;
+}
+
+/*!
+    Returns the index of the last sample at or before \a time, or 0 if all
+    samples are after \a time.
+*/
+int TimeIndex::indexOf(qint64 time) const
+{
+    const int n = m_times.count();
+    const qint64 *times = m_times.constData();
+    if (!m_monotonic) {
+        const int i = int(std::upper_bound(times, times + n, time) - times);
+        return i > 0 ? i - 1 : 0;
+    }
+    if (n == 0 || time < times[0])
+        return 0;
+    if (time >= times[n - 1])
+        return n - 1;
+
+    if (m_interval > 0) {
+        const qint64 i = (time - times[0]) / m_interval;
+        if (i < m_gridCount - 1)
+            return int(i);
+        return gallop(time, m_gridCount - 1, m_gridCount - 1, n);
+    }
+
+    // times[0] <= time < times[n - 1]: interpolate a guess and gallop from there
+    const double fraction = double(time - times[0]) / double(times[n - 1] - times[0]);
+    return gallop(time, int(fraction * (n - 1)), 0, n);
+}
+
+/*!
+    Same as indexOf(), but searches outwards from \a hint, typically the result
+    of the previous lookup. Sequential lookups are then constant time.
+*/
+int TimeIndex::indexOf(qint64 time, int hint) const
+{
+    const int n = m_times.count();
+    const qint64 *times = m_times.constData();
+    if (!m_monotonic || m_interval > 0)
+        return indexOf(time);
+    if (n == 0 || time < times[0])
+        return 0;
+    if (time >= times[n - 1])
+        return n - 1;
+    return gallop(time, hint, 0, n);
+}
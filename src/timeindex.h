@@ -0,0 +1,45 @@
+#ifndef TIMEINDEX_H
+#define TIMEINDEX_H
+
+#include <QtCore/qvector.h>
+
+class SampleData;
+
+/*
+    Maps a time to the index of the last sample at or before it, like
+    SampleData::indexOfTime(), but close to constant time:
+
+    - Samples on a fixed interval (HRM data) are found arithmetically. The
+      extra sample HRMReader appends at the time the monitor was stopped is
+      allowed to be off the grid.
+    - Other time-sorted data (GPX) is found with interpolation search, with a
+      galloping search around the guess in case the data is not uniform.
+    - Data that is not sorted by time falls back to a binary search, which
+      gives the same result as SampleData::indexOfTime().
+
+    The index keeps its own copy of the timestamps, so it stays valid if the
+    SampleData it was built from is modified (but will then be stale).
+*/
+class TimeIndex {
+public:
+    TimeIndex();
+    explicit TimeIndex(const SampleData &samples);
+
+    int indexOf(qint64 time) const;
+    int indexOf(qint64 time, int hint) const;
+
+    int count() const { return m_times.count(); }
+    bool isMonotonic() const { return m_monotonic; }
+    bool hasFixedInterval() const { return m_interval > 0; }
+    qint64 interval() const { return m_interval; }
+
+private:
+    int gallop(qint64 time, int from, int lo, int hi) const;
+
+    QVector<qint64> m_times;
+    qint64 m_interval;      // 0 if the data is not on a fixed interval
+    int m_gridCount;        // number of leading samples on the fixed interval
+    bool m_monotonic;
+};
+
+#endif // TIMEINDEX_H
@@ -0,0 +1,117 @@
+#include "timestampformatter.h"
+#include <QtCore/qdatetime.h>
+
+#include <string.h>
+
+#include "iso8601.h"
+
+static inline qint64 floorDivide(qint64 value, qint64 divisor)
+{
+    return value >= 0 ? value / divisor : (value - divisor + 1) / divisor;
+}
+
+static inline void writeTwoDigits(char *out, int value)
+{
+    out[0] = char('0' + value / 10);
+    out[1] = char('0' + value % 10);
+}
+
+TimestampFormatter::TimestampFormatter(TimeSpec spec)
+    : m_spec(spec), m_offset(0), m_offsetFrom(0), m_offsetUntil(0),
+      m_minute(Q_INT64_C(0x7fffffffffffffff))
+{
+    if (spec == UTC) {
+        m_offsetFrom = Q_INT64_C(-0x7fffffffffffffff) - 1;
+        m_offsetUntil = Q_INT64_C(0x7fffffffffffffff);
+    } else {
+        m_zone = QTimeZone::systemTimeZone();
+    }
+}
+
+/*
+    Returns the UTC offset in milliseconds at \a msecsSinceEpoch, and caches it
+    from that time until the next transition. Without transition data the
+    offset is cached until the next quarter of an hour, which is the finest
+    granularity of DST changes in use.
+*/
+qint64 TimestampFormatter::offsetAt(qint64 msecsSinceEpoch)
+{
+    if (msecsSinceEpoch >= m_offsetFrom && msecsSinceEpoch < m_offsetUntil)
+        return m_offset;
+
+    const QDateTime dt = QDateTime::fromMSecsSinceEpoch(msecsSinceEpoch);
+    m_offsetFrom = msecsSinceEpoch;
+    if (m_zone.isValid() && m_zone.hasTransitions()) {
+        m_offset = m_zone.offsetFromUtc(dt) * Q_INT64_C(1000);
+        const QDateTime next = m_zone.nextTransition(dt).atUtc;
+        m_offsetUntil = next.isValid() ? next.toMSecsSinceEpoch() : Q_INT64_C(0x7fffffffffffffff);
+    } else {
+        m_offset = dt.offsetFromUtc() * Q_INT64_C(1000);
+        m_offsetUntil = (floorDivide(msecsSinceEpoch, 900000) + 1) * 900000;
+    }
+    return m_offset;
+}
+
+void TimestampFormatter::updatePrefix(qint64 minute)
+{
+    int year, month, day;
+    civilFromDays(floorDivide(minute, 1440), &year, &month, &day);
+    const int minuteOfDay = int(minute - floorDivide(minute, 1440) * 1440);
+    writeTwoDigits(m_prefix, year / 100 % 100);
+    writeTwoDigits(m_prefix + 2, year % 100);
+    m_prefix[4] = '-';
+    writeTwoDigits(m_prefix + 5, month);
+    m_prefix[7] = '-';
+    writeTwoDigits(m_prefix + 8, day);
+    m_prefix[10] = 'T';
+    writeTwoDigits(m_prefix + 11, minuteOfDay / 60);
+    m_prefix[13] = ':';
+    writeTwoDigits(m_prefix + 14, minuteOfDay % 60);
+    m_prefix[16] = ':';
+    m_minute = minute;
+}
+
+/*!
+    Writes \a msecsSinceEpoch to \a out and returns a pointer past the last
+    character written. Years outside [1, 9999] go through QDateTime, which has
+    no year 0.
+*/
+char *TimestampFormatter::format(qint64 msecsSinceEpoch, char *out)
+{
+    const qint64 local = msecsSinceEpoch + offsetAt(msecsSinceEpoch);
+    const qint64 minute = floorDivide(local, 60000);
+    if (minute != m_minute) {
+        // 0001-01-01T00:00 and 9999-12-31T23:59 local time, in minutes
+        if (minute < Q_INT64_C(-1035593280) || minute > Q_INT64_C(4223371679)) {
+            const QDateTime dt = m_spec == UTC
+                    ? QDateTime::fromMSecsSinceEpoch(msecsSinceEpoch, Qt::UTC)
+                    : QDateTime::fromMSecsSinceEpoch(msecsSinceEpoch);
+            const QByteArray str = dt.toString(QLatin1String("yyyy-MM-ddThh:mm:ss.zzz")).toLatin1();
+            const int length = qMin(str.size(), int(MaxLength) - 1);
+            memcpy(out, str.constData(), length);
+            out += length;
+            if (m_spec == UTC)
+                *out++ = 'Z';
+            return out;
+        }
+        updatePrefix(minute);
+    }
+
+    const int msecs = int(local - minute * 60000);
+    memcpy(out, m_prefix, sizeof(m_prefix));
+    out += sizeof(m_prefix);
+    writeTwoDigits(out, msecs / 1000);
+    out[2] = '.';
+    out[3] = char('0' + msecs / 100 % 10);
+    writeTwoDigits(out + 4, msecs % 100);
+    out += 6;
+    if (m_spec == UTC)
+        *out++ = 'Z';
+    return out;
+}
+
+QString TimestampFormatter::toString(qint64 msecsSinceEpoch)
+{
+    char buffer[MaxLength];
+    return QString::fromLatin1(buffer, format(msecsSinceEpoch, buffer) - buffer);
+}
@@ -0,0 +1,47 @@
+#ifndef TIMESTAMPFORMATTER_H
+#define TIMESTAMPFORMATTER_H
+
+#include <QtCore/qstring.h>
+#include <QtCore/qtimezone.h>
+
+/*
+    Formats milliseconds since the epoch as yyyy-MM-ddThh:mm:ss.zzz, either in
+    local time like msToDateTimeString() or in UTC with a Z suffix.
+
+    Made for the mostly increasing timestamps of a track: the UTC offset is
+    cached until the next DST transition of the system time zone, and the
+    yyyy-MM-ddThh:mm: prefix until the minute changes, so a typical call only
+    writes the seconds and milliseconds.
+*/
+class TimestampFormatter {
+public:
+    enum TimeSpec {
+        LocalTime,
+        UTC
+    };
+
+    // yyyy-MM-ddThh:mm:ss.zzzZ, with up to nine digits and a sign for the year
+    enum { MaxLength = 32 };
+
+    explicit TimestampFormatter(TimeSpec spec = LocalTime);
+
+    TimeSpec timeSpec() const { return m_spec; }
+
+    // Writes at most MaxLength characters to out, without a terminating null
+    char *format(qint64 msecsSinceEpoch, char *out);
+    QString toString(qint64 msecsSinceEpoch);
+
+private:
+    qint64 offsetAt(qint64 msecsSinceEpoch);
+    void updatePrefix(qint64 minute);
+
+    TimeSpec m_spec;
+    QTimeZone m_zone;
+    qint64 m_offset;            // ms from UTC to local time
+    qint64 m_offsetFrom;        // UTC range [m_offsetFrom, m_offsetUntil) where m_offset is valid
+    qint64 m_offsetUntil;
+    qint64 m_minute;            // local minutes since the epoch of m_prefix
+    char m_prefix[17];          // yyyy-MM-ddThh:mm:
+};
+
+#endif // TIMESTAMPFORMATTER_H
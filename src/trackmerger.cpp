@@ -0,0 +1,59 @@
+#include "trackmerger.h"
+#include "timeindex.h"
+
+/*!
+    Appends the track points of \a gpx between \a startTime and \a endTime to
+    \a merged, with HR and speed taken from \a hrm. The first and last track
+    points are moved to \a startTime and \a endTime, so that the merged track
+    covers the whole HRM recording.
+*/
+void TrackMerger::merge(const SampleData &gpx, const SampleData &hrm, qint64 startTime, qint64 endTime,
+                        SampleData *merged) const
+{
+    merged->metaData.activity = hrm.metaData.activity;
+    merged->metaData.name = gpx.metaData.name;
+    merged->metaData.description = gpx.metaData.description;
+
+    const int gpxStart = gpx.indexOfTime(startTime);
+    const int gpxEnd = gpx.indexOfTime(endTime);
+    if (gpxStart >= gpxEnd || hrm.isEmpty())
+        return;
+    merged->reserve(merged->count() + gpxEnd - gpxStart);
+
+    const GpsSample *hrmSamples = hrm.constData();
+    const int hrmCount = hrm.count();
+    const TimeIndex hrmIndex = hrm.buildTimeIndex();
+    int j = hrmIndex.indexOf(startTime);
+    for (int i = gpxStart; i < gpxEnd; ++i) {
+        GpsSample sample = gpx.at(i);
+        if (i == gpxStart)
+            sample.time = startTime;
+        if (i == gpxEnd - 1) {
+            if (sample.time < endTime)
+                sample.time = endTime;
+        }
+        if (sample.time > endTime) {
+            sample.time = endTime;
+            i = gpxEnd;     // finish iteration and leave loop
+        }
+
+        // The last HRM sample at or before the track point. The previous one is
+        // the hint, so this is constant time unless the track went back in time.
+        j = hrmIndex.indexOf(sample.time, j);
+
+        const GpsSample &prev = hrmSamples[j];
+        if (m_interpolation == Linear && j + 1 < hrmCount && prev.time <= sample.time) {
+            const GpsSample &next = hrmSamples[j + 1];
+            const double progress = double(sample.time - prev.time) / (next.time - prev.time);
+            sample.hr = qRound(prev.hr + (next.hr - prev.hr) * progress);
+            sample.speed = prev.speed + (next.speed - prev.speed) * progress;
+            sample.cadence = prev.cadence < 0 || next.cadence < 0
+                    ? prev.cadence : qRound(prev.cadence + (next.cadence - prev.cadence) * progress);
+        } else {
+            sample.hr = prev.hr;
+            sample.speed = prev.speed;
+            sample.cadence = prev.cadence;
+        }
+        merged->append(sample);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef TRACKMERGER_H
+#define TRACKMERGER_H
+
+#include "gpssample.h"
+
+/*
+    Merges HR, speed and cadence from HRM data into the track points of GPX data.
+    Both inputs must be sorted by time. The merge is a single forward sweep
+    over the GPX data, with the HRM samples found through a TimeIndex, so it
+    runs in O(n + m).
+*/
+class TrackMerger {
+public:
+    enum Interpolation {
+        PreviousSample,     // take HR, speed and cadence from the last HRM sample at or before the track point
+        Linear              // interpolate HR, speed and cadence between the surrounding HRM samples
+    };
+
+    TrackMerger() : m_interpolation(PreviousSample) {}
+
+    void setInterpolation(Interpolation interpolation) { m_interpolation = interpolation; }
+    Interpolation interpolation() const { return m_interpolation; }
+
+    void merge(const SampleData &gpx, const SampleData &hrm, qint64 startTime, qint64 endTime,
+               SampleData *merged) const;
+
+private:
+    Interpolation m_interpolation;
+};
+
+#endif // TRACKMERGER_H
@@ -0,0 +1,234 @@
+#include "tracksimplifier.h"
+
+#include <algorithm>
+#include <math.h>
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+// A sample as a unit vector from the centre of the earth (x towards lon 0,
+// z towards the north pole), so distances need no map projection
+struct TrackSimplifier::Point {
+    double v[3];
+    double time;
+    double ele;
+    double hr;
+};
+
+TrackSimplifier::TrackSimplifier()
+    : m_method(DouglasPeucker), m_tolerance(5.0), m_elevationTolerance(2.0), m_hrTolerance(3.0)
+{
+}
+
+static const double EarthRadius = 6371000.0;
+
+static double interpolate(double from, double to, double progress)
+{
+    return from + (to - from) * progress;
+}
+
+static inline void cross(const double *a, const double *b, double *result)
+{
+    result[0] = a[1] * b[2] - a[2] * b[1];
+    result[1] = a[2] * b[0] - a[0] * b[2];
+    result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline double dot(const double *a, const double *b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline double chord(const double *a, const double *b)
+{
+    const double d[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    return sqrt(dot(d, d));
+}
+
+/*
+    Returns how much sample \a i deviates from the line between \a a and \a b,
+    as a multiple of the tolerances. Samples with an error of at most 1 may be
+    removed.
+*/
+double TrackSimplifier::error(const Point *points, int a, int i, int b) const
+{
+    const Point &p = points[i];
+    const Point &pa = points[a];
+    const Point &pb = points[b];
+    const double duration = pb.time - pa.time;
+    const double progress = duration > 0 ? (p.time - pa.time) / duration : 0.0;
+    double result = qMax(qAbs(p.ele - interpolate(pa.ele, pb.ele, progress)) / m_elevationTolerance,
+                         qAbs(p.hr - interpolate(pa.hr, pb.hr, progress)) / m_hrTolerance);
+
+    if (m_method == VisvalingamWhyatt) {
+        // Area of the triangle projected on the plane through p that touches
+        // the earth, so samples on one great circle have no area
+        double normal[3];
+        cross(pa.v, pb.v, normal);
+        const double area = qAbs(dot(p.v, normal)) / 2 * EarthRadius * EarthRadius;
+        result = qMax(result, area / (m_tolerance * m_tolerance));
+    } else {
+        // Distance to the great circle through a and b (the cross-track
+        // distance), which is exact however long the segment is
+        double normal[3];
+        cross(pa.v, pb.v, normal);
+        const double length = sqrt(dot(normal, normal));
+        const double distance = length > 1e-15
+                ? asin(qMin(1.0, qAbs(dot(p.v, normal)) / length)) * EarthRadius
+                : chord(pa.v, p.v) * EarthRadius;
+        result = qMax(result, distance / m_tolerance);
+    }
+    return result;
+}
+
+/*
+    Each pass over a range costs its length, so a track where every split
+    only takes one sample off the end (a spiral, say) needs O(n^2) error
+    evaluations. Real tracks split near the middle and take O(n log n).
+*/
+void TrackSimplifier::douglasPeucker(const Point *points, int count, QVector<bool> *keep) const
+{
+    QVector<QPair<int, int> > stack;
+    stack.append(qMakePair(0, count - 1));
+    while (!stack.isEmpty()) {
+        const QPair<int, int> range = stack.last();
+        stack.removeLast();
+        double worst = 1.0;
+        int worstIndex = -1;
+        for (int i = range.first + 1; i < range.second; ++i) {
+            const double e = error(points, range.first, i, range.second);
+            if (e > worst) {
+                worst = e;
+                worstIndex = i;
+            }
+        }
+        if (worstIndex != -1) {
+            (*keep)[worstIndex] = true;
+            stack.append(qMakePair(range.first, worstIndex));
+            stack.append(qMakePair(worstIndex, range.second));
+        } else {
+            // Keep the samples that were forced (extrema) by splitting there
+            for (int i = range.first + 1; i < range.second; ++i) {
+                if (keep->at(i)) {
+                    stack.append(qMakePair(range.first, i));
+                    stack.append(qMakePair(i, range.second));
+                    break;
+                }
+            }
+        }
+    }
+}
+
+struct HeapEntry {
+    double error;
+    int index;
+    int version;
+    bool operator<(const HeapEntry &other) const { return error > other.error; }   // min-heap
+};
+
+void TrackSimplifier::visvalingamWhyatt(const Point *points, int count, QVector<bool> *keep) const
+{
+    QVector<int> prev(count);
+    QVector<int> next(count);
+    QVector<int> version(count, 0);
+    QVector<HeapEntry> heap;
+    heap.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        prev[i] = i - 1;
+        next[i] = i + 1;
+    }
+    for (int i = 1; i < count - 1; ++i) {
+        if (keep->at(i))
+            continue;
+        HeapEntry entry = { error(points, i - 1, i, i + 1), i, 0 };
+        heap.append(entry);
+    }
+    std::make_heap(heap.begin(), heap.end());
+
+    QVector<bool> removed(count, false);
+    double lastError = 0;
+    while (!heap.isEmpty()) {
+        std::pop_heap(heap.begin(), heap.end());
+        const HeapEntry entry = heap.last();
+        heap.removeLast();
+        if (entry.version != version.at(entry.index))
+            continue;   // stale, the neighbours changed since
+        // The error of a sample is at least the error of the samples removed
+        // before it, since it also stands in for them
+        const double e = qMax(entry.error, lastError);
+        if (e > 1.0)
+            break;
+        lastError = e;
+        const int i = entry.index;
+        removed[i] = true;
+        const int a = prev.at(i);
+        const int b = next.at(i);
+        next[a] = b;
+        prev[b] = a;
+        if (a > 0 && !keep->at(a)) {
+            HeapEntry updated = { error(points, prev.at(a), a, b), a, ++version[a] };
+            heap.append(updated);
+            std::push_heap(heap.begin(), heap.end());
+        }
+        if (b < count - 1 && !keep->at(b)) {
+            HeapEntry updated = { error(points, a, b, next.at(b)), b, ++version[b] };
+            heap.append(updated);
+            std::push_heap(heap.begin(), heap.end());
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        if (!removed.at(i))
+            (*keep)[i] = true;
+    }
+}
+
+/*!
+    Returns the samples of \a samples that are needed to keep its shape within
+    the tolerances.
+*/
+SampleData TrackSimplifier::simplify(const SampleData &samples) const
+{
+    const int count = samples.count();
+    if (count <= 2)
+        return samples;
+
+    const double toRadians = M_PI / 180.0;
+    QVector<Point> points(count);
+    QVector<bool> keep(count, false);
+    int minHR = 0, maxHR = 0, minEle = 0, maxEle = 0;
+    for (int i = 0; i < count; ++i) {
+        const GpsSample &sample = samples.at(i);
+        Point &point = points[i];
+        const double lat = sample.lat * toRadians;
+        const double lon = sample.lon * toRadians;
+        point.v[0] = cos(lat) * cos(lon);
+        point.v[1] = cos(lat) * sin(lon);
+        point.v[2] = sin(lat);
+        point.time = sample.time - samples.at(0).time;
+        point.ele = sample.ele;
+        point.hr = sample.hr;
+        if (sample.hr < samples.at(minHR).hr)
+            minHR = i;
+        if (sample.hr > samples.at(maxHR).hr)
+            maxHR = i;
+        if (sample.ele < samples.at(minEle).ele)
+            minEle = i;
+        if (sample.ele > samples.at(maxEle).ele)
+            maxEle = i;
+    }
+    keep[0] = keep[count - 1] = true;
+    keep[minHR] = keep[maxHR] = keep[minEle] = keep[maxEle] = true;
+
+    if (m_method == VisvalingamWhyatt)
+        visvalingamWhyatt(points.constData(), count, &keep);
+    else
+        douglasPeucker(points.constData(), count, &keep);
+
+    SampleData result;
+    result.metaData = samples.metaData;
+    for (int i = 0; i < count; ++i) {
+        if (keep.at(i))
+            result.append(samples.at(i));
+    }
+    return result;
+}
@@ -0,0 +1,57 @@
+#ifndef TRACKSIMPLIFIER_H
+#define TRACKSIMPLIFIER_H
+
+#include "gpssample.h"
+
+/*
+    Removes samples that add little to the shape of a track.
+
+    A sample may be removed if it is within tolerance() meters of the line
+    between the samples kept around it, and its elevation and HR are within
+    elevationTolerance() and hrTolerance() of the values interpolated (by
+    time) between them. Peaks and dips of HR and elevation therefore survive,
+    and so do the first and last sample and the samples with the minimum and
+    maximum HR and elevation of the whole track.
+
+    Douglas-Peucker keeps splitting at the worst sample with an explicit stack
+    (no recursion), measuring the distance to the great circle between the
+    kept samples so long segments are not distorted by a map projection. It
+    takes O(n log n) on real tracks, but O(n^2) when every split only takes a
+    sample off the end of its range. Visvalingam-Whyatt removes the least significant sample
+    first, with a heap, in O(n log n). For Visvalingam-Whyatt the distance
+    criterion is the area of the triangle with the neighbours, compared to
+    tolerance() squared.
+*/
+class TrackSimplifier {
+public:
+    enum Method {
+        DouglasPeucker,
+        VisvalingamWhyatt
+    };
+
+    TrackSimplifier();
+
+    void setMethod(Method method) { m_method = method; }
+    Method method() const { return m_method; }
+    void setTolerance(double meters) { m_tolerance = meters; }
+    double tolerance() const { return m_tolerance; }
+    void setElevationTolerance(double meters) { m_elevationTolerance = meters; }
+    double elevationTolerance() const { return m_elevationTolerance; }
+    void setHRTolerance(double bpm) { m_hrTolerance = bpm; }
+    double hrTolerance() const { return m_hrTolerance; }
+
+    SampleData simplify(const SampleData &samples) const;
+
+private:
+    struct Point;
+    double error(const Point *points, int a, int i, int b) const;
+    void douglasPeucker(const Point *points, int count, QVector<bool> *keep) const;
+    void visvalingamWhyatt(const Point *points, int count, QVector<bool> *keep) const;
+
+    Method m_method;
+    double m_tolerance;
+    double m_elevationTolerance;
+    double m_hrTolerance;
+};
+
+#endif // TRACKSIMPLIFIER_H
@@ -0,0 +1,5 @@
+TARGET = tst_compactsamplestore
+
+include(../tests.pri)
+
+SOURCES += tst_compactsamplestore.cpp
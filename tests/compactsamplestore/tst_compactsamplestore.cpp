@@ -0,0 +1,137 @@
+#include <QtTest/QtTest>
+
+#include "compactsamplestore.h"
+#include "gpxwriter.h"
+
+class TestCompactSampleStore : public QObject {
+    Q_OBJECT
+private slots:
+    void roundTrip();
+    void blockCursor();
+    void interpolatedCoordinates();
+    void gpxOutputUnchanged();
+    void memoryUsage();
+    void empty();
+};
+
+/*
+    A 1 Hz ride as a GPS unit and a Polar HRM record it: coordinates with 7
+    decimals, elevation and speed with one, and some samples without speed
+    or cadence. \a count is not a multiple of the block size on purpose.
+*/
+static SampleData recordedTrack(int count = 1000)
+{
+    SampleData samples;
+    samples.metaData.activity = SampleData::Cycling;
+    samples.metaData.name = QLatin1String("Evening ride");
+    const qint64 start = Q_INT64_C(1306368108000);
+    for (int i = 0; i < count; ++i) {
+        GpsSample sample;
+        sample.time = start + i * 1000 + (i >= count / 2 ? 95000 : 0);
+        sample.lat = qRound64((59.9 + i * 1.3e-5) * 1e7) / 1e7;
+        sample.lon = qRound64((10.7 - i * 2.1e-5) * 1e7) / 1e7;
+        sample.ele = float((1000 + i % 321) / 10.0);
+        sample.hr = 110 + i % 80;
+        sample.speed = i % 97 == 0 ? -1.0f : float((200 + i % 150) / 10.0);
+        sample.cadence = i % 89 == 0 ? -1 : 70 + i % 30;
+        samples.append(sample);
+    }
+    return samples;
+}
+
+static void compareSamples(const SampleData &actual, const SampleData &expected)
+{
+    QCOMPARE(actual.count(), expected.count());
+    for (int i = 0; i < actual.count(); ++i) {
+        const GpsSample &a = actual.at(i);
+        const GpsSample &e = expected.at(i);
+        if (a.time != e.time || a.lat != e.lat || a.lon != e.lon || a.ele != e.ele
+            || a.hr != e.hr || a.speed != e.speed || a.cadence != e.cadence) {
+            QFAIL(qPrintable(QString::fromLatin1("Sample %1 differs").arg(i)));
+        }
+    }
+}
+
+void TestCompactSampleStore::roundTrip()
+{
+    const SampleData samples = recordedTrack();
+    const CompactSampleStore store(samples);
+    QCOMPARE(store.count(), samples.count());
+
+    const SampleData decoded = store.toSampleData();
+    QCOMPARE(decoded.metaData.activity, samples.metaData.activity);
+    QCOMPARE(decoded.metaData.name, samples.metaData.name);
+    compareSamples(decoded, samples);
+}
+
+void TestCompactSampleStore::blockCursor()
+{
+    const SampleData samples = recordedTrack();
+    CompactSampleStore store;
+    for (int i = 0; i < samples.count(); ++i)
+        store.append(samples.at(i));
+
+    SampleData decoded;
+    CompactSampleStore::BlockCursor cursor(store);
+    const GpsSample *block;
+    while (int count = cursor.next(&block)) {
+        QCOMPARE(cursor.index(), decoded.count());
+        QVERIFY(count <= int(CompactSampleStore::BlockSize));
+        for (int i = 0; i < count; ++i)
+            decoded.append(block[i]);
+    }
+    QCOMPARE(cursor.next(&block), 0);
+    compareSamples(decoded, samples);
+}
+
+// Positions that were interpolated between fixes have more than 7 decimals
+void TestCompactSampleStore::interpolatedCoordinates()
+{
+    SampleData samples = recordedTrack(600);
+    for (int i = 300; i < 310; ++i) {
+        samples[i].lat += 1.0 / 3.0 * 1e-7;
+        samples[i].lon -= 1.0 / 7.0 * 1e-7;
+    }
+    compareSamples(CompactSampleStore(samples).toSampleData(), samples);
+}
+
+// Elevation and speed are rounded to the decimal that the GPX writer prints
+void TestCompactSampleStore::gpxOutputUnchanged()
+{
+    SampleData samples = recordedTrack(600);
+    static const float elevations[] = { 12.25f, 12.35f, -0.04f, -0.05f, -12.25f, 0.0f, 8848.86f, 123.456f };
+    for (int i = 0; i < samples.count(); ++i) {
+        samples[i].ele = elevations[i % 8] + (i / 8) * 0.01f;
+        samples[i].speed = i % 97 == 0 ? -1.0f : 17.35f + i * 0.013f;
+    }
+
+    GpxWriter writer(GpxWriter::Compatible);
+    writer.setTimeSpec(TimestampFormatter::UTC);
+    const QByteArray expected = writer.toByteArray(samples);
+    const QByteArray actual = writer.toByteArray(CompactSampleStore(samples).toSampleData());
+    QCOMPARE(actual, expected);
+}
+
+// At least 3x smaller than SampleData
+void TestCompactSampleStore::memoryUsage()
+{
+    const SampleData samples = recordedTrack(100000);
+    const CompactSampleStore store(samples);
+    const qint64 sampleDataSize = qint64(samples.count()) * sizeof(GpsSample);
+    QVERIFY2(store.memoryUsage() * 3 <= sampleDataSize,
+             qPrintable(QString::fromLatin1("%1 bytes per sample")
+                        .arg(double(store.memoryUsage()) / samples.count())));
+}
+
+void TestCompactSampleStore::empty()
+{
+    const CompactSampleStore store((SampleData()));
+    QVERIFY(store.isEmpty());
+    QVERIFY(store.toSampleData().isEmpty());
+    CompactSampleStore::BlockCursor cursor(store);
+    const GpsSample *block;
+    QCOMPARE(cursor.next(&block), 0);
+}
+
+QTEST_GUILESS_MAIN(TestCompactSampleStore)
+#include "tst_compactsamplestore.moc"
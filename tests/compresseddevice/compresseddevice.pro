@@ -0,0 +1,5 @@
+TARGET = tst_compresseddevice
+
+include(../tests.pri)
+
+SOURCES += tst_compresseddevice.cpp
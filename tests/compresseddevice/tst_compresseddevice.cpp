@@ -0,0 +1,293 @@
+#include <QtTest/QtTest>
+
+#include "compresseddevice.h"
+#include "gpxparser.h"
+
+/*
+    Runs every format hrmgpx is built with through CompressedDevice: round
+    trips, concatenated gzip members and zstd frames, truncated and failing
+    streams, and loading compressed GPX files.
+*/
+class TestCompressedDevice : public QObject {
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void roundTrip_data();
+    void roundTrip();
+    void concatenated_data();
+    void concatenated();
+    void truncated_data();
+    void truncated();
+    void finishFailure_data();
+    void finishFailure();
+    void loadGPX_data();
+    void loadGPX();
+};
+
+// Accepts everything written to it until it is made to fail
+class FailingDevice : public QIODevice {
+public:
+    FailingDevice() : failing(false) {}
+    bool failing;
+
+protected:
+    qint64 readData(char *, qint64) Q_DECL_OVERRIDE { return -1; }
+    qint64 writeData(const char *, qint64 size) Q_DECL_OVERRIDE
+    {
+        if (!failing)
+            return size;
+        setErrorString(QLatin1String("No space left on device"));
+        return -1;
+    }
+};
+
+// Compressible, but not trivially, and not a multiple of BlockSize
+static QByteArray testData(int size)
+{
+    QByteArray data(size, Qt::Uninitialized);
+    quint32 state = 2463534242u;
+    for (int i = 0; i < size; ++i) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        data[i] = i % 7 == 0 ? char(state) : char('a' + i % 13);
+    }
+    return data;
+}
+
+static void addFormats()
+{
+    QTest::addColumn<int>("format");
+#ifdef HAVE_ZLIB
+    QTest::newRow("gzip") << int(CompressedDevice::Gzip);
+#endif
+#ifdef HAVE_ZSTD
+    QTest::newRow("zstd") << int(CompressedDevice::Zstd);
+#endif
+}
+
+// Writes \a data in uneven pieces
+static QByteArray compress(const QByteArray &data, CompressedDevice::Format format)
+{
+    QByteArray compressed;
+    QBuffer buffer(&compressed);
+    buffer.open(QIODevice::WriteOnly);
+    CompressedDevice compressor(&buffer, format);
+    if (!compressor.open(QIODevice::WriteOnly))
+        return QByteArray();
+    for (int i = 0; i < data.size(); i += 100003) {
+        if (compressor.write(data.constData() + i, qMin(100003, data.size() - i)) < 0)
+            return QByteArray();
+    }
+    if (!compressor.finish())
+        return QByteArray();
+    return compressed;
+}
+
+// Reads until the end or an error, and returns the result of the last read()
+static qint64 decompress(const QByteArray &compressed, CompressedDevice::Format format, QByteArray *data)
+{
+    QByteArray input = compressed;
+    QBuffer buffer(&input);
+    buffer.open(QIODevice::ReadOnly);
+    CompressedDevice decompressor(&buffer, format);
+    if (!decompressor.open(QIODevice::ReadOnly))
+        return -1;
+    char block[65536];
+    for (;;) {
+        const qint64 read = decompressor.read(block, sizeof(block));
+        if (read <= 0)
+            return read;
+        data->append(block, int(read));
+    }
+}
+
+void TestCompressedDevice::initTestCase()
+{
+#ifdef HAVE_ZLIB
+    QVERIFY(CompressedDevice::isSupported(CompressedDevice::Gzip));
+#endif
+#ifdef HAVE_ZSTD
+    QVERIFY(CompressedDevice::isSupported(CompressedDevice::Zstd));
+#endif
+    QVERIFY(!CompressedDevice::isSupported(CompressedDevice::Uncompressed));
+}
+
+void TestCompressedDevice::roundTrip_data()
+{
+    QTest::addColumn<int>("format");
+    QTest::addColumn<int>("size");
+
+    const int sizes[] = { 0, 1, 1000, CompressedDevice::BlockSize, 3 * CompressedDevice::BlockSize + 17, 5000000 };
+    for (int i = 0; i < int(sizeof(sizes) / sizeof(sizes[0])); ++i) {
+        const QByteArray size = QByteArray::number(sizes[i]) + " bytes";
+#ifdef HAVE_ZLIB
+        QTest::newRow(("gzip, " + size).constData()) << int(CompressedDevice::Gzip) << sizes[i];
+#endif
+#ifdef HAVE_ZSTD
+        QTest::newRow(("zstd, " + size).constData()) << int(CompressedDevice::Zstd) << sizes[i];
+#endif
+    }
+}
+
+void TestCompressedDevice::roundTrip()
+{
+    QFETCH(int, format);
+    QFETCH(int, size);
+
+    const QByteArray data = testData(size);
+    const QByteArray compressed = compress(data, CompressedDevice::Format(format));
+    QVERIFY(!compressed.isEmpty());
+    QCOMPARE(int(CompressedDevice::detectFormat(compressed.left(4))), format);
+
+    QByteArray decompressed;
+    QCOMPARE(decompress(compressed, CompressedDevice::Format(format), &decompressed), qint64(0));
+    QCOMPARE(decompressed.size(), data.size());
+    QVERIFY(decompressed == data);
+}
+
+void TestCompressedDevice::concatenated_data()
+{
+    addFormats();
+}
+
+// Like the output of cat a.gz b.gz, or zstd of several files
+void TestCompressedDevice::concatenated()
+{
+    QFETCH(int, format);
+
+    const QByteArray first = testData(300000);
+    const QByteArray second = testData(1000).toUpper();
+    const QByteArray compressed = compress(first, CompressedDevice::Format(format))
+            + compress(second, CompressedDevice::Format(format))
+            + compress(QByteArray(), CompressedDevice::Format(format));
+
+    QByteArray decompressed;
+    QCOMPARE(decompress(compressed, CompressedDevice::Format(format), &decompressed), qint64(0));
+    QVERIFY(decompressed == first + second);
+}
+
+void TestCompressedDevice::truncated_data()
+{
+    QTest::addColumn<int>("format");
+    QTest::addColumn<int>("missing");
+
+    // -1 cuts the stream in half
+    const int missing[] = { 1, 5, 1000, -1 };
+    for (int i = 0; i < int(sizeof(missing) / sizeof(missing[0])); ++i) {
+        const QByteArray bytes = missing[i] < 0 ? QByteArray("half missing")
+                                                : QByteArray::number(missing[i]) + " bytes missing";
+#ifdef HAVE_ZLIB
+        QTest::newRow(("gzip, " + bytes).constData()) << int(CompressedDevice::Gzip) << missing[i];
+#endif
+#ifdef HAVE_ZSTD
+        QTest::newRow(("zstd, " + bytes).constData()) << int(CompressedDevice::Zstd) << missing[i];
+#endif
+    }
+}
+
+void TestCompressedDevice::truncated()
+{
+    QFETCH(int, format);
+    QFETCH(int, missing);
+
+    const QByteArray data = testData(2 * CompressedDevice::BlockSize);
+    const QByteArray compressed = compress(data, CompressedDevice::Format(format));
+    if (missing < 0)
+        missing = compressed.size() / 2;
+    QVERIFY(compressed.size() > missing);
+
+    QByteArray decompressed;
+    QCOMPARE(decompress(compressed.left(compressed.size() - missing), CompressedDevice::Format(format), &decompressed),
+             qint64(-1));
+    QVERIFY(decompressed.size() < data.size());
+    QVERIFY(data.startsWith(decompressed));
+}
+
+void TestCompressedDevice::finishFailure_data()
+{
+    addFormats();
+}
+
+// The end of the stream is only written by finish(), which must report that it failed
+void TestCompressedDevice::finishFailure()
+{
+    QFETCH(int, format);
+
+    FailingDevice device;
+    QVERIFY(device.open(QIODevice::WriteOnly));
+    CompressedDevice compressor(&device, CompressedDevice::Format(format));
+    QVERIFY(compressor.open(QIODevice::WriteOnly));
+    QCOMPARE(compressor.write(QByteArray(1000, 'x')), qint64(1000));
+
+    device.failing = true;
+    QVERIFY(!compressor.finish());
+    QCOMPARE(compressor.errorString(), QString::fromLatin1("No space left on device"));
+    QVERIFY(!compressor.finish());
+    QCOMPARE(compressor.write("x", 1), qint64(-1));
+}
+
+void TestCompressedDevice::loadGPX_data()
+{
+    addFormats();
+}
+
+// Large enough for streamGPX() to scan it in several blocks
+void TestCompressedDevice::loadGPX()
+{
+    QFETCH(int, format);
+
+    SampleData samples;
+    samples.metaData.name = QLatin1String("Compressed");
+    for (int i = 0; i < 20000; ++i) {
+        GpsSample sample;
+        sample.time = Q_INT64_C(1306368108000) + i * 1000;
+        sample.lat = 59.9 + i * 1.3e-5;
+        sample.lon = 10.7 - i * 2.1e-5;
+        sample.ele = float((1000 + i % 321) / 10.0);
+        samples.append(sample);
+    }
+    GpxWriter writer;
+    writer.setTimeSpec(TimestampFormatter::UTC);
+    const QByteArray document = writer.toByteArray(samples);
+    const QByteArray compressed = compress(document, CompressedDevice::Format(format));
+    QVERIFY(!compressed.isEmpty());
+
+    QTemporaryFile plainFile(QDir::tempPath() + QLatin1String("/tst_compresseddevice_XXXXXX.gpx"));
+    QVERIFY(plainFile.open());
+    QCOMPARE(plainFile.write(document), qint64(document.size()));
+    QVERIFY(plainFile.flush());
+    QTemporaryFile compressedFile(QDir::tempPath() + QLatin1String("/tst_compresseddevice_XXXXXX.gpx")
+                                  + CompressedDevice::fileSuffix(CompressedDevice::Format(format)));
+    QVERIFY(compressedFile.open());
+    QCOMPARE(compressedFile.write(compressed), qint64(compressed.size()));
+    QVERIFY(compressedFile.flush());
+
+    SampleData expected;
+    QVERIFY(::loadGPX(&expected, plainFile.fileName()));
+    QCOMPARE(expected.count(), samples.count());
+    SampleData fromFile;
+    QVERIFY(::loadGPX(&fromFile, compressedFile.fileName()));
+    QByteArray input = compressed;
+    QBuffer buffer(&input);
+    QVERIFY(buffer.open(QIODevice::ReadOnly));
+    SampleData fromDevice;
+    QVERIFY(::loadGPX(&fromDevice, &buffer));
+
+    const SampleData *loaded[] = { &fromFile, &fromDevice };
+    for (int j = 0; j < 2; ++j) {
+        const SampleData &actual = *loaded[j];
+        QCOMPARE(actual.metaData.name, expected.metaData.name);
+        QCOMPARE(actual.metaData.description, expected.metaData.description);
+        QCOMPARE(actual.count(), expected.count());
+        for (int i = 0; i < actual.count(); ++i) {
+            const GpsSample &a = actual.at(i);
+            const GpsSample &e = expected.at(i);
+            if (a.time != e.time || a.lat != e.lat || a.lon != e.lon || a.ele != e.ele)
+                QFAIL(qPrintable(QString::fromLatin1("Sample %1 differs").arg(i)));
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(TestCompressedDevice)
+#include "tst_compresseddevice.moc"
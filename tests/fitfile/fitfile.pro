@@ -0,0 +1,5 @@
+TARGET = tst_fitfile
+
+include(../tests.pri)
+
+SOURCES += tst_fitfile.cpp
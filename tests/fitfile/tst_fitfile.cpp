@@ -0,0 +1,137 @@
+#include <QtCore/qbuffer.h>
+#include <QtTest/QtTest>
+
+#include "fitfile.h"
+#include "trackmerger.h"
+
+class TestFitFile : public QObject {
+    Q_OBJECT
+private slots:
+    void checksum();
+    void roundTripMergedSession();
+    void chainedFiles();
+    void corruptedFile();
+    void truncatedFile();
+};
+
+/*
+    A merged session like mergeTracks() writes: an hour of 1 Hz GPX data with
+    a two minute pause and some positions without a fix, merged with 5 second
+    HRM data that has a few samples without speed or cadence.
+*/
+static SampleData mergedSession()
+{
+    const qint64 start = Q_INT64_C(1600000000000);
+    SampleData gpx;
+    for (int i = 0; i < 3600; ++i) {
+        GpsSample sample;
+        sample.time = start + i * 1000 + (i >= 1800 ? 120000 : 0);
+        if (i % 97 != 13) {
+            sample.lat = 59.9 + i * 1e-5;
+            sample.lon = 10.7 + i * 2e-5;
+        }
+        sample.ele = 100.0f + (i % 50) * 0.4f;
+        gpx.append(sample);
+    }
+
+    SampleData hrm;
+    hrm.metaData.activity = SampleData::Cycling;
+    for (int i = 0; i <= 744; ++i) {
+        GpsSample sample;
+        sample.time = start + i * 5000;
+        sample.hr = 120 + i % 40;
+        sample.speed = i % 23 == 0 ? -1.0f : 20.0f + (i % 10) * 0.7f;
+        sample.cadence = i % 17 == 0 ? -1 : 80 + i % 15;
+        hrm.append(sample);
+    }
+
+    SampleData merged;
+    TrackMerger().merge(gpx, hrm, hrm.first().time, hrm.last().time, &merged);
+    return merged;
+}
+
+static QByteArray encode(const SampleData &samples)
+{
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    if (!saveFIT(samples, &buffer))
+        return QByteArray();
+    return buffer.data();
+}
+
+static bool decode(const QByteArray &data, SampleData *samples)
+{
+    return loadFIT(samples, data.constData(), data.constData() + data.size());
+}
+
+void TestFitFile::checksum()
+{
+    QCOMPARE(fitChecksum("123456789", 9), quint16(0xbb3d));
+    QCOMPARE(fitChecksum("6789", 4, fitChecksum("12345", 5)), quint16(0xbb3d));
+    QCOMPARE(fitChecksum("", 0), quint16(0));
+}
+
+void TestFitFile::roundTripMergedSession()
+{
+    const SampleData session = mergedSession();
+    QVERIFY(session.count() > 3000);
+    const QByteArray data = encode(session);
+    QVERIFY(!data.isEmpty());
+
+    SampleData decoded;
+    QVERIFY(decode(data, &decoded));
+    QCOMPARE(decoded.count(), session.count());
+    QCOMPARE(decoded.metaData.activity, session.metaData.activity);
+
+    // FIT stores whole seconds, positions in semicircles (8.4e-8 degrees),
+    // altitude in steps of 0.2 m and speed in mm/s
+    for (int i = 0; i < session.count(); ++i) {
+        const GpsSample &expected = session.at(i);
+        const GpsSample &actual = decoded.at(i);
+        QCOMPARE(actual.time, (expected.time + 500) / 1000 * 1000);
+        QVERIFY(qAbs(actual.lat - expected.lat) < 5e-8);
+        QVERIFY(qAbs(actual.lon - expected.lon) < 5e-8);
+        QVERIFY(qAbs(actual.ele - expected.ele) < 0.101f);
+        QCOMPARE(actual.hr, expected.hr);
+        QCOMPARE(actual.cadence, expected.cadence);
+        if (expected.speed < 0)
+            QCOMPARE(actual.speed, -1.0f);
+        else
+            QVERIFY(qAbs(actual.speed - expected.speed) < 0.002f);
+    }
+}
+
+void TestFitFile::chainedFiles()
+{
+    const SampleData session = mergedSession();
+    QByteArray data = encode(session);
+    data += data;
+
+    SampleData decoded;
+    QVERIFY(decode(data, &decoded));
+    QCOMPARE(decoded.count(), 2 * session.count());
+    QCOMPARE(decoded.at(session.count()).time, decoded.first().time);
+}
+
+void TestFitFile::corruptedFile()
+{
+    QByteArray data = encode(mergedSession());
+    data[data.size() / 2] = char(data.at(data.size() / 2) ^ 0x10);
+
+    SampleData decoded;
+    QTest::ignoreMessage(QtWarningMsg, "FIT file has a CRC error");
+    QVERIFY(!decode(data, &decoded));
+}
+
+void TestFitFile::truncatedFile()
+{
+    QByteArray data = encode(mergedSession());
+    data.chop(10);
+
+    SampleData decoded;
+    QTest::ignoreMessage(QtWarningMsg, "Truncated FIT file");
+    QVERIFY(!decode(data, &decoded));
+}
+
+QTEST_GUILESS_MAIN(TestFitFile)
+#include "tst_fitfile.moc"
@@ -0,0 +1,5 @@
+TARGET = tst_geo
+
+include(../tests.pri)
+
+SOURCES += tst_geo.cpp
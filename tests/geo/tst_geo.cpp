@@ -0,0 +1,187 @@
+#include <QtTest/QtTest>
+
+#include <math.h>
+
+#include "geo.h"
+#include "gpssample.h"
+
+/*
+    Checks the error bounds of the distance models documented in geo.h, on
+    random segments and on random walks that look like GPS tracks.
+*/
+class TestGeo : public QObject {
+    Q_OBJECT
+private slots:
+    void cleanup();
+    void equirectangularErrorBound();
+    void localTangentPlaneErrorBound();
+    void localTangentPlaneTrack();
+    void antimeridian();
+};
+
+namespace {
+
+const double EarthRadius = 6371000.0;   // m, the sphere used by geo.cpp
+
+struct ErrorBound {
+    double length;      // m
+    double bound;       // relative to haversineDistance()
+};
+
+// A deterministic generator (xorshift64), so that failures can be reproduced
+class Random {
+public:
+    explicit Random(quint64 seed) : m_state(seed) {}
+
+    double uniform(double from, double to)
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 7;
+        m_state ^= m_state << 17;
+        return from + (to - from) * double(m_state >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    quint64 m_state;
+};
+
+inline double toRadians(double degrees)
+{
+    return degrees * (M_PI / 180.0);
+}
+
+inline double toDegrees(double radians)
+{
+    return radians * (180.0 / M_PI);
+}
+
+// The position \a length meters from \a lat, \a lon in the direction \a bearing (radians)
+void destination(double lat, double lon, double length, double bearing, double *lat2, double *lon2)
+{
+    const double angle = length / EarthRadius;
+    const double phi = toRadians(lat);
+    const double phi2 = asin(sin(phi) * cos(angle) + cos(phi) * sin(angle) * cos(bearing));
+    const double lambda = atan2(sin(bearing) * sin(angle) * cos(phi), cos(angle) - sin(phi) * sin(phi2));
+    *lat2 = toDegrees(phi2);
+    *lon2 = lon + toDegrees(lambda);
+    if (*lon2 > 180.0)
+        *lon2 -= 360.0;
+    else if (*lon2 < -180.0)
+        *lon2 += 360.0;
+}
+
+inline double relativeError(double distance, double reference)
+{
+    return qAbs(distance - reference) / reference;
+}
+
+// A 1 Hz track at up to 50 km/h, wandering like a bike ride
+SampleData randomTrack(Random &random, int count)
+{
+    SampleData track;
+    track.resize(count);
+    double lat = random.uniform(-80.0, 80.0);
+    double lon = random.uniform(-170.0, 170.0);
+    double bearing = random.uniform(0, 2 * M_PI);
+    for (int i = 0; i < count; ++i) {
+        track[i].time = i * 1000;
+        track[i].lat = lat;
+        track[i].lon = lon;
+        bearing += random.uniform(-0.3, 0.3);
+        destination(lat, lon, random.uniform(0.5, 14.0), bearing, &lat, &lon);
+    }
+    return track;
+}
+
+} // namespace
+
+void TestGeo::cleanup()
+{
+    setDistanceModel(HRMGPX_DISTANCE_MODEL);
+}
+
+void TestGeo::equirectangularErrorBound()
+{
+    // The bounds stated in geo.h, for latitudes up to 80 degrees
+    static const ErrorBound bounds[] = {
+        { 10, 4e-12 }, { 100, 4e-10 }, { 1000, 4e-8 }, { 10000, 3e-7 }
+    };
+    Random random(1);
+    for (size_t b = 0; b < sizeof(bounds) / sizeof(bounds[0]); ++b) {
+        double worst = 0;
+        for (int i = 0; i < 20000; ++i) {
+            const double lat = random.uniform(-80.0, 80.0);
+            const double lon = random.uniform(-170.0, 170.0);
+            double lat2, lon2;
+            destination(lat, lon, bounds[b].length, random.uniform(0, 2 * M_PI), &lat2, &lon2);
+            if (qAbs(lat2) > 80.0)
+                continue;
+            worst = qMax(worst, relativeError(equirectangularDistance(lat, lon, lat2, lon2),
+                                              haversineDistance(lat, lon, lat2, lon2)));
+        }
+        QVERIFY2(worst <= bounds[b].bound,
+                 qPrintable(QString::fromLatin1("%1 m: %2").arg(bounds[b].length).arg(worst)));
+    }
+}
+
+void TestGeo::localTangentPlaneErrorBound()
+{
+    setDistanceModel(LocalTangentPlaneModel);
+    static const double lengths[] = { 1, 10, 100, 1000, 10000 };
+    Random random(2);
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l) {
+        double worst = 0;
+        for (int i = 0; i < 20000; ++i) {
+            const double lat = random.uniform(-80.0, 80.0);
+            const double lon = random.uniform(-170.0, 170.0);
+            double lat2, lon2;
+            destination(lat, lon, lengths[l], random.uniform(0, 2 * M_PI), &lat2, &lon2);
+            worst = qMax(worst, relativeError(segmentDistance(lat, lon, lat2, lon2),
+                                              haversineDistance(lat, lon, lat2, lon2)));
+        }
+        QVERIFY2(worst <= 2e-12, qPrintable(QString::fromLatin1("%1 m: %2").arg(lengths[l]).arg(worst)));
+    }
+}
+
+// segmentDistances() keeps an anchor for up to 13 km of track, which adds up
+// to 1e-11 m for the positions far from it
+void TestGeo::localTangentPlaneTrack()
+{
+    setDistanceModel(LocalTangentPlaneModel);
+    Random random(3);
+    for (int t = 0; t < 20; ++t) {
+        const SampleData track = randomTrack(random, 10000);
+        QVector<double> distances(track.count() - 1);
+        segmentDistances(&track.first().lat, &track.first().lon, track.count(), distances.data(),
+                         sizeof(GpsSample));
+        double worst = 0;
+        for (int i = 1; i < track.count(); ++i) {
+            const GpsSample &prev = track.at(i - 1);
+            const GpsSample &curr = track.at(i);
+            const double error = qAbs(distances.at(i - 1) - haversineDistance(prev.lat, prev.lon, curr.lat, curr.lon));
+            worst = qMax(worst, error * 1000.0);
+        }
+        QVERIFY2(worst <= 1e-11, qPrintable(QString::fromLatin1("%1 m").arg(worst)));
+    }
+}
+
+void TestGeo::antimeridian()
+{
+    Random random(4);
+    for (int i = 0; i < 10000; ++i) {
+        const double lat = random.uniform(-80.0, 80.0);
+        const double lon = 180.0 - random.uniform(0, 1e-4);
+        double lat2, lon2;
+        destination(lat, lon, random.uniform(2.0, 10.0), random.uniform(M_PI / 4, 3 * M_PI / 4), &lat2, &lon2);
+        const double haversine = haversineDistance(lat, lon, lat2, lon2);
+        for (int model = EquirectangularModel; model <= LocalTangentPlaneModel; ++model) {
+            setDistanceModel(DistanceModel(model));
+            const double error = qAbs(segmentDistance(lat, lon, lat2, lon2) - haversine) * 1000.0;
+            QVERIFY2(error <= 1e-8, qPrintable(QString::fromLatin1("%1: %2 m")
+                                                .arg(distanceModelName(DistanceModel(model))).arg(error)));
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(TestGeo)
+#include "tst_geo.moc"
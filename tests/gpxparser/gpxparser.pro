@@ -0,0 +1,5 @@
+TARGET = tst_gpxparser
+
+include(../tests.pri)
+
+SOURCES += tst_gpxparser.cpp
@@ -0,0 +1,252 @@
+#include <QtTest/QtTest>
+
+#include "gpxparser.h"
+
+/*
+    The memory mapped scanner used by loadGPX(SampleData *, const QString &)
+    must read exactly what the QXmlStreamReader based loadGPX(SampleData *,
+    QIODevice *) reads, and the benchmarks compare the two on a large track.
+*/
+class TestGpxParser : public QObject {
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void sameSamples_data();
+    void sameSamples();
+    void loadLargeTrack_data();
+    void loadLargeTrack();
+    void threadCount_data();
+    void threadCount();
+    void loadLargeTrackThreads_data();
+    void loadLargeTrackThreads();
+
+private:
+    QTemporaryFile m_largeTrack;
+};
+
+// Which elements the track points of a generated document have
+enum Pattern {
+    AllElements,
+    SomeWithoutElements,    // every third point has no <ele>, every fifth no <time>
+    LeadingWithoutElements, // the first third of the points have neither
+    EmptyTrackPoints        // every fourth point is <trkpt .../>
+};
+
+static const int LargeTrackCount = 200000;
+
+static QByteArray trackPoint(int i, int count, Pattern pattern)
+{
+    const double lat = 59.9 + i * 1.3e-5;
+    const double lon = 10.7 - i * 2.1e-5;
+    char buffer[200];
+    if (pattern == EmptyTrackPoints && i % 4 == 0) {
+        qsnprintf(buffer, sizeof(buffer), "   <trkpt lat=\"%.7f\" lon=\"%.7f\"/>\n", lat, lon);
+        return buffer;
+    }
+
+    const bool leading = pattern == LeadingWithoutElements && i < count / 3;
+    const bool elevation = !leading && !(pattern == SomeWithoutElements && i % 3 == 0);
+    const bool time = !leading && !(pattern == SomeWithoutElements && i % 5 == 0);
+    QByteArray point;
+    qsnprintf(buffer, sizeof(buffer), "   <trkpt lat=\"%.7f\" lon=\"%.7f\">\n", lat, lon);
+    point += buffer;
+    if (elevation) {
+        qsnprintf(buffer, sizeof(buffer), "    <ele>%.1f</ele>\n", (1000 + i % 321) / 10.0);
+        point += buffer;
+    }
+    if (time) {
+        qsnprintf(buffer, sizeof(buffer), "    <time>2011-05-%02dT%02d:%02d:%02dZ</time>\n",
+                  1 + i / 86400, i / 3600 % 24, i / 60 % 60, i % 60);
+        point += buffer;
+    }
+    point += "   </trkpt>\n";
+    return point;
+}
+
+static QByteArray gpxDocument(const QByteArray &metadata, int count, Pattern pattern)
+{
+    QByteArray document =
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<gpx version=\"1.1\" creator=\"hrmgpx\" xmlns=\"http://www.topografix.com/GPX/1/1\">\n";
+    document += metadata;
+    document += " <trk>\n  <name>Track</name>\n  <trkseg>\n";
+    for (int i = 0; i < count; ++i)
+        document += trackPoint(i, count, pattern);
+    document += "  </trkseg>\n </trk>\n</gpx>\n";
+    return document;
+}
+
+static void compareSamples(const SampleData &actual, const SampleData &expected)
+{
+    QCOMPARE(actual.metaData.name, expected.metaData.name);
+    QCOMPARE(actual.metaData.description, expected.metaData.description);
+    QCOMPARE(actual.count(), expected.count());
+    for (int i = 0; i < actual.count(); ++i) {
+        const GpsSample &a = actual.at(i);
+        const GpsSample &e = expected.at(i);
+        if (a.time != e.time || a.lat != e.lat || a.lon != e.lon || a.ele != e.ele
+            || a.hr != e.hr || a.speed != e.speed || a.cadence != e.cadence) {
+            QFAIL(qPrintable(QString::fromLatin1("Sample %1 differs").arg(i)));
+        }
+    }
+}
+
+static bool writeFile(QTemporaryFile *file, const QByteArray &contents)
+{
+    return file->open() && file->write(contents) == contents.size() && file->flush();
+}
+
+void TestGpxParser::initTestCase()
+{
+    QVERIFY(writeFile(&m_largeTrack, gpxDocument(QByteArray(), LargeTrackCount, AllElements)));
+}
+
+void TestGpxParser::cleanupTestCase()
+{
+    m_largeTrack.remove();
+}
+
+void TestGpxParser::sameSamples_data()
+{
+    QTest::addColumn<QByteArray>("document");
+
+    const QByteArray metadata =
+            " <metadata>\n"
+            "  <name>Morning &amp; evening</name>\n"
+            "  <desc><![CDATA[Two <rides>]]></desc>\n"
+            "  <link href=\"http://example.com/\"><text>Link</text></link>\n"
+            "  <time>2011-05-25T12:00:00Z</time>\n"
+            " </metadata>\n";
+    QTest::newRow("all elements") << gpxDocument(metadata, 1000, AllElements);
+    QTest::newRow("no metadata") << gpxDocument(QByteArray(), 1000, AllElements);
+    QTest::newRow("empty metadata") << gpxDocument(" <metadata><name></name><desc/></metadata>\n", 100, AllElements);
+    QTest::newRow("missing ele and time") << gpxDocument(metadata, 1000, SomeWithoutElements);
+    QTest::newRow("leading points without ele and time") << gpxDocument(metadata, 1000, LeadingWithoutElements);
+    QTest::newRow("empty track points") << gpxDocument(metadata, 1000, EmptyTrackPoints);
+    QTest::newRow("no track points") << gpxDocument(metadata, 0, AllElements);
+}
+
+void TestGpxParser::sameSamples()
+{
+    QFETCH(QByteArray, document);
+
+    QTemporaryFile file;
+    QVERIFY(writeFile(&file, document));
+    SampleData mapped;
+    QVERIFY(loadGPX(&mapped, file.fileName()));
+
+    QBuffer buffer(&document);
+    QVERIFY(buffer.open(QIODevice::ReadOnly));
+    SampleData streamed;
+    QVERIFY(loadGPX(&streamed, &buffer));
+
+    compareSamples(mapped, streamed);
+}
+
+void TestGpxParser::loadLargeTrack_data()
+{
+    QTest::addColumn<bool>("mapped");
+    QTest::newRow("QXmlStreamReader") << false;
+    QTest::newRow("memory mapped") << true;
+}
+
+void TestGpxParser::loadLargeTrack()
+{
+    QFETCH(bool, mapped);
+
+    SampleData samples;
+    if (mapped) {
+        QBENCHMARK {
+            samples.clear();
+            QVERIFY(loadGPX(&samples, m_largeTrack.fileName()));
+        }
+    } else {
+        QBENCHMARK {
+            samples.clear();
+            QFile file(m_largeTrack.fileName());
+            QVERIFY(file.open(QIODevice::ReadOnly));
+            QVERIFY(loadGPX(&samples, &file));
+        }
+    }
+    QCOMPARE(samples.count(), LargeTrackCount);
+}
+
+/*
+    Large enough to be split in chunks at several places: inside a long
+    <metadata>, in the points in front of the first <ele> and <time>, and
+    between points that inherit <ele> or <time> from the previous chunk.
+*/
+void TestGpxParser::threadCount_data()
+{
+    QTest::addColumn<QByteArray>("document");
+    QTest::addColumn<int>("threadCount");
+
+    const QByteArray description = QByteArray("Lap &amp; lap. ").repeated(200000);
+    QByteArray metadata = " <metadata>\n  <name>Long</name>\n  <desc>";
+    metadata += description;
+    metadata += "</desc>\n </metadata>\n";
+    const QByteArray documents[] = {
+        gpxDocument(metadata, 10000, AllElements),
+        gpxDocument(QByteArray(), 100000, LeadingWithoutElements),
+        gpxDocument(metadata, 100000, SomeWithoutElements)
+    };
+    const char *names[] = { "long metadata", "leading points without ele and time", "missing ele and time" };
+    const int threadCounts[] = { 2, 4, 7 };
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            QByteArray name = names[i];
+            name += ", ";
+            name += QByteArray::number(threadCounts[j]);
+            name += " threads";
+            QTest::newRow(name.constData()) << documents[i] << threadCounts[j];
+        }
+    }
+}
+
+void TestGpxParser::threadCount()
+{
+    QFETCH(QByteArray, document);
+    QFETCH(int, threadCount);
+    QVERIFY(document.size() > 2 * 1024 * 1024);
+
+    QTemporaryFile file;
+    QVERIFY(writeFile(&file, document));
+    SampleData expected;
+    QVERIFY(loadGPX(&expected, file.fileName(), 1));
+    QThreadPool::globalInstance()->setMaxThreadCount(threadCount);
+    SampleData samples;
+    const bool ok = loadGPX(&samples, file.fileName(), threadCount);
+    QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+    QVERIFY(ok);
+    compareSamples(samples, expected);
+}
+
+void TestGpxParser::loadLargeTrackThreads_data()
+{
+    QTest::addColumn<int>("threadCount");
+    QTest::newRow("1 thread") << 1;
+    QTest::newRow("2 threads") << 2;
+    QTest::newRow("4 threads") << 4;
+    QTest::newRow("8 threads") << 8;
+}
+
+void TestGpxParser::loadLargeTrackThreads()
+{
+    QFETCH(int, threadCount);
+
+    // Like --jobs, which limits the global thread pool the chunks are scanned on
+    QThreadPool::globalInstance()->setMaxThreadCount(threadCount);
+    SampleData samples;
+    bool ok = true;
+    QBENCHMARK {
+        samples.clear();
+        ok = ok && loadGPX(&samples, m_largeTrack.fileName(), threadCount);
+    }
+    QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+    QVERIFY(ok);
+    QCOMPARE(samples.count(), LargeTrackCount);
+}
+
+QTEST_GUILESS_MAIN(TestGpxParser)
+#include "tst_gpxparser.moc"
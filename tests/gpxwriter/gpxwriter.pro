@@ -0,0 +1,5 @@
+TARGET = tst_gpxwriter
+
+include(../tests.pri)
+
+SOURCES += tst_gpxwriter.cpp
@@ -0,0 +1,264 @@
+#include <QtTest/QtTest>
+
+#include "gpxwriter.h"
+
+/*
+    In Compatible mode GpxWriter must write exactly what the QTextStream based
+    writer it replaced wrote. Tracks of at least two MinimumChunkSize chunks
+    are formatted on the global thread pool and written with one gathered
+    write, which must give the same bytes as formatting them on one thread.
+*/
+class TestGpxWriter : public QObject {
+    Q_OBJECT
+private slots:
+    void cleanup();
+    void compatibleOutput_data();
+    void compatibleOutput();
+    void writeLargeTrack_data();
+    void writeLargeTrack();
+    void parallelOutput_data();
+    void parallelOutput();
+    void writeThreads_data();
+    void writeThreads();
+};
+
+// A 1 Hz ride, with a name and description that need escaping
+static SampleData recordedTrack(int count)
+{
+    SampleData samples;
+    samples.metaData.name = QString::fromUtf8("Ride & run <S\xc3\xa6ther>");
+    samples.metaData.description = QLatin1String("\"Intervals\"");
+    const qint64 start = Q_INT64_C(1306368108000);
+    for (int i = 0; i < count; ++i) {
+        GpsSample sample;
+        sample.time = start + i * 1000;
+        sample.lat = 59.9 + i * 1.3e-5;
+        sample.lon = 10.7 - i * 2.1e-5;
+        sample.ele = float((1000 + i % 321) / 10.0);
+        sample.hr = 110 + i % 80;
+        sample.speed = float((200 + i % 150) / 10.0);
+        sample.cadence = 70 + i % 30;
+        samples.append(sample);
+    }
+    return samples;
+}
+
+// The QTextStream based saveGPX() that Compatible mode replaced
+static QByteArray referenceGPX(const SampleData &sampleData)
+{
+    QByteArray data;
+    QBuffer device(&data);
+    device.open(QIODevice::WriteOnly);
+    QTextStream stream(&device);
+    stream.setCodec("UTF-8");
+
+    stream.setRealNumberNotation(QTextStream::FixedNotation);
+    stream << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+    stream << "<gpx xsi:schemaLocation=\"http://www.topografix.com/GPX/1/1"
+             " http://www.topografix.com/GPX/1/1/gpx.xsd"
+             " http://www.garmin.com/xmlschemas/GpxExtensions/v3"
+             " http://www.garmin.com/xmlschemas/GpxExtensionsv3.xsd"
+             " http://www.garmin.com/xmlschemas/TrackPointExtension/v1"
+             " http://www.garmin.com/xmlschemas/TrackPointExtensionv1.xsd\""
+           " version=\"1.1\""
+           " creator=\"HrmGpx\""
+           " xmlns=\"http://www.topografix.com/GPX/1/1\""
+           " xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\""
+           " xmlns:gpxtpx=\"http://www.garmin.com/xmlschemas/TrackPointExtension/v1\""
+           " xmlns:gpxx=\"http://www.garmin.com/xmlschemas/GpxExtensions/v3\">\n";
+    stream << "  <metadata>\n";
+    QRegularExpression re(QStringLiteral("\\d\\d/\\d\\d/\\d{4}/\\d\\d:\\d\\d:\\d\\d\\.\\d+$"));
+    QString name = sampleData.metaData.name;
+    name.replace(re, msToDateTimeStringHuman(sampleData.first().time));
+    stream << "    <name>" << name << "</name>\n";
+    stream << "    <desc>" << sampleData.metaData.description << "</desc>\n";
+    stream << "    <author>\n";
+    stream << "      <name>Jan Arve S\xe6ther</name>\n";
+    stream << "    </author>\n";
+    stream << "    <link href=\"sjarve@gmail.com\">\n";
+    stream << "      <text>HrmGpx</text>\n";
+    stream << "    </link>\n";
+    stream << "  </metadata>\n";
+    stream << "  <trk>\n";
+    stream << "      <trkseg>\n";
+
+    Q_FOREACH (const GpsSample &sample, sampleData) {
+        stream.setRealNumberPrecision(15);
+        stream << "        <trkpt lat=\"" << sample.lat << "\" lon=\"" << sample.lon << "\">\n";
+        stream.setRealNumberPrecision(1);
+        stream << "          <ele>" << sample.ele << "</ele>\n";
+        stream << "          <time>" << msToDateTimeString(sample.time) << "</time>\n";
+        stream << "          <!--speed>" << sample.speed << "</speed-->\n";
+        stream << "          <extensions><gpxtpx:TrackPointExtension><gpxtpx:hr>"
+                                << sample.hr
+                                << "</gpxtpx:hr></gpxtpx:TrackPointExtension></extensions>\n";
+        stream << "        </trkpt>\n";
+    }
+
+    stream << "    </trkseg>\n";
+    stream << "  </trk>\n";
+    stream << "</gpx>\n";
+    stream.flush();
+    return data;
+}
+
+static qint64 localTime(int year, int month, int day)
+{
+    return QDateTime(QDate(year, month, day), QTime(12, 34, 56, 789)).toMSecsSinceEpoch();
+}
+
+void TestGpxWriter::cleanup()
+{
+    QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+}
+
+void TestGpxWriter::compatibleOutput_data()
+{
+    QTest::addColumn<double>("lat");
+    QTest::addColumn<double>("lon");
+    QTest::addColumn<float>("ele");
+    QTest::addColumn<float>("speed");
+    QTest::addColumn<qint64>("time");
+
+    const qint64 time = Q_INT64_C(1306368108000);
+    // 2^-16 has 16 decimals, so these are exact ties at 15 decimals
+    QTest::newRow("ties") << 59 + 1 / 65536.0 << -(10 + 3 / 65536.0) << 0.25f << -0.75f << time;
+    QTest::newRow("large ties") << 10000 + 1 / 65536.0 << -(10000 + 5 / 65536.0) << 1.5e18f << -4.5e18f << time;
+    QTest::newRow("negative zero") << -0.0 << -1e-16 << -0.0f << -0.04f << time;
+    QTest::newRow("huge values") << 1e20 << -1.5e300 << 3e38f << -1.7e38f << time;
+    QTest::newRow("infinity and nan") << qInf() << -qInf() << float(qQNaN()) << -float(qInf()) << time;
+    QTest::newRow("year 1") << 59.9 << 10.7 << 100.0f << 20.0f << localTime(1, 1, 1);
+    QTest::newRow("year 0") << 59.9 << 10.7 << 100.0f << 20.0f << localTime(-1, 6, 1);
+    QTest::newRow("negative year") << 59.9 << 10.7 << 100.0f << 20.0f << localTime(-4713, 11, 25);
+    QTest::newRow("year 9999") << 59.9 << 10.7 << 100.0f << 20.0f << localTime(9999, 12, 31);
+    QTest::newRow("year 10000") << 59.9 << 10.7 << 100.0f << 20.0f << localTime(10000, 1, 1);
+    QTest::newRow("year 2000000") << 59.9 << 10.7 << 100.0f << 20.0f << localTime(2000000, 2, 29);
+}
+
+void TestGpxWriter::compatibleOutput()
+{
+    QFETCH(double, lat);
+    QFETCH(double, lon);
+    QFETCH(float, ele);
+    QFETCH(float, speed);
+    QFETCH(qint64, time);
+
+    // The odd sample in the middle, and at the end where nothing follows it
+    SampleData samples = recordedTrack(5);
+    GpsSample sample = samples.at(2);
+    sample.lat = lat;
+    sample.lon = lon;
+    sample.ele = ele;
+    sample.speed = speed;
+    sample.time = time;
+    samples[2] = sample;
+    samples.append(sample);
+
+    const QList<QByteArray> actual = GpxWriter(GpxWriter::Compatible).toByteArray(samples).split('\n');
+    const QList<QByteArray> expected = referenceGPX(samples).split('\n');
+    for (int i = 0; i < qMin(actual.count(), expected.count()); ++i)
+        QCOMPARE(actual.at(i), expected.at(i));
+    QCOMPARE(actual.count(), expected.count());
+}
+
+void TestGpxWriter::writeLargeTrack_data()
+{
+    QTest::addColumn<bool>("reference");
+    QTest::newRow("QTextStream") << true;
+    QTest::newRow("GpxWriter") << false;
+}
+
+void TestGpxWriter::writeLargeTrack()
+{
+    QFETCH(bool, reference);
+
+    const SampleData samples = recordedTrack(200000);
+    const GpxWriter writer(GpxWriter::Compatible);
+    QByteArray data;
+    if (reference) {
+        QBENCHMARK {
+            data = referenceGPX(samples);
+        }
+    } else {
+        QBENCHMARK {
+            data = writer.toByteArray(samples);
+        }
+    }
+    QVERIFY(data.endsWith("</gpx>\n"));
+}
+
+void TestGpxWriter::parallelOutput_data()
+{
+    QTest::addColumn<bool>("compatible");
+    QTest::addColumn<bool>("file");
+
+    QTest::newRow("Standard, QBuffer") << false << false;
+    QTest::newRow("Standard, QFile") << false << true;
+    QTest::newRow("Compatible, QBuffer") << true << false;
+    QTest::newRow("Compatible, QFile") << true << true;
+}
+
+void TestGpxWriter::parallelOutput()
+{
+    QFETCH(bool, compatible);
+    QFETCH(bool, file);
+
+    // Four chunks, the last one shorter than the others
+    const SampleData samples = recordedTrack(3 * GpxWriter::MinimumChunkSize + 1234);
+    const GpxWriter writer(compatible ? GpxWriter::Compatible : GpxWriter::Standard);
+    QThreadPool::globalInstance()->setMaxThreadCount(1);
+    const QByteArray expected = writer.toByteArray(samples);
+    QVERIFY(expected.endsWith("</gpx>\n"));
+
+    QThreadPool::globalInstance()->setMaxThreadCount(4);
+    QByteArray actual;
+    if (file) {
+        // Files are written with writev(), behind anything the QFile buffered
+        QTemporaryFile output;
+        QVERIFY(output.open());
+        QCOMPARE(output.write("<!-- before -->\n"), qint64(16));
+        QVERIFY(writer.write(samples, &output));
+        QCOMPARE(output.write("<!-- after -->\n"), qint64(15));
+        QVERIFY(output.flush());
+        QCOMPARE(output.size(), qint64(16 + expected.size() + 15));
+        QVERIFY(output.seek(0));
+        actual = output.readAll();
+        QVERIFY(actual.startsWith("<!-- before -->\n"));
+        QVERIFY(actual.endsWith("<!-- after -->\n"));
+        actual = actual.mid(16, actual.size() - 16 - 15);
+    } else {
+        QBuffer output(&actual);
+        QVERIFY(output.open(QIODevice::WriteOnly));
+        QVERIFY(writer.write(samples, &output));
+    }
+    QCOMPARE(actual.size(), expected.size());
+    QVERIFY(actual == expected);
+}
+
+void TestGpxWriter::writeThreads_data()
+{
+    QTest::addColumn<int>("threadCount");
+    QTest::newRow("1 thread") << 1;
+    QTest::newRow("2 threads") << 2;
+    QTest::newRow("4 threads") << 4;
+    QTest::newRow("8 threads") << 8;
+}
+
+void TestGpxWriter::writeThreads()
+{
+    QFETCH(int, threadCount);
+
+    const SampleData samples = recordedTrack(200000);
+    const GpxWriter writer;
+    QThreadPool::globalInstance()->setMaxThreadCount(threadCount);
+    bool ok = true;
+    QBENCHMARK {
+        QBuffer output;
+        output.open(QIODevice::WriteOnly);
+        ok = ok && writer.write(samples, &output);
+    }
+    QVERIFY(ok);
+}
+
+QTEST_GUILESS_MAIN(TestGpxWriter)
+#include "tst_gpxwriter.moc"
@@ -0,0 +1,5 @@
+TARGET = tst_haversine
+
+include(../tests.pri)
+
+SOURCES += tst_haversine.cpp
@@ -0,0 +1,149 @@
+#include <QtTest/QtTest>
+
+#include <math.h>
+
+#include "geo.h"
+#include "gpssample.h"
+
+/*
+    Checks the batch haversine kernel against haversineDistance(), with the
+    error bounds documented in geo.cpp. The kernel is the SSE2 or the AVX2
+    variant, whichever the machine running the test supports.
+*/
+class TestHaversine : public QObject {
+    Q_OBJECT
+private slots:
+    void track();
+    void randomPoints();
+    void nearlyAntipodal();
+    void counts();
+};
+
+namespace {
+
+// A deterministic generator (xorshift64), so that failures can be reproduced
+class Random {
+public:
+    explicit Random(quint64 seed) : m_state(seed) {}
+
+    double uniform(double from, double to)
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 7;
+        m_state ^= m_state << 17;
+        return from + (to - from) * double(m_state >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    quint64 m_state;
+};
+
+inline double relativeError(double distance, double reference)
+{
+    return reference == 0 ? qAbs(distance) : qAbs(distance - reference) / reference;
+}
+
+// Returns the largest relative error of haversineDistances() for the points
+double worstError(const QVector<double> &lat, const QVector<double> &lon, double limit = 19000.0)
+{
+    QVector<double> distances(lat.count() - 1);
+    haversineDistances(lat.constData(), lon.constData(), lat.count(), distances.data());
+    double worst = 0;
+    for (int i = 1; i < lat.count(); ++i) {
+        const double reference = haversineDistance(lat.at(i - 1), lon.at(i - 1), lat.at(i), lon.at(i));
+        if (reference < limit)
+            worst = qMax(worst, relativeError(distances.at(i - 1), reference));
+    }
+    return worst;
+}
+
+} // namespace
+
+// Reads the coordinates straight out of a SampleData, like SampleStatistics
+void TestHaversine::track()
+{
+    Random random(1);
+    SampleData track;
+    track.resize(100000);
+    double lat = random.uniform(-80.0, 80.0);
+    double lon = random.uniform(-170.0, 170.0);
+    for (int i = 0; i < track.count(); ++i) {
+        track[i].time = i * 1000;
+        track[i].lat = lat;
+        track[i].lon = lon;
+        lat += random.uniform(-1e-4, 1e-4);
+        lon += random.uniform(-1e-4, 1e-4);
+    }
+
+    QVector<double> distances(track.count() - 1);
+    haversineDistances(&track.first().lat, &track.first().lon, track.count(), distances.data(), sizeof(GpsSample));
+    double worst = 0;
+    for (int i = 1; i < track.count(); ++i) {
+        const GpsSample &prev = track.at(i - 1);
+        const GpsSample &curr = track.at(i);
+        worst = qMax(worst, relativeError(distances.at(i - 1),
+                                          haversineDistance(prev.lat, prev.lon, curr.lat, curr.lon)));
+    }
+    QVERIFY2(worst <= 2e-15, qPrintable(QString::number(worst)));
+}
+
+// Points anywhere on the sphere, below 2e-15 up to 19000 km
+void TestHaversine::randomPoints()
+{
+    Random random(2);
+    QVector<double> lat(100001);
+    QVector<double> lon(100001);
+    for (int i = 0; i < lat.count(); ++i) {
+        lat[i] = asin(random.uniform(-1.0, 1.0)) * (180.0 / M_PI);
+        lon[i] = random.uniform(-180.0, 180.0);
+    }
+    const double worst = worstError(lat, lon);
+    QVERIFY2(worst <= 2e-15, qPrintable(QString::number(worst)));
+}
+
+// Both versions are ill-conditioned within 0.01 degrees of the antipode
+void TestHaversine::nearlyAntipodal()
+{
+    Random random(3);
+    QVector<double> lat;
+    QVector<double> lon;
+    for (int i = 0; i < 10000; ++i) {
+        const double pointLat = random.uniform(-89.0, 89.0);
+        const double pointLon = random.uniform(-179.0, 179.0);
+        lat.append(pointLat);
+        lon.append(pointLon);
+        lat.append(-pointLat + random.uniform(-0.01, 0.01));
+        lon.append(pointLon + (pointLon < 0 ? 180.0 : -180.0) + random.uniform(-0.01, 0.01));
+    }
+    const double worst = worstError(lat, lon, 20100.0);
+    QVERIFY2(worst <= 3e-10, qPrintable(QString::number(worst)));
+}
+
+// Every count up to a few tiles, so that each vector width ends with a
+// scalar tail, and no distance is written past count - 1
+void TestHaversine::counts()
+{
+    Random random(4);
+    QVector<double> lat(600);
+    QVector<double> lon(600);
+    for (int i = 0; i < lat.count(); ++i) {
+        lat[i] = random.uniform(-80.0, 80.0);
+        lon[i] = random.uniform(-180.0, 180.0);
+    }
+
+    const double untouched = -1.0;
+    for (int count = 0; count <= lat.count(); ++count) {
+        QVector<double> distances(count + 1, untouched);
+        haversineDistances(lat.constData(), lon.constData(), count, distances.data());
+        for (int i = 1; i < count; ++i) {
+            const double reference = haversineDistance(lat.at(i - 1), lon.at(i - 1), lat.at(i), lon.at(i));
+            QVERIFY2(relativeError(distances.at(i - 1), reference) <= 2e-15,
+                     qPrintable(QString::fromLatin1("count %1, segment %2").arg(count).arg(i - 1)));
+        }
+        for (int i = qMax(count - 1, 0); i < distances.count(); ++i)
+            QCOMPARE(distances.at(i), untouched);
+    }
+}
+
+QTEST_GUILESS_MAIN(TestHaversine)
+#include "tst_haversine.moc"
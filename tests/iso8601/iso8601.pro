@@ -0,0 +1,5 @@
+TARGET = tst_iso8601
+
+include(../tests.pri)
+
+SOURCES += tst_iso8601.cpp
@@ -0,0 +1,141 @@
+#include <QtCore/qdatetime.h>
+#include <QtTest/QtTest>
+
+#include "iso8601.h"
+
+class TestIso8601 : public QObject {
+    Q_OBJECT
+private slots:
+    void agreesWithQDateTime_data();
+    void agreesWithQDateTime();
+    void invalid_data();
+    void invalid();
+    void fraction_data();
+    void fraction();
+    void parseIsoDateTimeBenchmark();
+    void qDateTimeBenchmark();
+};
+
+static bool parse(const QByteArray &timestamp, qint64 *msecsSinceEpoch)
+{
+    return parseIsoDateTime(timestamp.constData(), timestamp.constData() + timestamp.size(), msecsSinceEpoch);
+}
+
+// The time stamps of an hour long 1 Hz track, as written by a GPS unit
+static QList<QByteArray> trackTimestamps()
+{
+    const QDateTime start(QDate(2011, 5, 26), QTime(0, 1, 48), Qt::UTC);
+    QList<QByteArray> timestamps;
+    for (int i = 0; i < 3600; ++i)
+        timestamps.append(start.addSecs(i).toString(Qt::ISODate).toLatin1());
+    return timestamps;
+}
+
+void TestIso8601::agreesWithQDateTime_data()
+{
+    QTest::addColumn<QByteArray>("timestamp");
+
+    QTest::newRow("utc") << QByteArray("2011-05-26T00:01:48Z");
+    QTest::newRow("milliseconds") << QByteArray("2011-05-26T00:01:48.250Z");
+    QTest::newRow("tenths") << QByteArray("2011-05-26T00:01:48.5Z");
+    QTest::newRow("positive offset") << QByteArray("2011-05-26T02:01:48+02:00");
+    QTest::newRow("negative offset") << QByteArray("2011-05-25T18:31:48-05:30");
+    QTest::newRow("leap day") << QByteArray("2012-02-29T23:59:59Z");
+    QTest::newRow("new year") << QByteArray("1999-12-31T23:59:59.999Z");
+    QTest::newRow("epoch") << QByteArray("1970-01-01T00:00:00Z");
+    QTest::newRow("before epoch") << QByteArray("1969-07-20T20:17:40Z");
+    QTest::newRow("local time") << QByteArray("2011-05-26T00:01:48");
+}
+
+void TestIso8601::agreesWithQDateTime()
+{
+    QFETCH(QByteArray, timestamp);
+
+    const QDateTime expected = QDateTime::fromString(QString::fromLatin1(timestamp), Qt::ISODate);
+    QVERIFY(expected.isValid());
+    qint64 msecs;
+    QVERIFY(parse(timestamp, &msecs));
+    QCOMPARE(msecs, expected.toMSecsSinceEpoch());
+}
+
+void TestIso8601::invalid_data()
+{
+    QTest::addColumn<QByteArray>("timestamp");
+
+    QTest::newRow("empty") << QByteArray();
+    QTest::newRow("date only") << QByteArray("2011-05-26");
+    QTest::newRow("space separator") << QByteArray("2011-05-26 00:01:48Z");
+    QTest::newRow("no seconds") << QByteArray("2011-05-26T00:01Z");
+    QTest::newRow("month 13") << QByteArray("2011-13-26T00:01:48Z");
+    QTest::newRow("february 29") << QByteArray("2011-02-29T00:01:48Z");
+    QTest::newRow("minute 60") << QByteArray("2011-05-26T00:60:48Z");
+    QTest::newRow("after midnight") << QByteArray("2011-05-26T24:00:01Z");
+    QTest::newRow("empty fraction") << QByteArray("2011-05-26T00:01:48.Z");
+    QTest::newRow("trailing garbage") << QByteArray("2011-05-26T00:01:48Zx");
+    QTest::newRow("offset hours") << QByteArray("2011-05-26T00:01:48+24:00");
+}
+
+void TestIso8601::invalid()
+{
+    QFETCH(QByteArray, timestamp);
+
+    qint64 msecs;
+    QVERIFY(!parse(timestamp, &msecs));
+}
+
+void TestIso8601::fraction_data()
+{
+    QTest::addColumn<QByteArray>("timestamp");
+    QTest::addColumn<qint64>("msecs");
+
+    const qint64 second = Q_INT64_C(1306368108000);     // 2011-05-26T00:01:48Z
+    QTest::newRow("microseconds") << QByteArray("2011-05-26T00:01:48.123456Z") << second + 123;
+    QTest::newRow("round up") << QByteArray("2011-05-26T00:01:48.1235Z") << second + 124;
+    QTest::newRow("next second") << QByteArray("2011-05-26T00:01:48.9999Z") << second + 1000;
+    QTest::newRow("comma") << QByteArray("2011-05-26T00:01:48,5Z") << second + 500;
+    QTest::newRow("midnight") << QByteArray("2011-05-25T24:00:00Z") << Q_INT64_C(1306368000000);
+}
+
+// More than three fractional digits are rounded to the nearest millisecond
+void TestIso8601::fraction()
+{
+    QFETCH(QByteArray, timestamp);
+    QFETCH(qint64, msecs);
+
+    qint64 parsed;
+    QVERIFY(parse(timestamp, &parsed));
+    QCOMPARE(parsed, msecs);
+}
+
+void TestIso8601::parseIsoDateTimeBenchmark()
+{
+    const QList<QByteArray> timestamps = trackTimestamps();
+    qint64 sum = 0;
+    QBENCHMARK {
+        sum = 0;
+        foreach (const QByteArray &timestamp, timestamps) {
+            qint64 msecs;
+            parse(timestamp, &msecs);
+            sum += msecs;
+        }
+    }
+    QVERIFY(sum != 0);
+}
+
+// The path the GPX reader took before parseIsoDateTime()
+void TestIso8601::qDateTimeBenchmark()
+{
+    QList<QString> timestamps;
+    foreach (const QByteArray &timestamp, trackTimestamps())
+        timestamps.append(QString::fromLatin1(timestamp));
+    qint64 sum = 0;
+    QBENCHMARK {
+        sum = 0;
+        foreach (const QString &timestamp, timestamps)
+            sum += QDateTime::fromString(timestamp, Qt::ISODate).toMSecsSinceEpoch();
+    }
+    QVERIFY(sum != 0);
+}
+
+QTEST_GUILESS_MAIN(TestIso8601)
+#include "tst_iso8601.moc"
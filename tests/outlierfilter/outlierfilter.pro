@@ -0,0 +1,5 @@
+TARGET = tst_outlierfilter
+
+include(../tests.pri)
+
+SOURCES += tst_outlierfilter.cpp
@@ -0,0 +1,101 @@
+#include <QtTest/QtTest>
+
+#include "outlierfilter.h"
+
+class TestOutlierFilter : public QObject {
+    Q_OBJECT
+private slots:
+    void cleanTrack();
+    void spike();
+    void runAtEnd();
+    void longRun();
+};
+
+// Ten minutes at 1 Hz, heading north east at about 25 km/h
+static SampleData straightTrack(int count = 600)
+{
+    SampleData samples;
+    for (int i = 0; i < count; ++i) {
+        GpsSample sample;
+        sample.time = Q_INT64_C(1306368108000) + i * 1000;
+        sample.lat = 59.9 + i * 5e-5;
+        sample.lon = 10.7 + i * 1e-4;
+        samples.append(sample);
+    }
+    return samples;
+}
+
+// Moves the samples [first, last] about 5 km north
+static void displace(SampleData *samples, int first, int last)
+{
+    for (int i = first; i <= last; ++i)
+        (*samples)[i].lat += 0.045;
+}
+
+void TestOutlierFilter::cleanTrack()
+{
+    SampleData samples = straightTrack();
+    QVector<SampleRange> uncorrected;
+    QVERIFY(OutlierFilter().correct(&samples, &uncorrected).isEmpty());
+    QVERIFY(uncorrected.isEmpty());
+}
+
+void TestOutlierFilter::spike()
+{
+    const SampleData expected = straightTrack();
+    SampleData samples = expected;
+    displace(&samples, 200, 204);
+
+    QVector<SampleRange> uncorrected;
+    const QVector<SampleRange> corrected = OutlierFilter().correct(&samples, &uncorrected);
+    QCOMPARE(corrected.count(), 1);
+    QCOMPARE(corrected.first().first, 200);
+    QCOMPARE(corrected.first().last, 204);
+    QVERIFY(uncorrected.isEmpty());
+    for (int i = 200; i <= 204; ++i) {
+        QCOMPARE(samples.at(i).time, expected.at(i).time);
+        QVERIFY(qAbs(samples.at(i).lat - expected.at(i).lat) < 1e-9);
+        QVERIFY(qAbs(samples.at(i).lon - expected.at(i).lon) < 1e-9);
+    }
+}
+
+// Nothing is accepted after the run, so it keeps the last accepted position
+void TestOutlierFilter::runAtEnd()
+{
+    SampleData samples = straightTrack();
+    displace(&samples, 590, 599);
+
+    QVector<SampleRange> uncorrected;
+    const QVector<SampleRange> corrected = OutlierFilter().correct(&samples, &uncorrected);
+    QCOMPARE(corrected.count(), 1);
+    QCOMPARE(corrected.first().first, 590);
+    QCOMPARE(corrected.first().last, 599);
+    QVERIFY(uncorrected.isEmpty());
+    for (int i = 590; i < samples.count(); ++i) {
+        QCOMPARE(samples.at(i).lat, samples.at(589).lat);
+        QCOMPARE(samples.at(i).lon, samples.at(589).lon);
+    }
+}
+
+// A jump that lasts longer than maximumGap() samples is real, and is reported
+void TestOutlierFilter::longRun()
+{
+    const SampleData expected = straightTrack();
+    SampleData samples = expected;
+    displace(&samples, 300, 599);
+    const SampleData displaced = samples;
+
+    OutlierFilter filter;
+    filter.setMaximumGap(60);
+    QVector<SampleRange> uncorrected;
+    const QVector<SampleRange> corrected = filter.correct(&samples, &uncorrected);
+    QVERIFY(corrected.isEmpty());
+    QCOMPARE(uncorrected.count(), 1);
+    QCOMPARE(uncorrected.first().first, 300);
+    QCOMPARE(uncorrected.first().last, 359);
+    for (int i = 0; i < samples.count(); ++i)
+        QCOMPARE(samples.at(i).lat, displaced.at(i).lat);
+}
+
+QTEST_GUILESS_MAIN(TestOutlierFilter)
+#include "tst_outlierfilter.moc"
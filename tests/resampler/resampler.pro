@@ -0,0 +1,5 @@
+TARGET = tst_resampler
+
+include(../tests.pri)
+
+SOURCES += tst_resampler.cpp
@@ -0,0 +1,92 @@
+#include <QtTest/QtTest>
+
+#include "resampler.h"
+
+class TestResampler : public QObject {
+    Q_OBJECT
+private slots:
+    void medianInterval();
+    void slowRecording();
+    void pause();
+    void fixedMaximumGap();
+};
+
+static const qint64 StartTime = Q_INT64_C(1306368108000);
+
+// A sample every \a interval ms, with a pause of \a pause ms after sample \a pauseAfter
+static SampleData track(int count, qint64 interval, int pauseAfter = -1, qint64 pause = 0)
+{
+    SampleData samples;
+    qint64 time = StartTime;
+    for (int i = 0; i < count; ++i) {
+        GpsSample sample;
+        sample.time = time;
+        sample.lat = 59.9 + i * 1e-4;
+        sample.lon = 10.7 - i * 2e-4;
+        sample.ele = 100 + i;
+        sample.speed = 20;
+        sample.hr = 120 + i % 40;
+        sample.cadence = 80;
+        samples.append(sample);
+        time += interval;
+        if (i == pauseAfter)
+            time += pause;
+    }
+    return samples;
+}
+
+void TestResampler::medianInterval()
+{
+    QCOMPARE(Resampler::medianInterval(SampleData()), Q_INT64_C(0));
+    QCOMPARE(Resampler::medianInterval(track(1, 1000)), Q_INT64_C(0));
+    QCOMPARE(Resampler::medianInterval(track(100, 15000, 50, 600000)), Q_INT64_C(15000));
+    QCOMPARE(Resampler::defaultMaximumGap(track(100, 1000)), Q_INT64_C(10000));
+    QCOMPARE(Resampler::defaultMaximumGap(track(100, 15000)), Q_INT64_C(60000));
+}
+
+// A 15 s recording interval is not a gap, every grid point is filled in
+void TestResampler::slowRecording()
+{
+    const SampleData input = track(41, 15000);
+    const SampleData output = Resampler().resample(input);
+    QCOMPARE(output.count(), 40 * 15 + 1);
+    for (int i = 0; i < output.count(); ++i) {
+        const GpsSample &sample = output.at(i);
+        const GpsSample &prev = input.at(i / 15);
+        QCOMPARE(sample.time, StartTime + i * 1000);
+        if (i % 15 == 0) {
+            QCOMPARE(sample.lat, prev.lat);
+            QCOMPARE(sample.lon, prev.lon);
+            QCOMPARE(sample.hr, prev.hr);
+        } else {
+            const GpsSample &next = input.at(i / 15 + 1);
+            QVERIFY(sample.lat > prev.lat && sample.lat < next.lat);
+            QVERIFY(sample.lon < prev.lon && sample.lon > next.lon);
+            QVERIFY(qAbs(sample.lat - (prev.lat + (next.lat - prev.lat) * (i % 15) / 15.0)) < 1e-12);
+        }
+    }
+}
+
+// A ten minute pause in a 15 s recording is left out
+void TestResampler::pause()
+{
+    const SampleData input = track(41, 15000, 19, 600000);
+    const SampleData output = Resampler().resample(input);
+    QCOMPARE(output.count(), (19 * 15 + 1) + (20 * 15 + 1));
+    QCOMPARE(output.at(19 * 15).time, input.at(19).time);
+    QCOMPARE(output.at(19 * 15 + 1).time, input.at(20).time);
+}
+
+void TestResampler::fixedMaximumGap()
+{
+    const SampleData input = track(41, 15000);
+    Resampler resampler;
+    resampler.setMaximumGap(10000);
+    const SampleData output = resampler.resample(input);
+    QCOMPARE(output.count(), input.count());
+    for (int i = 0; i < output.count(); ++i)
+        QCOMPARE(output.at(i).time, input.at(i).time);
+}
+
+QTEST_GUILESS_MAIN(TestResampler)
+#include "tst_resampler.moc"
@@ -0,0 +1,5 @@
+TARGET = tst_samplecache
+
+include(../tests.pri)
+
+SOURCES += tst_samplecache.cpp
@@ -0,0 +1,300 @@
+#include <QtTest/QtTest>
+
+#include "samplecache.h"
+
+/*
+    A cache file must read back exactly what was saved, and anything that
+    makes it unusable (a changed byte, another version or byte order, or a
+    source file that changed since) must make it fail to load, so that it is
+    rewritten.
+*/
+class TestSampleCache : public QObject {
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void roundTrip_data();
+    void roundTrip();
+    void corrupted_data();
+    void corrupted();
+    void rewrittenHeader_data();
+    void rewrittenHeader();
+    void staleSource();
+
+private:
+    QString writeSource(const QString &name);
+
+    QTemporaryDir m_dir;
+};
+
+// The layout of the header in samplecache.cpp
+enum {
+    HeaderSize = 272,
+    VersionOffset = 8,
+    ByteOrderOffset = 12,
+    HeaderCrcOffset = HeaderSize - 4
+};
+
+static SampleData recordedTrack(int count)
+{
+    SampleData samples;
+    samples.metaData.activity = SampleData::Running;
+    samples.metaData.name = QString::fromUtf8("Morning run");
+    samples.metaData.description = QString::fromUtf8("Fr\xc3\xb8ya rundt");
+    const qint64 start = Q_INT64_C(1306368108000);
+    for (int i = 0; i < count; ++i) {
+        GpsSample sample;
+        sample.time = start + i * 1000;
+        sample.lat = 59.9 + i * 1.3e-5;
+        sample.lon = 10.7 - i * 2.1e-5;
+        sample.ele = float((1000 + i % 321) / 10.0);
+        sample.hr = 110 + i % 80;
+        sample.speed = i % 97 == 0 ? -1.0f : float((200 + i % 150) / 10.0);
+        sample.cadence = i % 89 == 0 ? -1 : 70 + i % 30;
+        samples.append(sample);
+    }
+    return samples;
+}
+
+static SampleCacheInfo recordedInfo()
+{
+    SampleCacheInfo info;
+    info.startTime = Q_INT64_C(1306368108000);
+    info.endTime = Q_INT64_C(1306371708000);
+    info.interval = 1;
+    info.flags = SampleCacheInfo::HasAltitude;
+    return info;
+}
+
+// CRC-32 as zlib computes it, bit by bit
+static quint32 crc32(const char *data, int size)
+{
+    quint32 crc = 0xffffffff;
+    for (int i = 0; i < size; ++i) {
+        crc ^= uchar(data[i]);
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+static QByteArray readFile(const QString &fileName)
+{
+    QFile file(fileName);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+static bool writeFile(const QString &fileName, const QByteArray &contents)
+{
+    QFile file(fileName);
+    return file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.write(contents) == contents.size();
+}
+
+void TestSampleCache::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+}
+
+QString TestSampleCache::writeSource(const QString &name)
+{
+    const QString fileName = m_dir.path() + QLatin1Char('/') + name;
+    return writeFile(fileName, "<gpx/>\n") ? fileName : QString();
+}
+
+void TestSampleCache::roundTrip_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::newRow("empty") << 0;
+    QTest::newRow("1 sample") << 1;
+    QTest::newRow("1001 samples") << 1001;
+}
+
+void TestSampleCache::roundTrip()
+{
+    QFETCH(int, count);
+
+    const SampleData samples = recordedTrack(count);
+    SampleCacheInfo info = recordedInfo();
+    info.sourceSize = 12345;
+    info.sourceModified = Q_INT64_C(1306372000000);
+    const QString fileName = m_dir.path() + QLatin1String("/roundtrip.cache");
+    {
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        QVERIFY(SampleCache::save(samples, info, &file));
+    }
+
+    SampleCache cache;
+    QVERIFY(cache.open(fileName));
+    QCOMPARE(cache.count(), count);
+    QCOMPARE(cache.info().sourceSize, info.sourceSize);
+    QCOMPARE(cache.info().sourceModified, info.sourceModified);
+    QCOMPARE(cache.info().startTime, info.startTime);
+    QCOMPARE(cache.info().endTime, info.endTime);
+    QCOMPARE(cache.info().interval, info.interval);
+    QCOMPARE(cache.info().flags, info.flags);
+    QCOMPARE(cache.metaData().activity, samples.metaData.activity);
+    QCOMPARE(cache.metaData().name, samples.metaData.name);
+    QCOMPARE(cache.metaData().description, samples.metaData.description);
+    QCOMPARE(quintptr(cache.time()) % SampleCache::Alignment, quintptr(0));
+    QCOMPARE(quintptr(cache.cadence()) % SampleCache::Alignment, quintptr(0));
+
+    const SampleData loaded = cache.toSampleData();
+    QCOMPARE(loaded.metaData.name, samples.metaData.name);
+    QCOMPARE(loaded.count(), count);
+    for (int i = 0; i < count; ++i) {
+        const GpsSample &a = loaded.at(i);
+        const GpsSample &e = samples.at(i);
+        if (a.time != e.time || a.lat != e.lat || a.lon != e.lon || a.ele != e.ele
+            || a.hr != e.hr || a.speed != e.speed || a.cadence != e.cadence) {
+            QFAIL(qPrintable(QString::fromLatin1("Sample %1 differs").arg(i)));
+        }
+        QCOMPARE(cache.time()[i], e.time);
+    }
+}
+
+void TestSampleCache::corrupted_data()
+{
+    QTest::addColumn<QString>("region");
+    const char *regions[] = {
+        "magic", "header", "header checksum", "name", "description",
+        "time", "lat", "lon", "ele", "hr", "speed", "cadence", "truncated"
+    };
+    for (int i = 0; i < int(sizeof(regions) / sizeof(regions[0])); ++i)
+        QTest::newRow(regions[i]) << QString::fromLatin1(regions[i]);
+}
+
+// Flips a bit in \a region of a cache that loads, which must make it fail to load
+void TestSampleCache::corrupted()
+{
+    QFETCH(QString, region);
+
+    const SampleData samples = recordedTrack(1001);
+    const QString source = writeSource(QLatin1String("corrupted.gpx"));
+    QVERIFY(!source.isEmpty());
+    QVERIFY(saveCachedSamples(samples, recordedInfo(), source));
+    const QString fileName = sampleCacheFileName(source);
+    QByteArray contents = readFile(fileName);
+    QCOMPARE(contents.indexOf(samples.metaData.name.toUtf8()), int(HeaderSize));
+
+    // Column offsets, from where the mapped columns are relative to each other
+    int offset = -1;
+    {
+        SampleCache cache;
+        QVERIFY(cache.open(fileName));
+        const char *first = reinterpret_cast<const char *>(cache.time());
+        const char *columns[] = {
+            first, reinterpret_cast<const char *>(cache.lat()), reinterpret_cast<const char *>(cache.lon()),
+            reinterpret_cast<const char *>(cache.ele()), reinterpret_cast<const char *>(cache.hr()),
+            reinterpret_cast<const char *>(cache.speed()), reinterpret_cast<const char *>(cache.cadence())
+        };
+        const int columnSizes[] = { 8, 8, 8, 4, 4, 4, 4 };
+        const char *names[] = { "time", "lat", "lon", "ele", "hr", "speed", "cadence" };
+        const int firstOffset = contents.size() - samples.count() * 4 - int(columns[6] - first);
+        for (int i = 0; i < 7; ++i) {
+            if (region == QLatin1String(names[i]))
+                offset = firstOffset + int(columns[i] - first) + samples.count() * columnSizes[i] / 2;
+        }
+    }
+    if (region == QLatin1String("magic"))
+        offset = 0;
+    else if (region == QLatin1String("header"))
+        offset = 40;    // endTime
+    else if (region == QLatin1String("header checksum"))
+        offset = HeaderCrcOffset;
+    else if (region == QLatin1String("name"))
+        offset = HeaderSize;
+    else if (region == QLatin1String("description"))
+        offset = contents.indexOf(samples.metaData.description.toUtf8());
+
+    if (region == QLatin1String("truncated")) {
+        contents.chop(1);
+    } else {
+        QVERIFY(offset >= 0 && offset < contents.size());
+        contents[offset] = char(contents.at(offset) ^ 0x10);
+    }
+    QVERIFY(writeFile(fileName, contents));
+
+    SampleCache cache;
+    QVERIFY(!cache.open(fileName));
+    QVERIFY(!cache.isOpen());
+    SampleData loaded;
+    SampleCacheInfo info;
+    QVERIFY(!loadCachedSamples(&loaded, &info, source));
+}
+
+void TestSampleCache::rewrittenHeader_data()
+{
+    QTest::addColumn<int>("offset");
+    QTest::addColumn<quint32>("value");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("unchanged") << int(VersionOffset) << quint32(SampleCache::Version) << true;
+    QTest::newRow("older version") << int(VersionOffset) << quint32(SampleCache::Version - 1) << false;
+    QTest::newRow("newer version") << int(VersionOffset) << quint32(SampleCache::Version + 1) << false;
+    QTest::newRow("other byte order") << int(ByteOrderOffset) << quint32(0x04030201) << false;
+}
+
+// Changes a header field and writes a matching checksum, so only the field is wrong
+void TestSampleCache::rewrittenHeader()
+{
+    QFETCH(int, offset);
+    QFETCH(quint32, value);
+    QFETCH(bool, valid);
+
+    const QString fileName = m_dir.path() + QLatin1String("/header.cache");
+    {
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        QVERIFY(SampleCache::save(recordedTrack(100), recordedInfo(), &file));
+    }
+    QByteArray contents = readFile(fileName);
+    memcpy(contents.data() + offset, &value, sizeof(value));
+    const quint32 crc = crc32(contents.constData(), HeaderCrcOffset);
+    memcpy(contents.data() + HeaderCrcOffset, &crc, sizeof(crc));
+    QVERIFY(writeFile(fileName, contents));
+
+    SampleCache cache;
+    QCOMPARE(cache.open(fileName), valid);
+}
+
+void TestSampleCache::staleSource()
+{
+    const SampleData samples = recordedTrack(100);
+    const QString source = writeSource(QLatin1String("stale.gpx"));
+    QVERIFY(!source.isEmpty());
+    QVERIFY(saveCachedSamples(samples, recordedInfo(), source));
+
+    SampleData loaded;
+    SampleCacheInfo info;
+    QVERIFY(loadCachedSamples(&loaded, &info, source));
+    QCOMPARE(loaded.count(), samples.count());
+    QCOMPARE(info.sourceSize, QFileInfo(source).size());
+    QCOMPARE(info.interval, recordedInfo().interval);
+
+    // Same size, older modification time
+    QFile file(source);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    const QDateTime modified = QFileInfo(source).lastModified();
+    QVERIFY(file.setFileTime(modified.addSecs(-3600), QFileDevice::FileModificationTime));
+    file.close();
+    QVERIFY(!loadCachedSamples(&loaded, &info, source));
+
+    // Same modification time, another size
+    QVERIFY(saveCachedSamples(samples, recordedInfo(), source));
+    QVERIFY(loadCachedSamples(&loaded, &info, source));
+    const QDateTime cached = QFileInfo(source).lastModified();
+    QVERIFY(file.open(QIODevice::Append));
+    QCOMPARE(file.write("\n"), qint64(1));
+    QVERIFY(file.flush());
+    QVERIFY(file.setFileTime(cached, QFileDevice::FileModificationTime));
+    file.close();
+    QCOMPARE(QFileInfo(source).lastModified(), cached);
+    QVERIFY(!loadCachedSamples(&loaded, &info, source));
+
+    // No source at all
+    QVERIFY(QFile::remove(source));
+    QVERIFY(!loadCachedSamples(&loaded, &info, source));
+}
+
+QTEST_GUILESS_MAIN(TestSampleCache)
+#include "tst_samplecache.moc"
@@ -0,0 +1,5 @@
+TARGET = tst_samplecolumns
+
+include(../tests.pri)
+
+SOURCES += tst_samplecolumns.cpp
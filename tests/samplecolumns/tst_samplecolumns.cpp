@@ -0,0 +1,199 @@
+#include <QtTest/QtTest>
+
+#include "samplecolumns.h"
+
+/*
+    Compares SampleColumns with SampleData on a session of a million samples:
+    the single field kernels must give the same results, and the benchmarks
+    run each kernel on both layouts.
+*/
+class TestSampleColumns : public QObject {
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void roundTrip();
+    void sameResults();
+    void averageHR_data();
+    void averageHR();
+    void maximumHR_data();
+    void maximumHR();
+    void indexOfTime_data();
+    void indexOfTime();
+    void correctAltitudes_data();
+    void correctAltitudes();
+
+private:
+    SampleData m_samples;
+    SampleColumns m_columns;
+};
+
+static const int SampleCount = 1000000;
+
+static void addLayouts()
+{
+    QTest::addColumn<bool>("columns");
+    QTest::newRow("SampleData") << false;
+    QTest::newRow("SampleColumns") << true;
+}
+
+// About twelve days of 1 Hz samples, or a long season of rides
+void TestSampleColumns::initTestCase()
+{
+    const qint64 start = Q_INT64_C(1306368108000);
+    m_samples.reserve(SampleCount);
+    for (int i = 0; i < SampleCount; ++i) {
+        GpsSample sample;
+        sample.time = start + i * Q_INT64_C(1000);
+        sample.lat = 59.9 + (i % 3600) * 1e-5;
+        sample.lon = 10.7 + (i % 3600) * 2e-5;
+        sample.ele = 100.0f + (i % 500) * 0.2f;
+        sample.hr = 100 + (i * 7) % 93;
+        sample.speed = (i % 400) * 0.1f;
+        sample.cadence = 60 + i % 40;
+        m_samples.append(sample);
+    }
+    m_columns = SampleColumns(m_samples);
+}
+
+void TestSampleColumns::cleanupTestCase()
+{
+    m_samples.clear();
+    m_columns.clear();
+}
+
+void TestSampleColumns::roundTrip()
+{
+    QCOMPARE(m_columns.count(), m_samples.count());
+    const SampleData samples = m_columns.toSampleData();
+    QCOMPARE(samples.count(), m_samples.count());
+    for (int i = 0; i < samples.count(); i += 997) {
+        const GpsSample &expected = m_samples.at(i);
+        const GpsSample actual = m_columns.at(i);
+        QCOMPARE(samples.at(i).time, expected.time);
+        QCOMPARE(actual.time, expected.time);
+        QCOMPARE(actual.lat, expected.lat);
+        QCOMPARE(actual.lon, expected.lon);
+        QCOMPARE(actual.ele, expected.ele);
+        QCOMPARE(actual.hr, expected.hr);
+        QCOMPARE(actual.speed, expected.speed);
+        QCOMPARE(actual.cadence, expected.cadence);
+    }
+}
+
+void TestSampleColumns::sameResults()
+{
+    QCOMPARE(m_columns.averageHR(), m_samples.averageHR());
+    QCOMPARE(m_columns.maximumHR(), m_samples.maximumHR());
+    QCOMPARE(m_columns.startTime(), m_samples.startTime());
+    QCOMPARE(m_columns.endTime(), m_samples.endTime());
+    const qint64 times[] = { m_samples.startTime() - 1, m_samples.startTime() + 1500,
+                             m_samples.endTime() - 500, m_samples.endTime() + 1 };
+    for (size_t i = 0; i < sizeof(times) / sizeof(times[0]); ++i)
+        QCOMPARE(m_columns.indexOfTime(times[i]), m_samples.indexOfTime(times[i]));
+
+    SampleData samples = m_samples;
+    SampleColumns columns = m_columns;
+    samples.correctAltitudes(250.0f, 180.0f);
+    columns.correctAltitudes(250.0f, 180.0f);
+    for (int i = 0; i < samples.count(); ++i)
+        QCOMPARE(columns.ele()[i], samples.at(i).ele);
+}
+
+void TestSampleColumns::averageHR_data()
+{
+    addLayouts();
+}
+
+void TestSampleColumns::averageHR()
+{
+    QFETCH(bool, columns);
+
+    float average = 0;
+    if (columns) {
+        QBENCHMARK {
+            average = m_columns.averageHR();
+        }
+    } else {
+        QBENCHMARK {
+            average = m_samples.averageHR();
+        }
+    }
+    QVERIFY(average > 100);
+}
+
+void TestSampleColumns::maximumHR_data()
+{
+    addLayouts();
+}
+
+void TestSampleColumns::maximumHR()
+{
+    QFETCH(bool, columns);
+
+    int maximum = 0;
+    if (columns) {
+        QBENCHMARK {
+            maximum = m_columns.maximumHR();
+        }
+    } else {
+        QBENCHMARK {
+            maximum = m_samples.maximumHR();
+        }
+    }
+    QCOMPARE(maximum, 192);
+}
+
+void TestSampleColumns::indexOfTime_data()
+{
+    addLayouts();
+}
+
+// A thousand lookups spread over the session, like TrackMerger does for each lap
+void TestSampleColumns::indexOfTime()
+{
+    QFETCH(bool, columns);
+
+    const qint64 start = m_samples.startTime();
+    const qint64 step = (m_samples.endTime() - start) / 1000;
+    qint64 sum = 0;
+    if (columns) {
+        QBENCHMARK {
+            sum = 0;
+            for (int i = 0; i < 1000; ++i)
+                sum += m_columns.indexOfTime(start + i * step);
+        }
+    } else {
+        QBENCHMARK {
+            sum = 0;
+            for (int i = 0; i < 1000; ++i)
+                sum += m_samples.indexOfTime(start + i * step);
+        }
+    }
+    QVERIFY(sum > 0);
+}
+
+void TestSampleColumns::correctAltitudes_data()
+{
+    addLayouts();
+}
+
+void TestSampleColumns::correctAltitudes()
+{
+    QFETCH(bool, columns);
+
+    SampleData samples = m_samples;
+    SampleColumns sampleColumns = m_columns;
+    if (columns) {
+        QBENCHMARK {
+            sampleColumns.correctAltitudes(250.0f, 180.0f);
+        }
+    } else {
+        QBENCHMARK {
+            samples.correctAltitudes(250.0f, 180.0f);
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(TestSampleColumns)
+#include "tst_samplecolumns.moc"
@@ -0,0 +1,8 @@
+# Every test is its own application, built with the hrmgpx sources
+TEMPLATE = app
+QT += core concurrent testlib
+QT -= gui
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+include(../src/hrmgpx.pri)
@@ -0,0 +1,15 @@
+TEMPLATE = subdirs
+SUBDIRS = \
+    compactsamplestore \
+    compresseddevice \
+    fitfile \
+    geo \
+    gpxparser \
+    gpxwriter \
+    haversine \
+    iso8601 \
+    outlierfilter \
+    resampler \
+    samplecache \
+    samplecolumns \
+    tracksimplifier
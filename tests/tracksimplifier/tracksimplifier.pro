@@ -0,0 +1,5 @@
+TARGET = tst_tracksimplifier
+
+include(../tests.pri)
+
+SOURCES += tst_tracksimplifier.cpp
@@ -0,0 +1,99 @@
+#include <QtTest/QtTest>
+
+#include <math.h>
+#include "tracksimplifier.h"
+
+/*
+    Samples off a long straight track are kept or removed by their distance on
+    the ground, wherever on the track they are.
+*/
+class TestTrackSimplifier : public QObject {
+    Q_OBJECT
+private slots:
+    void straightTrack_data();
+    void straightTrack();
+    void longTrack_data();
+    void longTrack();
+};
+
+static const qint64 StartTime = Q_INT64_C(1306368108000);
+static const double MetersPerDegree = 6371000.0 * 3.14159265358979323846 / 180.0;
+
+// A sample every 0.1 degrees north along lon 10, from the equator to lat 80
+static SampleData meridian()
+{
+    SampleData samples;
+    for (int i = 0; i <= 800; ++i) {
+        GpsSample sample;
+        sample.time = StartTime + i * 1000;
+        sample.lat = i / 10.0;
+        sample.lon = 10.0;
+        sample.ele = 100;
+        sample.speed = 20;
+        sample.hr = 120;
+        sample.cadence = 80;
+        samples.append(sample);
+    }
+    return samples;
+}
+
+// Moves sample \a index \a meters east
+static void moveEast(SampleData *samples, int index, double meters)
+{
+    GpsSample &sample = (*samples)[index];
+    sample.lon += meters / (MetersPerDegree * cos(sample.lat * 3.14159265358979323846 / 180.0));
+}
+
+void TestTrackSimplifier::straightTrack_data()
+{
+    QTest::addColumn<int>("method");
+    QTest::newRow("Douglas-Peucker") << int(TrackSimplifier::DouglasPeucker);
+    QTest::newRow("Visvalingam-Whyatt") << int(TrackSimplifier::VisvalingamWhyatt);
+}
+
+void TestTrackSimplifier::straightTrack()
+{
+    QFETCH(int, method);
+    TrackSimplifier simplifier;
+    simplifier.setMethod(TrackSimplifier::Method(method));
+    const SampleData samples = meridian();
+    const SampleData result = simplifier.simplify(samples);
+    QCOMPARE(result.count(), 2);
+    QCOMPARE(result.at(0).time, samples.first().time);
+    QCOMPARE(result.at(1).time, samples.last().time);
+}
+
+void TestTrackSimplifier::longTrack_data()
+{
+    QTest::addColumn<int>("index");
+    QTest::addColumn<double>("meters");
+    QTest::addColumn<bool>("kept");
+
+    // The tolerance is 5 m; a projection around lat 40 would see these as
+    // 4.6 m and 6.7 m
+    QTest::newRow("6 m at lat 1") << 10 << 6.0 << true;
+    QTest::newRow("3 m at lat 70") << 700 << 3.0 << false;
+    QTest::newRow("4.5 m at lat 0.1") << 1 << 4.5 << false;
+    QTest::newRow("5.5 m at lat 79.9") << 799 << 5.5 << true;
+}
+
+void TestTrackSimplifier::longTrack()
+{
+    QFETCH(int, index);
+    QFETCH(double, meters);
+    QFETCH(bool, kept);
+
+    SampleData samples = meridian();
+    moveEast(&samples, index, meters);
+    const SampleData result = TrackSimplifier().simplify(samples);
+    bool found = false;
+    for (int i = 0; i < result.count(); ++i)
+        found = found || result.at(i).time == samples.at(index).time;
+    QCOMPARE(found, kept);
+    if (!kept)
+        QCOMPARE(result.count(), 2);
+}
+
+QTEST_GUILESS_MAIN(TestTrackSimplifier)
+
+#include "tst_tracksimplifier.moc"